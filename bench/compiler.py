@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""
+Compiler throughput benchmark: generates synthetic programs of growing size with gen.py and measures how long stp
+takes and how much memory it needs for each phase.
+
+    python3 bench/compiler.py [--stp ./stp] [--scales 1,2,4,8,16] [--level 2] [--repeat 3] [--output results.json]
+
+Scale s multiplies the classes and functions of the base program (--classes, --functions), so the source grows
+linearly with it. --methods, --fields, --depth and --statements shape the program at every scale. Every phase is
+timed by compiling with --stop-after=<phase> and subtracting the time of the phase before it, so each number covers
+that phase alone. Memory is the max RSS of the compile up to the phase.
+
+Between consecutive scales the source grows by some factor. A phase whose time grows faster than that factor to the
+power --threshold (default 1.3) is flagged as superlinear, as long as it takes at least --min-time seconds. Flags are
+reported on stderr and in the JSON, the exit status is only 1 for them with --fail-on-superlinear.
+"""
+
+import argparse
+import json
+import math
+import os
+import statistics
+import subprocess
+import sys
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+
+# --stop-after phases in the order stp runs them, "emit" is the full compile
+PHASES = ["lex", "parse", "sema", "codegen", "optimize", "emit"]
+
+
+def run_checked(command):
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+    if result.returncode != 0:
+        raise RuntimeError("%s failed:\n%s" % (" ".join(command), result.stderr))
+
+
+def compile_stats(measure_exe, command, repeat, stats_file):
+    walls = []
+    max_rss = 0
+    for _ in range(repeat):
+        run_checked([measure_exe, stats_file] + command)
+        with open(stats_file) as stats:
+            wall, rss, status = stats.read().split()
+        if int(status) != 0:
+            raise RuntimeError("%s exited with status %s" % (" ".join(command), status))
+        walls.append(float(wall))
+        max_rss = max(max_rss, int(rss))
+    return statistics.median(walls), max_rss
+
+
+def main():
+    parser = argparse.ArgumentParser(description="stp compile time and memory at growing input sizes")
+    parser.add_argument("--stp", default="./stp")
+    parser.add_argument("--cc", default="cc")
+    parser.add_argument("--scales", default="1,2,4,8,16")
+    parser.add_argument("--classes", type=int, default=20)
+    parser.add_argument("--methods", type=int, default=5)
+    parser.add_argument("--fields", type=int, default=8)
+    parser.add_argument("--depth", type=int, default=10)
+    parser.add_argument("--statements", type=int, default=20)
+    parser.add_argument("--functions", type=int, default=20)
+    parser.add_argument("--level", type=int, default=2, help="-O level of the compile")
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--threshold", type=float, default=1.3)
+    parser.add_argument("--min-time", type=float, default=0.05)
+    parser.add_argument("--fail-on-superlinear", action="store_true", help="exit with 1 when a phase is flagged")
+    parser.add_argument("--build-dir", default="build/bench")
+    parser.add_argument("--output", help="write the JSON here instead of stdout")
+    args = parser.parse_args()
+
+    os.makedirs(args.build_dir, exist_ok=True)
+    measure_exe = os.path.join(args.build_dir, "measure")
+    run_checked([args.cc, "-O2", "-o", measure_exe, os.path.join(BENCH_DIR, "measure.c")])
+    stats_file = os.path.join(args.build_dir, "stats")
+
+    results = []
+    for scale in [int(scale) for scale in args.scales.split(",")]:
+        source = os.path.join(args.build_dir, "synthetic.%d.stp" % scale)
+        run_checked([sys.executable, os.path.join(BENCH_DIR, "gen.py"),
+                     "--classes", str(args.classes * scale), "--methods", str(args.methods),
+                     "--fields", str(args.fields), "--depth", str(args.depth),
+                     "--statements", str(args.statements), "--functions", str(args.functions * scale),
+                     "-o", source])
+
+        entry = {"scale": scale, "source_bytes": os.path.getsize(source), "phases": {}}
+        previous = 0.0
+        for phase in PHASES:
+            command = [args.stp, "-O%d" % args.level, "-o", os.path.join(args.build_dir, "synthetic.ll"), source]
+            if phase != "emit":
+                command.insert(1, "--stop-after=" + phase)
+            wall, max_rss = compile_stats(measure_exe, command, args.repeat, stats_file)
+            entry["phases"][phase] = {"wall_s": max(wall - previous, 0.0), "cumulative_wall_s": wall,
+                                      "max_rss_kb": max_rss}
+            previous = wall
+        results.append(entry)
+
+        print("scale %3d  %9d bytes  %s" % (scale, entry["source_bytes"],
+              "  ".join("%s %.3fs" % (phase, entry["phases"][phase]["wall_s"]) for phase in PHASES)), file=sys.stderr)
+
+    # growth exponent of every phase against the source size between consecutive scales
+    flags = []
+    for before, after in zip(results, results[1:]):
+        growth = after["source_bytes"] / float(before["source_bytes"])
+        for phase in PHASES:
+            time_before = before["phases"][phase]["wall_s"]
+            time_after = after["phases"][phase]["wall_s"]
+            if time_before <= 0 or time_after < args.min_time:
+                continue
+            exponent = math.log(time_after / time_before) / math.log(growth)
+            after["phases"][phase]["growth_exponent"] = exponent
+            if exponent > args.threshold:
+                flags.append({"phase": phase, "from_scale": before["scale"], "to_scale": after["scale"],
+                              "exponent": exponent})
+                print("superlinear: %s grows with exponent %.2f from scale %d to %d" %
+                      (phase, exponent, before["scale"], after["scale"]), file=sys.stderr)
+
+    report = json.dumps({"stp": os.path.abspath(args.stp), "results": results, "superlinear": flags}, indent=2)
+    if args.output:
+        with open(args.output, "w") as output:
+            output.write(report + "\n")
+    else:
+        print(report)
+    return 1 if flags and args.fail_on_superlinear else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,24 @@
+BENCH_PATH := $(call my-dir)
+
+.PHONY: bench
+
+# runs the execution benchmarks against the freshly built compiler and runtime, BENCH_ARGS are passed to run.py
+bench: stp stp_runtime
+	python3 $(BENCH_PATH)run.py --stp ./stp --runtime $(BUILDDIR)/stp_runtime/stp_runtime.a \
+		--build-dir $(BUILDDIR)/bench --output $(BUILDDIR)/bench/results.json $(BENCH_ARGS)
+
+.PHONY: bench-compiler
+
+# compile time and memory of every phase at growing synthetic input sizes, BENCH_ARGS are passed to compiler.py
+bench-compiler: stp
+	python3 $(BENCH_PATH)compiler.py --stp ./stp --build-dir $(BUILDDIR)/bench \
+		--output $(BUILDDIR)/bench/compiler.json $(BENCH_ARGS)
+
+.PHONY: bench-runtime
+
+# ns/op of the runtime primitives at 1..N threads, BENCH_ARGS are passed to micro
+bench-runtime: stp_runtime
+	mkdir -p $(BUILDDIR)/bench
+	$(CC) -std=gnu99 -O2 -pthread -o $(BUILDDIR)/bench/micro $(BENCH_PATH)micro.c \
+		$(BUILDDIR)/stp_runtime/stp_runtime.a -lm
+	$(BUILDDIR)/bench/micro --json $(BUILDDIR)/bench/runtime.json $(BENCH_ARGS)
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+Generates a synthetic Staple program for compiler throughput measurements.
+
+    python3 bench/gen.py --classes 100 --methods 10 --fields 8 --depth 10 --statements 50 --functions 100 > big.stp
+
+Classes form inheritance chains of --depth classes. Every class has --fields fields and --methods methods, and every
+method and global function body has --statements statements. Methods alternate between their own class's fields and
+this.f accesses to the fields inherited from their ancestors, which the field lookup finds up the chain. main creates
+one object of every class and calls every function, so nothing is dead.
+"""
+
+import argparse
+import sys
+
+
+def body(out, statements, fields, indent, call=None, inherited=()):
+    """arithmetic on locals, the argument and the given fields, with an if every few statements. Odd statements access
+    the inherited fields through this when there are any. call is added to the returned value"""
+    out.append("%sint v0 = a + 1;" % indent)
+    for s in range(1, statements):
+        if inherited and s % 2 == 1:
+            operand = "this." + inherited[(s // 2) % len(inherited)]
+        else:
+            operand = fields[s % len(fields)] if fields else "a"
+        if s % 7 == 0:
+            out.append("%sif(v%d > %s) {" % (indent, s - 1, operand))
+            out.append("%s  v%d = v%d - %s;" % (indent, s - 1, s - 1, operand))
+            out.append("%s}" % indent)
+            out.append("%sint v%d = v%d;" % (indent, s, s - 1))
+        elif s % 3 == 0:
+            out.append("%sint v%d = v%d * 3 - %s;" % (indent, s, s - 1, operand))
+        else:
+            out.append("%sint v%d = v%d + %s;" % (indent, s, s - 1, operand))
+    out.append("%sreturn v%d%s;" % (indent, statements - 1, " + " + call if call else ""))
+
+
+def generate(args):
+    out = []
+
+    inherited = []
+    for c in range(args.classes):
+        parent = c - 1 if c % args.depth != 0 else None
+        out.append("class C%d%s {" % (c, " extends C%d" % parent if parent is not None else ""))
+        if parent is None:
+            inherited = []
+        fields = ["f%d_%d" % (c, f) for f in range(args.fields)]
+        for field in fields:
+            out.append("  int %s;" % field)
+        for m in range(args.methods):
+            out.append("")
+            out.append("  int m%d_%d(int a) {" % (c, m))
+            body(out, args.statements, fields, "    ", inherited=inherited)
+            out.append("  }")
+        out.append("}")
+        out.append("")
+        # farthest ancestors first, so every depth of the chain gets used
+        inherited = inherited + fields
+
+    # each function calls the one before it
+    for f in range(args.functions):
+        out.append("int fn%d(int a) {" % f)
+        body(out, args.statements, [], "  ", "fn%d(a - 1)" % (f - 1) if f > 0 else None)
+        out.append("}")
+        out.append("")
+
+    out.append("int main(int argc, uint8** argv) {")
+    out.append("  int total = 0;")
+    for c in range(args.classes):
+        out.append("  C%d* o%d = new C%d;" % (c, c, c))
+        for m in range(args.methods):
+            out.append("  total = total + o%d.m%d_%d(%d);" % (c, c, m, m))
+    for f in range(args.functions):
+        out.append("  total = total + fn%d(%d);" % (f, f))
+    out.append('  printf("%d", total);')
+    out.append("  return 0;")
+    out.append("}")
+    out.append("")
+    out.append("")
+    out.append("extern int printf(uint8*, ...)")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="synthetic Staple program generator")
+    parser.add_argument("--classes", type=int, default=10)
+    parser.add_argument("--methods", type=int, default=5)
+    parser.add_argument("--fields", type=int, default=4)
+    parser.add_argument("--depth", type=int, default=5, help="classes per inheritance chain")
+    parser.add_argument("--statements", type=int, default=20, help="statements per method and function body")
+    parser.add_argument("--functions", type=int, default=10)
+    parser.add_argument("-o", "--output", help="write here instead of stdout")
+    args = parser.parse_args()
+    if args.depth < 1 or args.statements < 1:
+        parser.error("--depth and --statements must be at least 1")
+
+    program = generate(args)
+    if args.output:
+        with open(args.output, "w") as output:
+            output.write(program)
+    else:
+        sys.stdout.write(program)
+
+
+if __name__ == "__main__":
+    main()
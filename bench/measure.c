@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * measure <stats file> <program> [args...]
+ *
+ * runs the program and writes "<wall seconds> <max rss kb> <exit status>" to the stats file. Forking from this small
+ * process instead of python keeps the interpreter's memory out of the child's max RSS.
+ */
+int main(int argc, char** argv) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: measure <stats file> <program> [args...]\n");
+        return 2;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        execv(argv[2], &argv[2]);
+        perror(argv[2]);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if(pid < 0 || wait4(pid, &status, 0, &usage) < 0) {
+        perror("measure");
+        return 2;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    FILE* stats = fopen(argv[1], "w");
+    if(stats == NULL) {
+        perror(argv[1]);
+        return 2;
+    }
+    fprintf(stats, "%.9f %ld %d\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9,
+            usage.ru_maxrss, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+    fclose(stats);
+    return 0;
+}
@@ -0,0 +1,374 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Microbenchmarks of the runtime primitives generated code calls, linked against stp_runtime.a so they measure the
+ * runtime as it is built.
+ *
+ *     micro [--threads 1,2,4,8] [--batches 200] [--batch-size 10000] [--json file] [benchmark ...]
+ *
+ * Every thread runs --batches timed batches of --batch-size operations. The ns/op of each batch is one sample, the
+ * percentiles are over the samples of all threads. Benchmarks marked shared also run with every thread on the same
+ * object, the contended case, next to private where every thread has its own. Thread counts default to powers of
+ * two up to the number of cpus.
+ */
+
+struct obj;
+
+struct obj_vtable {
+    void (*kill)(struct obj*);
+};
+
+struct obj_class {
+    const char* className;
+    struct obj_class* parent;
+    struct obj_vtable vtable;
+};
+
+struct obj {
+    struct obj_class* class;
+    int32_t refCount;
+};
+
+//runtime.ll
+extern struct obj_class obj_class_def;
+void obj_init(struct obj* o);
+void stp_retain(struct obj* value);
+void stp_release(struct obj* value);
+void stp_storeStrong(struct obj** dest, struct obj* value);
+
+//heap.c
+struct stp_alloc_site;
+void* stp_alloc(int32_t size, struct stp_alloc_site* site);
+void stp_free(void* ptr);
+
+static void freeObject(struct obj* o) {
+    stp_free(o);
+}
+
+//a class whose destructor frees the object like a generated kill does
+static struct obj_class freeingClass = { "micro", &obj_class_def, { freeObject } };
+
+//padded so private objects of different threads do not share cache lines
+struct paddedObj {
+    struct obj obj;
+    char padding[64 - sizeof(struct obj)];
+} __attribute__((aligned(64)));
+
+struct worker {
+    pthread_t thread;
+    struct obj* target;
+    struct obj* other;
+    struct obj* slot;
+    double* samples;
+    struct paddedObj own[2];
+};
+
+typedef void (*benchFunction)(struct worker* worker, int64_t n);
+
+static void benchRetain(struct worker* worker, int64_t n) {
+    int64_t i;
+    for(i = 0; i < n; i++) {
+        stp_retain(worker->target);
+    }
+}
+
+static void benchRelease(struct worker* worker, int64_t n) {
+    int64_t i;
+    for(i = 0; i < n; i++) {
+        stp_release(worker->target);
+    }
+}
+
+static void benchStoreStrong(struct worker* worker, int64_t n) {
+    int64_t i;
+    for(i = 0; i < n; i += 2) {
+        stp_storeStrong(&worker->slot, worker->target);
+        stp_storeStrong(&worker->slot, worker->other);
+    }
+}
+
+static void benchObjInit(struct worker* worker, int64_t n) {
+    int64_t i;
+    for(i = 0; i < n; i++) {
+        obj_init(worker->target);
+    }
+}
+
+static void benchDispatch(struct worker* worker, int64_t n) {
+    struct obj* target = worker->target;
+    int64_t i;
+    for(i = 0; i < n; i++) {
+        target->class->vtable.kill(target);
+    }
+}
+
+static void benchAllocFree(struct worker* worker, int64_t n) {
+    int64_t i;
+    for(i = 0; i < n; i++) {
+        stp_free(stp_alloc(32, NULL));
+    }
+}
+
+//new, one more reference and both releases: the whole life of a short lived object
+static void benchNewRelease(struct worker* worker, int64_t n) {
+    int64_t i;
+    for(i = 0; i < n; i++) {
+        struct obj* o = stp_alloc(32, NULL);
+        o->class = &freeingClass;
+        obj_init(o);
+        stp_retain(o);
+        stp_release(o);
+        stp_release(o);
+    }
+}
+
+struct benchmark {
+    const char* name;
+    benchFunction run;
+    //also run with all threads on one object
+    int shared;
+    //retains of the target before each batch, so releases never destroy it
+    int retainFirst;
+};
+
+static const struct benchmark benchmarks[] = {
+    { "retain", benchRetain, 1, 0 },
+    { "release", benchRelease, 1, 1 },
+    { "storeStrong", benchStoreStrong, 1, 0 },
+    { "obj_init", benchObjInit, 0, 0 },
+    { "dispatch", benchDispatch, 0, 0 },
+    { "alloc_free", benchAllocFree, 0, 0 },
+    { "new_release", benchNewRelease, 0, 0 },
+};
+
+#define NUM_BENCHMARKS (int)(sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static int numBatches = 200;
+static int64_t batchSize = 10000;
+
+static const struct benchmark* current;
+static pthread_barrier_t startBarrier;
+//objects every thread works on in the shared case
+static struct paddedObj sharedObj[2];
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void* runWorker(void* arg) {
+    struct worker* worker = arg;
+    int batch;
+
+    //one untimed batch to warm up caches and the allocator
+    if(current->retainFirst) {
+        benchRetain(worker, batchSize);
+    }
+    current->run(worker, batchSize);
+    pthread_barrier_wait(&startBarrier);
+
+    for(batch = 0; batch < numBatches; batch++) {
+        if(current->retainFirst) {
+            benchRetain(worker, batchSize);
+        }
+        double start = now();
+        current->run(worker, batchSize);
+        worker->samples[batch] = (now() - start) * 1e9 / batchSize;
+    }
+    return NULL;
+}
+
+static int compareDouble(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static double percentile(const double* sorted, int count, double p) {
+    int index = (int)(p / 100 * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static void initObject(struct obj* o) {
+    o->class = &obj_class_def;
+    obj_init(o);
+    //owned by the benchmark, so no release brings it to zero
+    o->refCount = 1;
+}
+
+static void runBenchmark(const struct benchmark* benchmark, int shared, int numThreads, FILE* json, int* first) {
+    struct worker* workers = NULL;
+    double* samples = malloc(sizeof(double) * numBatches * numThreads);
+    int i;
+
+    if(posix_memalign((void**)&workers, 64, sizeof(struct worker) * numThreads) != 0 || samples == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    current = benchmark;
+    initObject(&sharedObj[0].obj);
+    initObject(&sharedObj[1].obj);
+    memset(workers, 0, sizeof(struct worker) * numThreads);
+    for(i = 0; i < numThreads; i++) {
+        struct worker* worker = &workers[i];
+        initObject(&worker->own[0].obj);
+        initObject(&worker->own[1].obj);
+        worker->target = shared ? &sharedObj[0].obj : &worker->own[0].obj;
+        worker->other = shared ? &sharedObj[1].obj : &worker->own[1].obj;
+        worker->samples = &samples[i * numBatches];
+    }
+
+    pthread_barrier_init(&startBarrier, NULL, numThreads + 1);
+    for(i = 0; i < numThreads; i++) {
+        pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]);
+    }
+    pthread_barrier_wait(&startBarrier);
+    double start = now();
+    for(i = 0; i < numThreads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    double wall = now() - start;
+    pthread_barrier_destroy(&startBarrier);
+
+    int count = numBatches * numThreads;
+    double mean = 0;
+    for(i = 0; i < count; i++) {
+        mean += samples[i];
+    }
+    mean /= count;
+    qsort(samples, count, sizeof(double), compareDouble);
+    double mops = numBatches * batchSize * (double)numThreads / wall / 1e6;
+    const char* sharing = shared ? "shared" : "private";
+
+    printf("%-12s %-8s %3d  %8.2f %8.2f %8.2f %8.2f %8.2f  %10.2f\n", benchmark->name, sharing, numThreads, mean,
+           percentile(samples, count, 50), percentile(samples, count, 90), percentile(samples, count, 99),
+           samples[count - 1], mops);
+    fflush(stdout);
+
+    if(json != NULL) {
+        fprintf(json, "%s\n    {\"benchmark\": \"%s\", \"sharing\": \"%s\", \"threads\": %d, \"ns_per_op\": "
+                "{\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"min\": %.3f, \"max\": %.3f}, "
+                "\"mops_per_s\": %.3f}", *first ? "" : ",", benchmark->name, sharing, numThreads, mean,
+                percentile(samples, count, 50), percentile(samples, count, 90), percentile(samples, count, 99),
+                samples[0], samples[count - 1], mops);
+        *first = 0;
+    }
+
+    free(samples);
+    free(workers);
+}
+
+static int parseThreads(const char* list, int* threads, int max) {
+    int count = 0;
+    char* copy = strdup(list);
+    char* token;
+    for(token = strtok(copy, ","); token != NULL && count < max; token = strtok(NULL, ",")) {
+        threads[count] = atoi(token);
+        if(threads[count] < 1) {
+            fprintf(stderr, "invalid thread count: %s\n", token);
+            exit(2);
+        }
+        count++;
+    }
+    free(copy);
+    return count;
+}
+
+static int selected(const char* name, char** names, int numNames) {
+    int i;
+    if(numNames == 0) {
+        return 1;
+    }
+    for(i = 0; i < numNames; i++) {
+        if(strcmp(names[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int threads[64];
+    int numThreads = 0;
+    const char* jsonFile = NULL;
+    char** names = malloc(sizeof(char*) * argc);
+    int numNames = 0;
+    int i, j, t;
+
+    for(i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            numThreads = parseThreads(argv[++i], threads, 64);
+        } else if(strcmp(argv[i], "--batches") == 0 && i + 1 < argc) {
+            numBatches = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--batch-size") == 0 && i + 1 < argc) {
+            //storeStrong works in pairs
+            batchSize = (atoll(argv[++i]) + 1) & ~1LL;
+        } else if(strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonFile = argv[++i];
+        } else if(argv[i][0] == '-') {
+            fprintf(stderr, "usage: micro [--threads 1,2,4] [--batches n] [--batch-size n] [--json file] "
+                    "[benchmark ...]\n");
+            return 2;
+        } else {
+            for(j = 0; j < NUM_BENCHMARKS && strcmp(benchmarks[j].name, argv[i]) != 0; j++) {}
+            if(j == NUM_BENCHMARKS) {
+                fprintf(stderr, "unknown benchmark: %s\n", argv[i]);
+                return 2;
+            }
+            names[numNames++] = argv[i];
+        }
+    }
+    if(numBatches < 1 || batchSize < 2) {
+        fprintf(stderr, "--batches and --batch-size must be positive\n");
+        return 2;
+    }
+
+    if(numThreads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        for(t = 1; t < cpus && numThreads < 63; t *= 2) {
+            threads[numThreads++] = t;
+        }
+        threads[numThreads++] = cpus > 0 ? (int)cpus : 1;
+    }
+
+    FILE* json = NULL;
+    if(jsonFile != NULL) {
+        json = fopen(jsonFile, "w");
+        if(json == NULL) {
+            perror(jsonFile);
+            return 1;
+        }
+        fprintf(json, "{\n  \"batches\": %d,\n  \"batch_size\": %lld,\n  \"results\": [", numBatches,
+                (long long)batchSize);
+    }
+
+    printf("%-12s %-8s %3s  %8s %8s %8s %8s %8s  %10s\n", "benchmark", "sharing", "thr", "mean", "p50", "p90", "p99",
+           "max", "Mops/s");
+    int first = 1;
+    for(i = 0; i < NUM_BENCHMARKS; i++) {
+        if(!selected(benchmarks[i].name, names, numNames)) {
+            continue;
+        }
+        for(t = 0; t < numThreads; t++) {
+            runBenchmark(&benchmarks[i], 0, threads[t], json, &first);
+        }
+        for(t = 0; benchmarks[i].shared && t < numThreads; t++) {
+            runBenchmark(&benchmarks[i], 1, threads[t], json, &first);
+        }
+    }
+
+    if(json != NULL) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+    free(names);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+struct point {
+    int refs;
+    int x;
+    int y;
+};
+
+int main(int argc, char** argv) {
+    int n = atoi(argv[1]);
+    int* out = malloc(sizeof(int) * n);
+    int i;
+    for(i = 0; i < n; i++) {
+        struct point* p = calloc(1, sizeof(struct point));
+        p->refs = 1;
+        p->x = i;
+        p->y = 2;
+        out[i] = p->x / p->y;
+        if(--p->refs == 0) {
+            free(p);
+        }
+    }
+    printf("%d", out[n - 1]);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+static int saxpy(int a, const int* x, int* y, int n) {
+    int i;
+    for(i = 0; i < n; i++) {
+        y[i] = a * x[i] + y[i];
+    }
+    return y[n - 1];
+}
+
+int main(int argc, char** argv) {
+    int r = atoi(argv[1]);
+    int n = 4096;
+    int* x = malloc(sizeof(int) * n);
+    int* y = malloc(sizeof(int) * n);
+    int i;
+    for(i = 0; i < n; i++) {
+        x[i] = i;
+        y[i] = 1;
+    }
+    int total = 0;
+    for(; r > 0; r--) {
+        total += saxpy(3, x, y, n);
+    }
+    printf("%d", total);
+    return 0;
+}
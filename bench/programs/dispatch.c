@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Staple binds method calls statically, so these are plain calls taking the object */
+struct square {
+    int refs;
+    int side;
+};
+
+struct rect {
+    int refs;
+    int width;
+    int height;
+};
+
+static int area(struct square* self, int scale) {
+    return self->side * self->side * scale;
+}
+
+static int perimeter(struct rect* self) {
+    return 2 * (self->width + self->height);
+}
+
+int main(int argc, char** argv) {
+    int n = atoi(argv[1]);
+    struct square* square = calloc(1, sizeof(struct square));
+    square->side = 3;
+    struct rect* rect = calloc(1, sizeof(struct rect));
+    rect->width = 3;
+    rect->height = 4;
+    int* out = malloc(sizeof(int) * n);
+    int i;
+    for(i = 0; i < n; i++) {
+        out[i] = area(square, i) + perimeter(rect);
+    }
+    printf("%d", out[n - 1]);
+    return 0;
+}
@@ -0,0 +1,15 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char** argv) {
+    int n = atoi(argv[1]);
+    char* buf = malloc(64);
+    int total = 0;
+    int i;
+    for(i = 0; i < n; i++) {
+        total += sprintf(buf, "item %d of %s", i, "format");
+    }
+    printf("%d", total);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/* reference counted like Staple objects, so teardown walks the list the same way */
+struct node {
+    int refs;
+    struct node* next;
+    int value;
+};
+
+static void release(struct node* node) {
+    while(node != NULL && --node->refs == 0) {
+        struct node* next = node->next;
+        free(node);
+        node = next;
+    }
+}
+
+static struct node* build(struct node* head, int count) {
+    while(count > 0) {
+        struct node* node = malloc(sizeof(struct node));
+        node->refs = 1;
+        node->value = count;
+        node->next = head;
+        head = node;
+        count--;
+    }
+    return head;
+}
+
+static int sum(struct node* node, int count) {
+    int retval = 0;
+    for(; count > 0; count--, node = node->next) {
+        retval += node->value;
+    }
+    return retval;
+}
+
+int main(int argc, char** argv) {
+    int r = atoi(argv[1]);
+    int total = 0;
+    for(; r > 0; r--) {
+        struct node* head = build(NULL, 10000);
+        total += sum(head, 10000);
+        release(head);
+    }
+    printf("%d", total);
+    return 0;
+}
@@ -0,0 +1,12 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+static int fib(int x) {
+    return x < 2 ? x : fib(x - 1) + fib(x - 2);
+}
+
+int main(int argc, char** argv) {
+    int n = atoi(argv[1]);
+    printf("%d", fib(n));
+    return 0;
+}
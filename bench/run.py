@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""
+Execution benchmarks: builds every Staple program in bench/programs and its C equivalent at each -O level, runs
+both and reports wall time, instructions, max RSS and the Staple/C ratios as JSON.
+
+    python3 bench/run.py [--stp ./stp] [--runtime build/stp_runtime/stp_runtime.a] [--levels 0,2] [--repeat 5]
+                         [--output results.json] [benchmark ...]
+
+Wall time is the median of --repeat runs, max RSS the largest. Instructions come from `perf stat` and are null when
+perf is not available. Both versions of a benchmark have to print the same result, a mismatch is reported as an error.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+PROGRAMS_DIR = os.path.join(BENCH_DIR, "programs")
+
+# argument of every benchmark, sized for about a second at -O2
+ARGUMENTS = {
+    "alloc": "20000000",
+    "arrays": "50000",
+    "dispatch": "50000000",
+    "format": "5000000",
+    "list": "1000",
+    "recursion": "35",
+}
+
+
+def run_checked(command):
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+    if result.returncode != 0:
+        raise RuntimeError("%s failed:\n%s" % (" ".join(command), result.stderr))
+
+
+def build_staple(args, name, level, build_dir):
+    source = os.path.join(PROGRAMS_DIR, name + ".stp")
+    base = os.path.join(build_dir, "%s.O%d" % (name, level))
+    run_checked([args.stp, "-O%d" % level, "-o", base + ".ll", source])
+    run_checked([args.llc, "-O=%d" % level, "-filetype=obj", "-o", base + ".o", base + ".ll"])
+    run_checked([args.cc, "-o", base + ".stp.exe", base + ".o", args.runtime, "-lm", "-lpthread"])
+    return base + ".stp.exe"
+
+
+def build_c(args, name, level, build_dir):
+    source = os.path.join(PROGRAMS_DIR, name + ".c")
+    exe = os.path.join(build_dir, "%s.O%d.c.exe" % (name, level))
+    run_checked([args.cc, "-O%d" % level, "-o", exe, source])
+    return exe
+
+
+def count_instructions(command):
+    if shutil.which("perf") is None:
+        return None
+    result = subprocess.run(["perf", "stat", "-x", ",", "-e", "instructions:u", "--"] + command,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True)
+    for line in result.stderr.splitlines():
+        fields = line.split(",")
+        if len(fields) > 2 and fields[2].startswith("instructions") and fields[0].isdigit():
+            return int(fields[0])
+    return None
+
+
+def build_measure(args):
+    exe = os.path.join(args.build_dir, "measure")
+    run_checked([args.cc, "-O2", "-o", exe, os.path.join(BENCH_DIR, "measure.c")])
+    return exe
+
+
+def measure(measure_exe, command, repeat, build_dir):
+    stats_file = os.path.join(build_dir, "stats")
+    walls = []
+    max_rss = 0
+    output = None
+    for _ in range(repeat):
+        result = subprocess.run([measure_exe, stats_file] + command, stdout=subprocess.PIPE, universal_newlines=True)
+        with open(stats_file) as stats:
+            wall, rss, status = stats.read().split()
+        if result.returncode != 0 or int(status) != 0:
+            raise RuntimeError("%s exited with status %s" % (" ".join(command), status))
+        walls.append(float(wall))
+        # kilobytes on Linux
+        max_rss = max(max_rss, int(rss))
+        output = result.stdout
+
+    return {
+        "wall_s": statistics.median(walls),
+        "instructions": count_instructions(command),
+        "max_rss_kb": max_rss,
+        "output": output,
+    }
+
+
+def ratio(staple, c):
+    if staple is None or not c:
+        return None
+    return staple / float(c)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Staple vs C execution benchmarks")
+    parser.add_argument("benchmarks", nargs="*", default=sorted(ARGUMENTS))
+    parser.add_argument("--stp", default="./stp")
+    parser.add_argument("--runtime", default="build/stp_runtime/stp_runtime.a")
+    parser.add_argument("--llc", default="llc")
+    parser.add_argument("--cc", default="cc")
+    parser.add_argument("--levels", default="0,1,2,3")
+    parser.add_argument("--repeat", type=int, default=5)
+    parser.add_argument("--build-dir", default="build/bench")
+    parser.add_argument("--output", help="write the JSON here instead of stdout")
+    args = parser.parse_args()
+
+    os.makedirs(args.build_dir, exist_ok=True)
+    levels = [int(level) for level in args.levels.split(",")]
+    measure_exe = build_measure(args)
+
+    results = []
+    failed = False
+    for name in args.benchmarks:
+        if name not in ARGUMENTS:
+            parser.error("unknown benchmark: " + name)
+        for level in levels:
+            entry = {"benchmark": name, "level": level, "argument": ARGUMENTS[name]}
+            try:
+                staple = measure(measure_exe, [build_staple(args, name, level, args.build_dir), ARGUMENTS[name]],
+                                 args.repeat, args.build_dir)
+                c = measure(measure_exe, [build_c(args, name, level, args.build_dir), ARGUMENTS[name]],
+                            args.repeat, args.build_dir)
+            except RuntimeError as error:
+                entry["error"] = str(error)
+                failed = True
+                results.append(entry)
+                continue
+
+            if staple["output"] != c["output"]:
+                entry["error"] = "outputs differ: staple %r, c %r" % (staple["output"], c["output"])
+                failed = True
+            entry["staple"] = staple
+            entry["c"] = c
+            entry["ratio"] = {
+                "wall": ratio(staple["wall_s"], c["wall_s"]),
+                "instructions": ratio(staple["instructions"], c["instructions"]),
+                "max_rss": ratio(staple["max_rss_kb"], c["max_rss_kb"]),
+            }
+            results.append(entry)
+
+            print("%-10s -O%d  staple %8.3fs  c %8.3fs  ratio %6.2f" % (name, level, staple["wall_s"], c["wall_s"],
+                                                                      entry["ratio"]["wall"]), file=sys.stderr)
+
+    report = json.dumps({"stp": os.path.abspath(args.stp), "results": results}, indent=2)
+    if args.output:
+        with open(args.output, "w") as output:
+            output.write(report + "\n")
+    else:
+        print(report)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
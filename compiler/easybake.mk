@@ -18,11 +18,19 @@ LOCAL_CXXFLAGS := -std=c++11 $(shell llvm-config --cxxflags)
 LOCAL_SRCS := \
 	src/tokens.cpp \
 	src/parser.cpp \
+	src/arena.cpp \
+	src/builtins.cpp \
 	src/sempass.cpp \
+	src/symbol.cpp \
 	src/compilercontext.cpp \
+	src/compilestats.cpp \
+	src/profiledata.cpp \
 	src/types/stapletype.cpp \
+	src/types/typecontext.cpp \
 	src/codegen/LLVMCodeGenerator.cpp \
 	src/codegen/LLVMStapleObject.cpp \
+	src/codegen/optremarks.cpp \
+	src/codegen/splitmodule.cpp \
 	src/main.cpp 
 
 LOCAL_CLEAN := \
@@ -30,7 +38,7 @@ LOCAL_CLEAN := \
 	src/parser.hpp \
 	src/tokens.cpp
 	
-LOCAL_LIBS := $(shell llvm-config --ldflags --libs) -ltinfo -ldl
+LOCAL_LIBS := $(shell llvm-config --ldflags --libs) -ltinfo -ldl -lpthread
 include $(BUILD_EXE)
 
 $(LOCAL_CPP_SOURCES): $(LOCAL_PATH)src/tokens.cpp $(LOCAL_PATH)src/parser.hpp $(LOCAL_PATH)src/parser.cpp
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include "arena.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace staple {
+
+    Arena::Arena(size_t chunkSize)
+    : mChunks(nullptr), mNext(nullptr), mEnd(nullptr), mChunkSize(chunkSize), mBytesAllocated(0),
+      mDestructors(nullptr) {}
+
+    void* Arena::allocateSlow(size_t size, size_t alignment) {
+        //objects larger than a chunk get a chunk of their own
+        size_t chunkSize = sizeof(Chunk) + alignment + size;
+        if(chunkSize < mChunkSize) {
+            chunkSize = mChunkSize;
+        }
+
+        Chunk* chunk = (Chunk*)malloc(chunkSize);
+        if(chunk == nullptr) {
+            fprintf(stderr, "out of memory\n");
+            abort();
+        }
+        chunk->next = mChunks;
+        chunk->size = chunkSize;
+        mChunks = chunk;
+
+        mNext = (char*)(chunk + 1);
+        mEnd = (char*)chunk + chunkSize;
+        return allocate(size, alignment);
+    }
+
+    void Arena::reset() {
+        //newest first, so objects go before anything they were built from
+        for(Destructor* destructor = mDestructors; destructor != nullptr; destructor = destructor->next) {
+            destructor->destroy(destructor->object);
+        }
+        mDestructors = nullptr;
+
+        Chunk* chunk = mChunks;
+        while(chunk != nullptr) {
+            Chunk* next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        mChunks = nullptr;
+        mNext = nullptr;
+        mEnd = nullptr;
+        mBytesAllocated = 0;
+    }
+
+}
@@ -0,0 +1,89 @@
+#ifndef STAPLE_ARENA_H
+#define STAPLE_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace staple {
+
+    using namespace std;
+
+    /**
+     * bump pointer allocator for everything that lives as long as a compile: AST nodes, token strings and semantic
+     * types. Objects are placed one after the other in large chunks, so tree walks touch few cache lines, and are all
+     * destroyed in one go when the arena is reset or destroyed. Objects with a destructor get it run, in reverse
+     * order of creation.
+     */
+    class Arena {
+    private:
+        struct Chunk {
+            Chunk* next;
+            size_t size;
+        };
+
+        struct Destructor {
+            void (*destroy)(void* object);
+            void* object;
+            Destructor* next;
+        };
+
+        Chunk* mChunks;
+        char* mNext;
+        char* mEnd;
+        size_t mChunkSize;
+        size_t mBytesAllocated;
+        Destructor* mDestructors;
+
+        void* allocateSlow(size_t size, size_t alignment);
+
+        template<typename T>
+        static void destroy(void* object) {
+            static_cast<T*>(object)->~T();
+        }
+
+    public:
+        Arena(size_t chunkSize = 64 * 1024);
+        ~Arena() { reset(); }
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* allocate(size_t size, size_t alignment) {
+            char* aligned = (char*)(((size_t)mNext + alignment - 1) & ~(alignment - 1));
+            if(mNext == nullptr || aligned + size > mEnd) {
+                return allocateSlow(size, alignment);
+            }
+            mNext = aligned + size;
+            mBytesAllocated += size;
+            return aligned;
+        }
+
+        /**
+         * constructs a T in the arena. It is destroyed with the arena, never delete it.
+         */
+        template<typename T, typename... Args>
+        T* make(Args&&... args) {
+            T* retval = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            if(!is_trivially_destructible<T>::value) {
+                Destructor* destructor = new(allocate(sizeof(Destructor), alignof(Destructor))) Destructor;
+                destructor->destroy = &destroy<T>;
+                destructor->object = retval;
+                destructor->next = mDestructors;
+                mDestructors = destructor;
+            }
+            return retval;
+        }
+
+        /**
+         * destroys every object and frees all chunks
+         */
+        void reset();
+
+        size_t getBytesAllocated() const { return mBytesAllocated; }
+    };
+
+}
+
+#endif //STAPLE_ARENA_H
@@ -0,0 +1,42 @@
+#include "builtins.h"
+
+#include <llvm/ADT/DenseMap.h>
+
+namespace staple {
+
+    namespace {
+
+        llvm::DenseMap<unsigned, Builtin> createBuiltins() {
+            const std::pair<Symbol, Builtin> names[] {
+                    {Symbol("len"), BI_Len},
+                    {Symbol("splat"), BI_Splat},
+                    {Symbol("extract"), BI_Extract},
+                    {Symbol("insert"), BI_Insert},
+                    {Symbol("shuffle"), BI_Shuffle},
+                    {Symbol("select"), BI_Select},
+                    {Symbol("reduce_add"), BI_ReduceAdd},
+                    {Symbol("reduce_mul"), BI_ReduceMul},
+                    {Symbol("reduce_min"), BI_ReduceMin},
+                    {Symbol("reduce_max"), BI_ReduceMax},
+                    {Symbol("vload"), BI_VLoad},
+                    {Symbol("vstore"), BI_VStore}
+            };
+
+            llvm::DenseMap<unsigned, Builtin> retval;
+            for(const std::pair<Symbol, Builtin>& name : names) {
+                retval[name.first.getId()] = name.second;
+            }
+            return retval;
+        }
+
+        //read only once made, sema looks calls up from several threads
+        const llvm::DenseMap<unsigned, Builtin> BUILTINS = createBuiltins();
+
+    }
+
+    Builtin lookupBuiltin(Symbol name) {
+        auto it = BUILTINS.find(name.getId());
+        return it != BUILTINS.end() ? it->second : BI_None;
+    }
+
+}
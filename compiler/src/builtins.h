@@ -0,0 +1,37 @@
+#ifndef _STAPLE_BUILTINS_H_
+#define _STAPLE_BUILTINS_H_
+
+#include "symbol.h"
+
+namespace staple {
+
+    /**
+     * Functions the compiler lowers inline instead of calling.
+     */
+    enum Builtin {
+        BI_None = 0,
+        BI_Len,
+
+        //SIMD vectors
+        BI_Splat,
+        BI_Extract,
+        BI_Insert,
+        BI_Shuffle,
+        BI_Select,
+        BI_ReduceAdd,
+        BI_ReduceMul,
+        BI_ReduceMin,
+        BI_ReduceMax,
+        BI_VLoad,
+        BI_VStore
+    };
+
+    /**
+     * the builtin called name, BI_None for any other function. The names are interned at startup, like the SYM_
+     * names, so this is a lookup by symbol id
+     */
+    Builtin lookupBuiltin(Symbol name);
+
+}
+
+#endif //_STAPLE_BUILTINS_H_
@@ -4,8 +4,30 @@
 #include "../compilercontext.h"
 #include "../types/stapletype.h"
 #include "LLVMStapleObject.h"
+#include "optremarks.h"
 
+#include <llvm/Bitcode/ReaderWriter.h>
 #include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FormattedStream.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+
+#include <memory>
+#include <sstream>
+#include <thread>
 
 
 namespace staple {
@@ -77,6 +99,8 @@ namespace staple {
 
         Value* mPtrValue;
         LLVMCodeGenerator* mCodeGen;
+        string mFunctionName;
+        YYLTYPE mLocation;
 
         User* getLastUsage(Value* value) {
             User* lastUser = value->user_back();
@@ -87,20 +111,22 @@ namespace staple {
         }
 
     public:
-        ReleaseObj(Value* ptrValue, LLVMCodeGenerator* codeGen) : mPtrValue(ptrValue), mCodeGen(codeGen) {
+        ReleaseObj(Value* ptrValue, LLVMCodeGenerator* codeGen, const string& functionName, const YYLTYPE& location)
+        : mPtrValue(ptrValue), mCodeGen(codeGen), mFunctionName(functionName), mLocation(location) {
 
         }
 
         void scopeOut() {
 
-            Function* releaseFunction = LLVMStapleObject::getReleaseFunction(mCodeGen->getModule());
+            Function* releaseFunction = LLVMStapleObject::getReleaseFunction(mCodeGen);
 
             Value* ptr = mPtrValue;
             User* lastUser = getLastUsage(mPtrValue);
             if(Instruction* inst = dyn_cast<Instruction>(lastUser)){
                 IRBuilder<> Builder(inst->getNextNode());
 
-                ptr = Builder.CreatePointerCast(ptr, PointerType::getUnqual(LLVMStapleObject::getStpObjInstanceType()));
+                ptr = Builder.CreatePointerCast(ptr, PointerType::getUnqual(LLVMStapleObject::getStpObjInstanceType(mCodeGen)));
+                mCodeGen->emitRefcountCounter(Builder, LLVMCodeGenerator::RC_TempRelease, mFunctionName, mLocation);
                 Builder.CreateCall(releaseFunction,
                                    std::vector<Value *>{ptr}
                 );
@@ -114,21 +140,25 @@ namespace staple {
         Value* mPtrValue;
         LLVMCodeGenerator* mCodeGen;
         BasicBlock* mBasicBlock;
+        string mFunctionName;
+        YYLTYPE mLocation;
 
     public:
-        ScopeVarRelease(Value* ptrValue, LLVMCodeGenerator* codeGen, BasicBlock* bb) : mPtrValue(ptrValue), mCodeGen(codeGen), mBasicBlock(bb) {
+        ScopeVarRelease(Value* ptrValue, LLVMCodeGenerator* codeGen, BasicBlock* bb, const string& functionName, const YYLTYPE& location)
+        : mPtrValue(ptrValue), mCodeGen(codeGen), mBasicBlock(bb), mFunctionName(functionName), mLocation(location) {
 
         }
 
         void scopeOut() {
-            Function* releaseFunction = LLVMStapleObject::getReleaseFunction(mCodeGen->getModule());
+            Function* releaseFunction = LLVMStapleObject::getReleaseFunction(mCodeGen);
 
             IRBuilder<> builder(--mBasicBlock->end());
 
             Value* ptr = mPtrValue;
             ptr = builder.CreateLoad(ptr);
 
-            ptr = builder.CreatePointerCast(ptr, PointerType::getUnqual(LLVMStapleObject::getStpObjInstanceType()));
+            ptr = builder.CreatePointerCast(ptr, PointerType::getUnqual(LLVMStapleObject::getStpObjInstanceType(mCodeGen)));
+            mCodeGen->emitRefcountCounter(builder, LLVMCodeGenerator::RC_ScopeRelease, mFunctionName, mLocation);
             builder.CreateCall(releaseFunction, std::vector<Value *>{ptr});
         }
     };
@@ -136,7 +166,6 @@ namespace staple {
     class CodeGenBlock {
     private:
         CodeGenBlock* mParent;
-        map<const string, Value*> mSymbolTable;
         vector<unique_ptr<ScopeCleanup>> mScopeCleanup;
 
     public:
@@ -145,21 +174,6 @@ namespace staple {
 
         CodeGenBlock* getParent() const { return mParent; }
 
-        void defineSymbol(const string& name, Value* llvmValue) {
-            mSymbolTable[name] = llvmValue;
-        }
-
-        Value* lookupSymbol(const string& name) {
-            auto it = mSymbolTable.find(name);
-            if(it != mSymbolTable.end()) {
-                return it->second;
-            } else if(mParent != nullptr){
-                return mParent->lookupSymbol(name);
-            } else {
-                return nullptr;
-            }
-        }
-
         void addCleanup(ScopeCleanup* cleanup) {
             mScopeCleanup.push_back(unique_ptr<ScopeCleanup>( cleanup ));
         }
@@ -176,16 +190,38 @@ namespace staple {
 
     };
 
+    class FreeArray : public ScopeCleanup {
+    private:
+        Value* mPtrValue;
+        LLVMCodeGenerator* mCodeGen;
+        CodeGenBlock* mScope;
+
+    public:
+        FreeArray(Value* ptrValue, LLVMCodeGenerator* codeGen, CodeGenBlock* scope) : mPtrValue(ptrValue), mCodeGen(codeGen), mScope(scope) {
+
+        }
+
+        void scopeOut() {
+            BasicBlock* bb = mScope->mBasicBlock;
+            IRBuilder<> builder(bb);
+            if(TerminatorInst* terminator = bb->getTerminator()) {
+                builder.SetInsertPoint(terminator);
+            }
+
+            Function* freeFunction = mCodeGen->getFreeFunction();
+            builder.CreateCall(freeFunction, builder.CreatePointerCast(mPtrValue, Type::getInt8PtrTy(mCodeGen->getContext())));
+        }
+    };
+
     class LLVMFunctionForwardDeclVisitor : public ASTVisitor {
     using ASTVisitor::visit;
     private:
         LLVMCodeGenerator* mCodeGen;
-        CodeGenBlock* mScope;
-        map<ASTNode*, Value*>& mValues;
+        NodeMap<Value*>& mValues;
 
     public:
-        LLVMFunctionForwardDeclVisitor(LLVMCodeGenerator* codeGen, CodeGenBlock* scope, map<ASTNode*, Value*>& values)
-        : mCodeGen(codeGen), mScope(scope), mValues(values) {}
+        LLVMFunctionForwardDeclVisitor(LLVMCodeGenerator* codeGen, NodeMap<Value*>& values)
+        : mCodeGen(codeGen), mValues(values) {}
 
         void visit(NFunctionPrototype* functionPrototype) {
 
@@ -199,13 +235,20 @@ namespace staple {
             }
 
             FunctionType* functionType = FunctionType::get(returnType, argTypes, stapleFunction->getIsVarg());
-            Function* function = Function::Create(
-                    functionType,
-                    GlobalValue::LinkageTypes::ExternalLinkage,
-                    functionPrototype->name.c_str(),
-                    &mCodeGen->mModule);
 
-            mScope->defineSymbol(functionPrototype->name, function);
+            //a Staple function, possibly defined in this file too, is linked by its package symbol
+            string name = functionPrototype->definition != nullptr
+                          ? mCodeGen->createFunctionSymbolName(functionPrototype->name)
+                          : functionPrototype->name.str();
+            Function* function = mCodeGen->mModule.getFunction(name);
+            if(function == nullptr) {
+                function = Function::Create(
+                        functionType,
+                        GlobalValue::LinkageTypes::ExternalLinkage,
+                        name,
+                        &mCodeGen->mModule);
+            }
+
             mValues[functionPrototype] = function;
 
         }
@@ -223,16 +266,17 @@ namespace staple {
 
             FunctionType* functionType = FunctionType::get(returnType, argTypes, stpFunctionType->getIsVarg());
 
-            string functionName = mCodeGen->createNamespaceSymbolName(function->name);
-
-            Function* llvmFunction = Function::Create(
-                    functionType,
-                    GlobalValue::LinkageTypes::ExternalLinkage,
-                    function->name.compare("main") == 0 ? function->name.c_str() : functionName.c_str(),
-                    &mCodeGen->mModule);
+            //an extern prototype earlier in the file already declared it
+            string functionName = mCodeGen->createFunctionSymbolName(function->name);
+            Function* llvmFunction = mCodeGen->mModule.getFunction(functionName);
+            if(llvmFunction == nullptr) {
+                llvmFunction = Function::Create(
+                        functionType,
+                        GlobalValue::LinkageTypes::ExternalLinkage,
+                        functionName,
+                        &mCodeGen->mModule);
+            }
 
-            mScope->defineSymbol(function->name, llvmFunction);
-            mScope->defineSymbol(functionName, llvmFunction);
             mValues[function] = llvmFunction;
         }
     };
@@ -241,9 +285,18 @@ namespace staple {
     using ASTVisitor::visit;
     private:
         LLVMCodeGenerator* mCodeGen;
-        map<ASTNode*, Value*> mValues;
+        NodeMap<Value*> mValues;
         CodeGenBlock* mScope;
         StapleClass* mCurrentClass;
+        //first argument of the method being emitted
+        Value* mThisPtr;
+
+        //symbol of the function being emitted, profile and allocation sites are keyed by it
+        string mFunctionName;
+        //functions and methods in source order, the generator's partition decides which of them are defined
+        unsigned mFunctionIndex;
+        //foreach loops are vectorized at this width, target_clones versions use their own features' width
+        unsigned mSimdWidth;
 
         void push() {
             mScope = new CodeGenBlock(mScope);
@@ -265,10 +318,312 @@ namespace staple {
             return mCodeGen->getLLVMType(mCodeGen->mCompilerContext->typeTable[node]);
         }
 
+        /**
+         * semantic type of node, fields are unwrapped to their declared type
+         */
+        inline StapleType* getStapleType(ASTNode* node) {
+            StapleType* retval = mCodeGen->mCompilerContext->typeTable[node];
+            if(StapleField* field = dyn_cast_or_null<StapleField>(retval)) {
+                retval = field->getElementType();
+            }
+            return retval;
+        }
+
+        /**
+         * traps unless 0 <= index < length. Code following the check is emitted in the in bounds block.
+         */
+        void emitBoundsCheck(Value* index, Value* length) {
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+
+            //unsigned compare also catches negative indexes
+            index = irBuilder.CreateIntCast(index, length->getType(), true);
+            emitTrapUnless(irBuilder.CreateICmpULT(index, length), "inbounds", "outofbounds");
+        }
+
+        /**
+         * traps unless condition holds, which is assumed to be the likely case. Code following the check is emitted
+         * in the pass block.
+         */
+        void emitTrapUnless(Value* condition, const char* passName, const char* failName) {
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+            Function* parent = irBuilder.GetInsertBlock()->getParent();
+
+            BasicBlock* failBB = BasicBlock::Create(mCodeGen->mContext, failName, parent);
+            BasicBlock* passBB = BasicBlock::Create(mCodeGen->mContext, passName, parent);
+
+            irBuilder.CreateCondBr(condition, passBB, failBB, MDBuilder(mCodeGen->mContext).createBranchWeights(1 << 20, 1));
+
+            irBuilder.SetInsertPoint(failBB);
+            irBuilder.CreateCall(Intrinsic::getDeclaration(&mCodeGen->mModule, Intrinsic::trap));
+            irBuilder.CreateUnreachable();
+
+            mScope->mBasicBlock = passBB;
+            irBuilder.SetInsertPoint(passBB);
+        }
+
+        /**
+         * implicit conversion between int and float scalars of any width. Other values are returned unchanged.
+         */
+        Value* convertScalar(Value* value, Type* destType) {
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+            Type* srcType = value->getType();
+            if(srcType == destType) {
+                return value;
+            } else if(srcType->isIntegerTy() && destType->isIntegerTy() && !srcType->isIntegerTy(1)) {
+                return irBuilder.CreateIntCast(value, destType, true);
+            } else if(srcType->isFloatingPointTy() && destType->isFloatingPointTy()) {
+                return irBuilder.CreateFPCast(value, destType);
+            } else if(srcType->isIntegerTy() && destType->isFloatingPointTy()) {
+                return irBuilder.CreateSIToFP(value, destType);
+            } else if(srcType->isFloatingPointTy() && destType->isIntegerTy()) {
+                return irBuilder.CreateFPToSI(value, destType);
+            }
+            return value;
+        }
+
+        /**
+         * name heap profiles report allocations of type under
+         */
+        string getHeapTypeName(StapleType* type) {
+            if(StapleClass* classType = dyn_cast<StapleClass>(type)) {
+                return classType->getClassName();
+            } else if(StaplePointer* ptrType = dyn_cast<StaplePointer>(type)) {
+                return getHeapTypeName(ptrType->getElementType()) + "*";
+            } else if(type == StapleType::getBoolType()) {
+                return "bool";
+            } else if(StapleInt* intType = dyn_cast<StapleInt>(type)) {
+                return "int" + to_string(intType->getWidth());
+            } else if(StapleFloat* floatType = dyn_cast<StapleFloat>(type)) {
+                return "float" + to_string(floatType->getWidth());
+            }
+            return "value";
+        }
+
+        /**
+         * --profile-generate: counts executions of node at the insert point. The increment is not atomic, threads
+         * running the same code at once may lose counts. That only skews the weights, and keeps instrumented loops
+         * vectorizable.
+         */
+        void emitProfileCounter(ASTNode* node, ProfileSiteKind kind) {
+            if(mCodeGen->mCompilerContext->profileGenerate.empty()) {
+                return;
+            }
+
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+            GlobalVariable* counter = new GlobalVariable(mCodeGen->mModule, irBuilder.getInt64Ty(), false,
+                                                         GlobalValue::LinkageTypes::InternalLinkage, irBuilder.getInt64(0),
+                                                         "__stp_prof_counter");
+            mCodeGen->mProfileCounters.push_back(LLVMCodeGenerator::ProfileCounter{getProfileSite(node), kind, counter});
+            irBuilder.CreateStore(irBuilder.CreateAdd(irBuilder.CreateLoad(counter), irBuilder.getInt64(1)), counter);
+        }
+
+        ProfileSite getProfileSite(ASTNode* node) {
+            return ProfileSite{mFunctionName, node->location.first_line, node->location.first_column};
+        }
+
+        /**
+         * --profile-use: executions of node in the training runs, false if the profile does not cover it
+         */
+        bool getProfileCount(ASTNode* node, uint64_t& count) {
+            return mCodeGen->mCompilerContext->profile.getCount(getProfileSite(node), count);
+        }
+
+        void setBranchWeights(BranchInst* branch, uint64_t taken, uint64_t notTaken) {
+            //weights are 32 bit, scale both down to keep the ratio
+            while(taken >= UINT32_MAX || notTaken >= UINT32_MAX) {
+                taken >>= 1;
+                notTaken >>= 1;
+            }
+            branch->setMetadata(LLVMContext::MD_prof, MDBuilder(mCodeGen->mContext).createBranchWeights(taken + 1, notTaken + 1));
+        }
+
+        /**
+         * functions that never ran in training are cold, ones within 10x of the hottest are inlined eagerly.
+         * On ELF both are grouped into their own sections to keep hot code dense.
+         */
+        void applyFunctionProfile(ASTNode* node, Function* llvmFunction) {
+            uint64_t count;
+            if(!getProfileCount(node, count)) {
+                return;
+            }
+
+            bool isELF = Triple(mCodeGen->mModule.getTargetTriple()).isOSBinFormatELF();
+            if(count == 0) {
+                llvmFunction->addFnAttr(Attribute::Cold);
+                if(isELF) {
+                    llvmFunction->setSection(".text.unlikely");
+                }
+            } else if(count >= mCodeGen->mCompilerContext->profile.getMaxFunctionCount() / 10) {
+                llvmFunction->addFnAttr(Attribute::InlineHint);
+                if(isELF) {
+                    llvmFunction->setSection(".text.hot");
+                }
+            }
+        }
+
+        /**
+         * stack slot in the function's entry block, so declarations inside loops do not grow the stack
+         */
+        AllocaInst* createEntryAlloca(Type* type, const string& name) {
+            BasicBlock& entry = mCodeGen->mIRBuilder.GetInsertBlock()->getParent()->getEntryBlock();
+            IRBuilder<> builder(&entry, entry.begin());
+            return builder.CreateAlloca(type, 0, name.c_str());
+        }
+
+        /**
+         * loop metadata for the latch branch of a loop to vectorize at width. The first operand is the node itself so
+         * each loop is unique.
+         */
+        MDNode* createLoopID(unsigned width) {
+            LLVMContext& context = mCodeGen->mContext;
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+
+            MDNode* temp = MDNode::getTemporary(context, None);
+            vector<Value*> operands{temp};
+            operands.push_back(MDNode::get(context, vector<Value*>{
+                    MDString::get(context, "llvm.loop.vectorize.enable"), irBuilder.getInt1(true)
+            }));
+            operands.push_back(MDNode::get(context, vector<Value*>{
+                    MDString::get(context, "llvm.loop.vectorize.width"), irBuilder.getInt32(width)
+            }));
+
+            MDNode* loopID = MDNode::get(context, operands);
+            loopID->replaceOperandWith(0, loopID);
+            MDNode::deleteTemporary(temp);
+            return loopID;
+        }
+
+        /**
+         * true if value is the foreach index loaded from counter, looking through integer casts
+         */
+        static bool isCounterValue(Value* value, Value* counter) {
+            while(CastInst* cast = dyn_cast<CastInst>(value)) {
+                value = cast->getOperand(0);
+            }
+            LoadInst* load = dyn_cast<LoadInst>(value);
+            return load != nullptr && load->getPointerOperand() == counter;
+        }
+
+        /**
+         * true if ptr addresses an element, or a field of an in place element, selected by the foreach index. Each
+         * iteration has its own such elements. Vector lanes are reached through a cast and overlap the next
+         * iteration's, so they do not count.
+         */
+        static bool isIndexedByCounter(Value* ptr, Value* counter) {
+            for(GetElementPtrInst* gep = dyn_cast<GetElementPtrInst>(ptr); gep != nullptr;
+                gep = dyn_cast<GetElementPtrInst>(gep->getPointerOperand())) {
+                for(auto index = gep->idx_begin(); index != gep->idx_end(); ++index) {
+                    if(isCounterValue(*index, counter)) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        /**
+         * emits while(*counter < end) { body; (*counter)++ } and continues after the loop.
+         * Loads and stores of elements indexed by the foreach index are marked as independent between iterations.
+         * Everything else, such as globals, fields and profile counters, is left to the vectorizer's own dependence
+         * checks, so a loop touching them is only vectorized if those succeed.
+         */
+        void emitForeachLoop(NForeach* foreach, Value* counter, Value* end, MDNode* loopID) {
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+            Function* parent = irBuilder.GetInsertBlock()->getParent();
+
+            BasicBlock* condBB = BasicBlock::Create(mCodeGen->mContext, "foreach.cond", parent);
+            BasicBlock* bodyBB = BasicBlock::Create(mCodeGen->mContext, "foreach.body", parent);
+            BasicBlock* latchBB = BasicBlock::Create(mCodeGen->mContext, "foreach.inc");
+            BasicBlock* exitBB = BasicBlock::Create(mCodeGen->mContext, "foreach.end");
+
+            irBuilder.CreateBr(condBB);
+            irBuilder.SetInsertPoint(condBB);
+            BranchInst* branch = irBuilder.CreateCondBr(irBuilder.CreateICmpSLT(irBuilder.CreateLoad(counter), end), bodyBB, exitBB);
+
+            uint64_t count, iterations;
+            if(getProfileCount(foreach, count) && getProfileCount(foreach->body, iterations)) {
+                setBranchWeights(branch, iterations, count);
+            }
+
+            irBuilder.SetInsertPoint(bodyBB);
+            emitProfileCounter(foreach->body, PS_Block);
+            emitBranch(foreach->body, bodyBB, latchBB);
+
+            parent->getBasicBlockList().push_back(latchBB);
+            irBuilder.SetInsertPoint(latchBB);
+            irBuilder.CreateStore(irBuilder.CreateAdd(irBuilder.CreateLoad(counter), irBuilder.getInt32(1)), counter);
+            irBuilder.CreateBr(condBB)->setMetadata("llvm.loop", loopID);
+
+            for(Function::iterator bb = bodyBB; bb != parent->end(); ++bb) {
+                for(Instruction& inst : *bb) {
+                    Value* ptr = nullptr;
+                    if(LoadInst* load = dyn_cast<LoadInst>(&inst)) {
+                        ptr = load->getPointerOperand();
+                    } else if(StoreInst* store = dyn_cast<StoreInst>(&inst)) {
+                        ptr = store->getPointerOperand();
+                    }
+                    //keep the innermost loop's annotation, an access can only name one loop
+                    if(ptr != nullptr && isIndexedByCounter(ptr, counter)
+                       && inst.getMetadata("llvm.mem.parallel_loop_access") == nullptr) {
+                        inst.setMetadata("llvm.mem.parallel_loop_access", loopID);
+                    }
+                }
+            }
+
+            parent->getBasicBlockList().push_back(exitBB);
+            mScope->mBasicBlock = exitBB;
+            irBuilder.SetInsertPoint(exitBB);
+        }
+
+        /**
+         * runs the class's init function on every element of an array storing its objects in place, so each has
+         * its class def and a ref count of 0 like one made with new
+         */
+        void emitArrayElementInit(Value* arrayPtr, StapleArray* arrayType) {
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+            Function* parent = irBuilder.GetInsertBlock()->getParent();
+
+            Function* initFunction = LLVMStapleObject::get(mCodeGen, cast<StapleClass>(arrayType->getElementType()))
+                    ->getInitFunction(mCodeGen);
+
+            BasicBlock* entryBB = irBuilder.GetInsertBlock();
+            BasicBlock* bodyBB = BasicBlock::Create(mCodeGen->mContext, "arrayinit.body", parent);
+            BasicBlock* exitBB = BasicBlock::Create(mCodeGen->mContext, "arrayinit.end", parent);
+
+            irBuilder.CreateBr(bodyBB);
+            irBuilder.SetInsertPoint(bodyBB);
+            PHINode* index = irBuilder.CreatePHI(irBuilder.getInt32Ty(), 2);
+            index->addIncoming(irBuilder.getInt32(0), entryBB);
+
+            irBuilder.CreateCall(initFunction, irBuilder.CreateInBoundsGEP(arrayPtr, vector<Value*>{irBuilder.getInt32(0), index}));
+
+            Value* next = irBuilder.CreateAdd(index, irBuilder.getInt32(1));
+            index->addIncoming(next, bodyBB);
+            irBuilder.CreateCondBr(irBuilder.CreateICmpULT(next, irBuilder.getInt32(arrayType->getSize())), bodyBB, exitBB);
+
+            mScope->mBasicBlock = exitBB;
+            irBuilder.SetInsertPoint(exitBB);
+        }
+
+        /**
+         * emits stmt starting in entry, then falls through to exit unless stmt already left the block
+         */
+        void emitBranch(NStatement* stmt, BasicBlock* entry, BasicBlock* exit) {
+            mScope->mBasicBlock = entry;
+            mCodeGen->mIRBuilder.SetInsertPoint(entry);
+
+            stmt->accept(this);
+
+            if(mCodeGen->mIRBuilder.GetInsertBlock()->getTerminator() == nullptr) {
+                mCodeGen->mIRBuilder.CreateBr(exit);
+            }
+        }
+
 
     public:
         LLVMCodeGenVisitor(LLVMCodeGenerator*codeGen)
-        : mCodeGen(codeGen), mScope(new CodeGenBlock(nullptr)) {}
+        : mCodeGen(codeGen), mScope(new CodeGenBlock(nullptr)), mThisPtr(nullptr), mFunctionIndex(0),
+          mSimdWidth(codeGen->mCompilerContext->simdWidth) {}
 
         Value* getValue(ASTNode* node) {
             node->accept(this);
@@ -280,16 +635,18 @@ namespace staple {
             if(mCodeGen->mCompilerContext->debugSymobols) {
                 mScope->mDebugInfo = new LLVMDebugInfo(mCodeGen);
                 mScope->mDebugInfo->mCompileUnit = mCodeGen->mDIBuider->createCompileUnit(
-                        dwarf::DW_LANG_C, mCodeGen->mCompilerContext->inputFilename.c_str(), ".",
-                        "Staple Compiler", false, "", 0);
+                        dwarf::DW_LANG_C, mCodeGen->mInputFilename.c_str(), ".",
+                        "Staple Compiler", mCodeGen->mCompilerContext->optLevel > 0, "", 0, StringRef(),
+                        mCodeGen->mCompilerContext->lineTablesOnly ? DIBuilder::LineTablesOnly : DIBuilder::FullDebug,
+                        mCodeGen->mCompilerContext->emitDebugInfo);
                 mScope->mDebugInfo->mFile = mCodeGen->mDIBuider->createFile(
-                        mCodeGen->mCompilerContext->inputFilename.c_str(), ".");
+                        mCodeGen->mInputFilename.c_str(), ".");
 
                 mScope->mDIScope = mScope->mDebugInfo->mFile;
             }
 
             {
-                LLVMFunctionForwardDeclVisitor visitor(mCodeGen, mScope, mValues);
+                LLVMFunctionForwardDeclVisitor visitor(mCodeGen, mValues);
 
                 for (NFunctionPrototype *functionPrototype : compileUnit->externFunctions) {
                     functionPrototype->accept(&visitor);
@@ -301,7 +658,9 @@ namespace staple {
             }
 
             for(NFunction* function : compileUnit->functions) {
-                function->accept(this);
+                if(mCodeGen->definesFunction(mFunctionIndex++)) {
+                    function->accept(this);
+                }
             }
 
             for(NClassDeclaration* classDeclaration : compileUnit->classes) {
@@ -317,6 +676,11 @@ namespace staple {
         DICompositeType createDebugFunctionType(StapleFunction* stpFunctionType) {
             vector<Value*> elements;
 
+            //line tables only describe where code is, not its types
+            if(mCodeGen->mCompilerContext->lineTablesOnly) {
+                return mCodeGen->mDIBuider->createSubroutineType(mScope->mDebugInfo->mFile, mCodeGen->mDIBuider->getOrCreateArray(elements));
+            }
+
             elements.push_back(mScope->mDebugInfo->getLLVMDebugType(stpFunctionType->getReturnType()));
             for(StapleType* arg : stpFunctionType->getArguments()) {
                 elements.push_back(mScope->mDebugInfo->getLLVMDebugType(arg));
@@ -329,17 +693,92 @@ namespace staple {
 
             Function* llvmFunction = cast<Function>(mValues[function]);
 
+            //target_clones versions count under the public symbol
+            mFunctionName = llvmFunction->getName();
+
+            if(function->targetClones.empty()) {
+                emitFunctionBody(function, llvmFunction);
+            } else {
+                emitTargetClones(function, llvmFunction);
+            }
+        }
+
+        /**
+         * every target_clones version is an internal copy of the function with its own target-features. The public
+         * symbol calls through a pointer that a global constructor sets to the first version the cpu supports,
+         * LLVM 3.5 has no ifunc to resolve it at load time.
+         */
+        void emitTargetClones(NFunction* function, Function* dispatcher) {
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+            Module& module = mCodeGen->mModule;
+            const string name = dispatcher->getName();
+
+            Function* defaultVersion = nullptr;
+            vector<pair<string, Function*>> versions;
+            for(const string& target : function->targetClones) {
+                string suffix = target;
+                replace(suffix.begin(), suffix.end(), ',', '_');
+
+                Function* version = Function::Create(dispatcher->getFunctionType(), GlobalValue::LinkageTypes::InternalLinkage,
+                                                     name + "." + suffix, &module);
+                if(target == "default") {
+                    defaultVersion = version;
+                    mSimdWidth = mCodeGen->mCompilerContext->simdWidth;
+                } else {
+                    version->addFnAttr("target-features", mCodeGen->getTargetFeatures(target));
+                    versions.push_back(make_pair(target, version));
+                    mSimdWidth = mCodeGen->getCloneSimdWidth(target);
+                }
+                emitFunctionBody(function, version);
+            }
+            mSimdWidth = mCodeGen->mCompilerContext->simdWidth;
+
+            irBuilder.SetCurrentDebugLocation(DebugLoc());
+
+            GlobalVariable* selected = new GlobalVariable(module, PointerType::getUnqual(dispatcher->getFunctionType()), false,
+                                                          GlobalValue::LinkageTypes::InternalLinkage, defaultVersion,
+                                                          name + ".version");
+
+            //the first version listed that the cpu supports wins
+            Function* resolver = Function::Create(FunctionType::get(irBuilder.getVoidTy(), false),
+                                                  GlobalValue::LinkageTypes::InternalLinkage, name + ".resolver", &module);
+            irBuilder.SetInsertPoint(BasicBlock::Create(mCodeGen->mContext, "entry", resolver));
+            Value* choice = defaultVersion;
+            for(auto it = versions.rbegin(); it != versions.rend(); ++it) {
+                Value* supported = irBuilder.CreateCall(mCodeGen->getCpuSupportsFunction(), irBuilder.CreateGlobalStringPtr(it->first));
+                choice = irBuilder.CreateSelect(irBuilder.CreateICmpNE(supported, irBuilder.getInt32(0)), it->second, choice);
+            }
+            irBuilder.CreateStore(choice, selected);
+            irBuilder.CreateRetVoid();
+            appendToGlobalCtors(module, resolver, 0);
+
+            irBuilder.SetInsertPoint(BasicBlock::Create(mCodeGen->mContext, "entry", dispatcher));
+            vector<Value*> args;
+            for(Function::arg_iterator AI = dispatcher->arg_begin(); AI != dispatcher->arg_end(); ++AI) {
+                args.push_back(AI);
+            }
+            CallInst* call = irBuilder.CreateCall(irBuilder.CreateLoad(selected), args);
+            call->setTailCall();
+            if(dispatcher->getReturnType()->isVoidTy()) {
+                irBuilder.CreateRetVoid();
+            } else {
+                irBuilder.CreateRet(call);
+            }
+        }
+
+        void emitFunctionBody(NFunction* function, Function* llvmFunction) {
+
             push();
-            mScope->mBasicBlock = BasicBlock::Create(getGlobalContext(), "entry", llvmFunction);
+            mScope->mBasicBlock = BasicBlock::Create(mCodeGen->mContext, "entry", llvmFunction);
             mCodeGen->mIRBuilder.SetInsertPoint(mScope->mBasicBlock);
 
             StapleFunction* stpFunctionType = cast<StapleFunction>(mCodeGen->mCompilerContext->typeTable[function]);
 
-            string functionName = mCodeGen->createNamespaceSymbolName(function->name);
+            string functionName = mCodeGen->createFunctionSymbolName(function->name);
 
             if(mCodeGen->mCompilerContext->debugSymobols) {
                 mScope->mDIScope = mCodeGen->mDIBuider->createFunction(mScope->getParent()->mDIScope,
-                                                                       function->name.compare("main") == 0 ? function->name.c_str() : functionName.c_str(), StringRef(),
+                                                                       functionName, StringRef(),
                                                                        mScope->mDebugInfo->mFile,
                                                                        function->location.first_line,
                                                                        createDebugFunctionType(stpFunctionType), false,
@@ -349,6 +788,9 @@ namespace staple {
 
             }
 
+            emitProfileCounter(function, PS_FunctionEntry);
+            applyFunctionProfile(function, llvmFunction);
+
             const size_t numArgs = function->arguments.size();
             Function::arg_iterator AI = llvmFunction->arg_begin();
             for(int i=0;i<numArgs;i++,++AI) {
@@ -356,7 +798,7 @@ namespace staple {
                 NArgument* nodeArg = function->arguments[i];
 
                 AllocaInst* alloc = mCodeGen->mIRBuilder.CreateAlloca(llvmArg, 0, nodeArg->name.c_str());
-                mScope->defineSymbol(nodeArg->name, alloc);
+                mValues[nodeArg] = alloc;
                 mCodeGen->mIRBuilder.CreateStore(AI, alloc);
             }
 
@@ -365,27 +807,44 @@ namespace staple {
             }
 
             pop();
-        }
 
-        void visit(NMethodFunction* methodFunction) {
+            emitTraceHooks(llvmFunction);
+        }
 
-            LLVMStapleObject* stapleObject = LLVMStapleObject::get(mCurrentClass);
+        /**
+         * --instrument-functions: stp_trace_enter on entry and stp_trace_exit before every return, after the scope
+         * cleanups so releases count towards the function. Both take the symbol name, so target_clones versions
+         * trace as the public function.
+         */
+        void emitTraceHooks(Function* llvmFunction) {
+            if(!mCodeGen->mCompilerContext->instrumentFunctions) {
+                return;
+            }
 
-            StapleMethodFunction* stpFunctionType = cast<StapleMethodFunction>(mCodeGen->mCompilerContext->typeTable[methodFunction]);
+            Constant* name = mCodeGen->getStringConstant(mFunctionName);
+            BasicBlock& entry = llvmFunction->getEntryBlock();
+            IRBuilder<> builder(&entry, entry.getFirstInsertionPt());
+            builder.CreateCall(mCodeGen->getTraceFunction("stp_trace_enter"), name);
 
-            FunctionType* functionType = cast<FunctionType>(mCodeGen->getLLVMType(stpFunctionType));
+            for(BasicBlock& bb : *llvmFunction) {
+                if(ReturnInst* ret = dyn_cast<ReturnInst>(bb.getTerminator())) {
+                    builder.SetInsertPoint(ret);
+                    builder.CreateCall(mCodeGen->getTraceFunction("stp_trace_exit"), name);
+                }
+            }
+        }
 
-            string functionName = mCodeGen->createClassSymbolName(mCurrentClass) + "_" + methodFunction->name;
+        void visit(NMethodFunction* methodFunction) {
 
-            Function* llvmFunction = cast<Function>(mCodeGen->mModule.getOrInsertFunction(functionName.c_str(), functionType));
+            LLVMStapleObject* stapleObject = LLVMStapleObject::get(mCodeGen, mCurrentClass);
 
+            StapleMethodFunction* stpFunctionType = cast<StapleMethodFunction>(mCodeGen->mCompilerContext->typeTable[methodFunction]);
 
-            mScope->defineSymbol(functionName, llvmFunction);
-            mValues[methodFunction] = llvmFunction;
+            Function* llvmFunction = mCodeGen->getMethodFunction(stpFunctionType);
+            string functionName = llvmFunction->getName().str();
 
             push();
-            mScope->defineSymbol(methodFunction->name, llvmFunction);
-            mScope->mBasicBlock = BasicBlock::Create(getGlobalContext(), "entry", llvmFunction);
+            mScope->mBasicBlock = BasicBlock::Create(mCodeGen->mContext, "entry", llvmFunction);
             mCodeGen->mIRBuilder.SetInsertPoint(mScope->mBasicBlock);
 
             if(mCodeGen->mCompilerContext->debugSymobols) {
@@ -400,26 +859,22 @@ namespace staple {
 
             }
 
+            mFunctionName = functionName;
+            emitProfileCounter(methodFunction, PS_FunctionEntry);
+            applyFunctionProfile(methodFunction, llvmFunction);
 
+            //"this" is bound to the method, fields are addressed through it where they are used
             Function::arg_iterator AI = llvmFunction->arg_begin();
-            Value* thisPtr = AI;
-            mScope->defineSymbol("this", thisPtr);
-
-            //define all the fields in scope
-            for(StapleField* field : mCurrentClass->getFields()) {
-                uint fieldIndex = 1; // start at index 1 to account for the ref counter
-                mCurrentClass->getField(field->getName(), fieldIndex);
-                Value *fieldPtr = mCodeGen->mIRBuilder.CreateConstGEP2_32(thisPtr, 0, fieldIndex);
-                mScope->defineSymbol(field->getName(), fieldPtr);
-            }
+            mThisPtr = AI;
+            mValues[methodFunction] = mThisPtr;
 
             AI++;
 
             int i = 0;
             while(AI != llvmFunction->arg_end()) {
-                string argName = methodFunction->arguments[i++]->name;
-                AllocaInst* alloc = mCodeGen->mIRBuilder.CreateAlloca(AI->getType(), 0, argName.c_str());
-                mScope->defineSymbol(argName.c_str(), alloc);
+                NArgument* arg = methodFunction->arguments[i++];
+                AllocaInst* alloc = mCodeGen->mIRBuilder.CreateAlloca(AI->getType(), 0, arg->name.c_str());
+                mValues[arg] = alloc;
                 mCodeGen->mIRBuilder.CreateStore(AI, alloc);
                 AI++;
             }
@@ -431,14 +886,26 @@ namespace staple {
 
             pop();
 
+            emitTraceHooks(llvmFunction);
+
         }
 
         void visit(NClassDeclaration* classDeclaration) {
 
             mCurrentClass = cast<StapleClass>(mCodeGen->mCompilerContext->typeTable[classDeclaration]);
 
+            //the other partitions and files only declare them and may use them without this module doing so
+            if(mCodeGen->exportsClassDefs() && mCodeGen->definesClassSupport(mCurrentClass)) {
+                LLVMStapleObject* stapleObject = LLVMStapleObject::get(mCodeGen, mCurrentClass);
+                stapleObject->getInitFunction(mCodeGen);
+                stapleObject->getKillFunction(mCodeGen);
+                stapleObject->getClassDefinition(mCodeGen);
+            }
+
             for(NMethodFunction* method : classDeclaration->functions) {
-                method->accept(this);
+                if(mCodeGen->definesFunction(mFunctionIndex++)) {
+                    method->accept(this);
+                }
             }
 
         }
@@ -451,10 +918,10 @@ namespace staple {
 
             StapleType* type = mCodeGen->mCompilerContext->typeTable[declaration];
 
-            AllocaInst* alloc = mCodeGen->mIRBuilder.CreateAlloca(mCodeGen->getLLVMType(type), 0, declaration->name.c_str());
-            mScope->defineSymbol(declaration->name, alloc);
+            AllocaInst* alloc = createEntryAlloca(mCodeGen->getLLVMType(type), declaration->name);
+            mValues[declaration] = alloc;
 
-            if(mCodeGen->mCompilerContext->debugSymobols) {
+            if(mCodeGen->mCompilerContext->debugSymobols && !mCodeGen->mCompilerContext->lineTablesOnly) {
 
                 DITypeRef diType = mScope->mDebugInfo->getLLVMDebugType(type);
                 DIVariable debugSymbol = mCodeGen->mDIBuider->createLocalVariable(dwarf::DW_TAG_auto_variable,
@@ -474,22 +941,29 @@ namespace staple {
                 mCodeGen->mIRBuilder.CreateStore(ConstantPointerNull::get(cast<PointerType>(mCodeGen->getLLVMType(ptrType))), alloc);
 
                 if(isa<StapleClass>(ptrType->getElementType())) {
-                    mScope->addCleanup(new ScopeVarRelease(alloc, mCodeGen, mScope->mBasicBlock));
+                    mScope->addCleanup(new ScopeVarRelease(alloc, mCodeGen, mScope->mBasicBlock, mFunctionName, declaration->location));
+                }
+            } else if(isa<StapleSlice>(type)) {
+                mCodeGen->mIRBuilder.CreateStore(ConstantAggregateZero::get(mCodeGen->getLLVMType(type)), alloc);
+            } else if(StapleArray* arrayType = dyn_cast<StapleArray>(type)) {
+                //soa columns have no object header to set up
+                if(isa<StapleClass>(arrayType->getElementType()) && !arrayType->isSoa() && arrayType->getSize() > 0) {
+                    emitArrayElementInit(alloc, arrayType);
                 }
             }
 
             if(declaration->assignmentExpr != nullptr) {
-                NAssignment assign(new NIdentifier(declaration->name), declaration->assignmentExpr);
-                assign.location = declaration->location;
-                assign.accept(this);
+                emitAssignment(alloc, declaration->assignmentExpr, declaration->location);
             }
-
-            mValues[declaration] = alloc;
         }
 
         void visit(NIdentifier* identifier) {
-            Value* value = mScope->lookupSymbol(identifier->name);
-            mValues[identifier] = value;
+            if(identifier->fieldIndex >= 0) {
+                //one past the ref counter
+                mValues[identifier] = mCodeGen->mIRBuilder.CreateConstGEP2_32(mThisPtr, 0, identifier->fieldIndex + 1);
+            } else {
+                mValues[identifier] = mValues[identifier->declaration];
+            }
         }
 
         void visit(NIntLiteral* intLiteral) {
@@ -497,6 +971,10 @@ namespace staple {
             mValues[intLiteral] = mCodeGen->mIRBuilder.getInt(APInt(intLiteral->width, value));
         }
 
+        void visit(NFloatLiteral* floatLiteral) {
+            mValues[floatLiteral] = ConstantFP::get(getNodeType(floatLiteral), floatLiteral->str);
+        }
+
         void visit(NNew* newnode) {
             if(mCodeGen->mCompilerContext->debugSymobols){
                 emitDebugLocation(newnode);
@@ -509,17 +987,17 @@ namespace staple {
             Value* size = mCodeGen->mIRBuilder.CreateGEP(nullptrValue, ConstantInt::get(mCodeGen->mIRBuilder.getInt32Ty(), 1));
             size = mCodeGen->mIRBuilder.CreatePointerCast(size, mCodeGen->mIRBuilder.getInt32Ty());
 
-            Function* malloc = mCodeGen->getMallocFunction();
+            StapleClass* stapleClass = cast<StapleClass>(ptrType->getElementType());
+            Constant* site = mCodeGen->createAllocSite(stapleClass->getClassName(), mFunctionName, newnode->location);
 
-            Value* retval = mCodeGen->mIRBuilder.CreateCall(malloc, size);
+            Value* retval = mCodeGen->mIRBuilder.CreateCall2(mCodeGen->getAllocFunction(), size, site);
             retval = mCodeGen->mIRBuilder.CreatePointerCast(retval, llvmPtrType);
 
             mValues[newnode] = retval;
-            mScope->addCleanup(new ReleaseObj(retval, mCodeGen));
+            mScope->addCleanup(new ReleaseObj(retval, mCodeGen, mFunctionName, newnode->location));
 
             //call init function
-            StapleClass* stapleClass = cast<StapleClass>(ptrType->getElementType());
-            LLVMStapleObject* llvmStapleObject = LLVMStapleObject::get(stapleClass);
+            LLVMStapleObject* llvmStapleObject = LLVMStapleObject::get(mCodeGen, stapleClass);
 
             Function* initFunction = llvmStapleObject->getInitFunction(mCodeGen);
             mCodeGen->mIRBuilder.CreateCall(initFunction, retval);
@@ -528,25 +1006,76 @@ namespace staple {
 
         }
 
+        void visit(NNewArray* newArray) {
+            if(mCodeGen->mCompilerContext->debugSymobols){
+                emitDebugLocation(newArray);
+            }
+
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+
+            StapleSlice* sliceType = cast<StapleSlice>(mCodeGen->mCompilerContext->typeTable[newArray]);
+            PointerType* elementPtrType = PointerType::getUnqual(mCodeGen->getLLVMType(sliceType->getElementType()));
+
+            Value* length = irBuilder.CreateIntCast(getValue(newArray->size), irBuilder.getInt32Ty(), true);
+            emitTrapUnless(irBuilder.CreateICmpSGT(length, irBuilder.getInt32(0)), "sizeok", "badsize");
+
+            Value* nullptrValue = ConstantPointerNull::get(elementPtrType);
+            Value* size = irBuilder.CreateGEP(nullptrValue, length);
+            size = irBuilder.CreatePointerCast(size, irBuilder.getInt32Ty());
+
+            Constant* site = mCodeGen->createAllocSite(getHeapTypeName(sliceType->getElementType()) + "[]", mFunctionName,
+                                                       newArray->location);
+            Value* data = irBuilder.CreateCall2(mCodeGen->getAllocFunction(), size, site);
+            data = irBuilder.CreatePointerCast(data, elementPtrType);
+
+            //the storage lives until the enclosing scope exits
+            mScope->addCleanup(new FreeArray(data, mCodeGen, mScope));
+
+            Value* slice = UndefValue::get(mCodeGen->getLLVMType(sliceType));
+            slice = irBuilder.CreateInsertValue(slice, data, 0);
+            slice = irBuilder.CreateInsertValue(slice, length, 1);
+
+            mValues[newArray] = slice;
+        }
+
+        void visit(NArraySlice* arraySlice) {
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+
+            StapleArray* arrayType = cast<StapleArray>(getStapleType(arraySlice->expr));
+            Value* arrayPtr = getValue(arraySlice->expr);
+
+            Value* slice = UndefValue::get(getNodeType(arraySlice));
+            slice = irBuilder.CreateInsertValue(slice, irBuilder.CreateConstInBoundsGEP2_32(arrayPtr, 0, 0), 0);
+            slice = irBuilder.CreateInsertValue(slice, irBuilder.getInt32(arrayType->getSize()), 1);
+
+            mValues[arraySlice] = slice;
+        }
+
         void visit(NAssignment* assignment) {
             if(mCodeGen->mCompilerContext->debugSymobols){
                 emitDebugLocation(assignment);
             }
-            Value* lhsValue = getValue(assignment->lhs);
-            Value* rhsValue = getValue(assignment->rhs);
+            emitAssignment(getValue(assignment->lhs), assignment->rhs, assignment->location);
+        }
+
+        void emitAssignment(Value* lhsValue, NExpression* rhs, const YYLTYPE& location) {
+            Value* rhsValue = getValue(rhs);
 
-            StapleType* rhsType = mCodeGen->mCompilerContext->typeTable[assignment->rhs];
+            StapleType* rhsType = mCodeGen->mCompilerContext->typeTable[rhs];
             StaplePointer* ptrType;
             if((ptrType = dyn_cast<StaplePointer>(rhsType)) && isa<StapleClass>(ptrType->getElementType())) {
 
-                Function* strongStore = LLVMStapleObject::getStoreStrongFunction(&mCodeGen->mModule);
+                Function* strongStore = LLVMStapleObject::getStoreStrongFunction(mCodeGen);
+                mCodeGen->emitRefcountCounter(mCodeGen->mIRBuilder, LLVMCodeGenerator::RC_StoreStrong, mFunctionName,
+                                              location);
                 mCodeGen->mIRBuilder.CreateCall(strongStore, std::vector<Value*>{
-                        mCodeGen->mIRBuilder.CreatePointerCast(lhsValue, PointerType::getUnqual(PointerType::getUnqual(LLVMStapleObject::getStpObjInstanceType()))),
-                        mCodeGen->mIRBuilder.CreatePointerCast(rhsValue, PointerType::getUnqual(LLVMStapleObject::getStpObjInstanceType()))
+                        mCodeGen->mIRBuilder.CreatePointerCast(lhsValue, PointerType::getUnqual(PointerType::getUnqual(LLVMStapleObject::getStpObjInstanceType(mCodeGen)))),
+                        mCodeGen->mIRBuilder.CreatePointerCast(rhsValue, PointerType::getUnqual(LLVMStapleObject::getStpObjInstanceType(mCodeGen)))
                 });
 
             } else {
-                mCodeGen->mIRBuilder.CreateStore(rhsValue, lhsValue);
+                Type* destType = cast<PointerType>(lhsValue->getType())->getElementType();
+                mCodeGen->mIRBuilder.CreateStore(convertScalar(rhsValue, destType), lhsValue);
             }
         }
 
@@ -561,31 +1090,52 @@ namespace staple {
                 emitDebugLocation(binaryOperator);
             }
 
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
             Value* l = getValue(binaryOperator->lhs);
             Value* r = getValue(binaryOperator->rhs);
 
             Value* retval = nullptr;
 
+            //a scalar operand of a vector operator is repeated in every lane
+            if(l->getType()->isVectorTy() != r->getType()->isVectorTy()) {
+                VectorType* vectorType = cast<VectorType>(l->getType()->isVectorTy() ? l->getType() : r->getType());
+                Value*& scalar = l->getType()->isVectorTy() ? r : l;
+                scalar = irBuilder.CreateVectorSplat(vectorType->getNumElements(),
+                                                     convertScalar(scalar, vectorType->getElementType()));
+            }
+
+            if(l->getType()->isFPOrFPVectorTy() || r->getType()->isFPOrFPVectorTy()) {
+                retval = emitFloatBinaryOp(binaryOperator->op, l, r);
+                mValues[binaryOperator] = retval;
+                return;
+            }
+
+            if(l->getType() != r->getType() && l->getType()->isIntegerTy() && r->getType()->isIntegerTy()) {
+                r = convertScalar(r, l->getType());
+            }
+
+            const bool isUnsigned = isUnsignedVector(binaryOperator->lhs) || isUnsignedVector(binaryOperator->rhs);
+
             switch (binaryOperator->op) {
-                case TPLUS: 	retval = mCodeGen->mIRBuilder.CreateAdd(l, r);
+                case TPLUS: 	retval = irBuilder.CreateAdd(l, r);
                     break;
-                case TMINUS: 	retval = mCodeGen->mIRBuilder.CreateSub(l, r);
+                case TMINUS: 	retval = irBuilder.CreateSub(l, r);
                     break;
-                case TMUL: 		retval = mCodeGen->mIRBuilder.CreateMul(l, r);
+                case TMUL: 		retval = irBuilder.CreateMul(l, r);
                     break;
-                case TDIV: 		retval = mCodeGen->mIRBuilder.CreateSDiv(l, r);
+                case TDIV: 		retval = isUnsigned ? irBuilder.CreateUDiv(l, r) : irBuilder.CreateSDiv(l, r);
                     break;
-                case TCEQ:		retval = mCodeGen->mIRBuilder.CreateICmpEQ(l, r);
+                case TCEQ:		retval = irBuilder.CreateICmpEQ(l, r);
                     break;
-                case TCNE:		retval = mCodeGen->mIRBuilder.CreateICmpNE(l, r);
+                case TCNE:		retval = irBuilder.CreateICmpNE(l, r);
                     break;
-                case TCGT:		retval = mCodeGen->mIRBuilder.CreateICmpSGT(l, r);
+                case TCGT:		retval = isUnsigned ? irBuilder.CreateICmpUGT(l, r) : irBuilder.CreateICmpSGT(l, r);
                     break;
-                case TCLT:		retval = mCodeGen->mIRBuilder.CreateICmpSLT(l, r);
+                case TCLT:		retval = isUnsigned ? irBuilder.CreateICmpULT(l, r) : irBuilder.CreateICmpSLT(l, r);
                     break;
-                case TCGE:		retval = mCodeGen->mIRBuilder.CreateICmpSGE(l, r);
+                case TCGE:		retval = isUnsigned ? irBuilder.CreateICmpUGE(l, r) : irBuilder.CreateICmpSGE(l, r);
                     break;
-                case TCLE:		retval = mCodeGen->mIRBuilder.CreateICmpSLE(l, r);
+                case TCLE:		retval = isUnsigned ? irBuilder.CreateICmpULE(l, r) : irBuilder.CreateICmpSLE(l, r);
                     break;
 
             }
@@ -593,6 +1143,49 @@ namespace staple {
             mValues[binaryOperator] = retval;
         }
 
+        bool isUnsignedVector(NExpression* expr) {
+            StapleVector* vectorType = dyn_cast_or_null<StapleVector>(getStapleType(expr));
+            return vectorType != nullptr && vectorType->isUnsigned();
+        }
+
+        /**
+         * lane index into vector, traps unless it names one of its lanes. Literals were checked by the semantic pass.
+         */
+        Value* getLaneIndex(NExpression* expr, Value* vector) {
+            Value* retval = getValue(expr);
+            if(!isa<ConstantInt>(retval)) {
+                emitBoundsCheck(retval, mCodeGen->mIRBuilder.getInt32(cast<VectorType>(vector->getType())->getNumElements()));
+            }
+            return retval;
+        }
+
+        Value* emitFloatBinaryOp(int op, Value* l, Value* r) {
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+
+            //mixed int/float scalar arithmetic is done at the float operand's width
+            if(!l->getType()->isFPOrFPVectorTy()) {
+                l = convertScalar(l, r->getType());
+            } else if(!r->getType()->isFPOrFPVectorTy()) {
+                r = convertScalar(r, l->getType());
+            } else if(l->getType() != r->getType()) {
+                r = convertScalar(r, l->getType());
+            }
+
+            switch (op) {
+                case TPLUS: return irBuilder.CreateFAdd(l, r);
+                case TMINUS: return irBuilder.CreateFSub(l, r);
+                case TMUL: return irBuilder.CreateFMul(l, r);
+                case TDIV: return irBuilder.CreateFDiv(l, r);
+                case TCEQ: return irBuilder.CreateFCmpOEQ(l, r);
+                case TCNE: return irBuilder.CreateFCmpONE(l, r);
+                case TCGT: return irBuilder.CreateFCmpOGT(l, r);
+                case TCLT: return irBuilder.CreateFCmpOLT(l, r);
+                case TCGE: return irBuilder.CreateFCmpOGE(l, r);
+                case TCLE: return irBuilder.CreateFCmpOLE(l, r);
+            }
+            return nullptr;
+        }
+
         void visit(NIfStatement* ifStatement) {
 
             if(mCodeGen->mCompilerContext->debugSymobols){
@@ -601,33 +1194,102 @@ namespace staple {
 
             Function* parent = mCodeGen->mIRBuilder.GetInsertBlock()->getParent();
 
+            emitProfileCounter(ifStatement, PS_Block);
+            Value* conditionValue = getValue(ifStatement->condition);
 
-            BasicBlock* thenBB = dyn_cast<BasicBlock>(getValue(ifStatement->thenBlock));
+            BasicBlock* thenBB = BasicBlock::Create(mCodeGen->mContext, "then", parent);
             BasicBlock* elseBB = ifStatement->elseBlock != nullptr
-                                 ? dyn_cast<BasicBlock>(getValue(ifStatement->elseBlock))
+                                 ? BasicBlock::Create(mCodeGen->mContext, "else", parent)
                                  : nullptr;
+            BasicBlock* mergeBlock = BasicBlock::Create(mCodeGen->mContext, "");
 
-            BasicBlock* mergeBlock = BasicBlock::Create(getGlobalContext(), "", parent);
+            BranchInst* branch = mCodeGen->mIRBuilder.CreateCondBr(conditionValue, thenBB, elseBB != nullptr ? elseBB : mergeBlock);
 
-            IRBuilder<> builder(thenBB);
-            builder.CreateBr(mergeBlock);
+            uint64_t count, thenCount;
+            if(getProfileCount(ifStatement, count) && getProfileCount(ifStatement->thenBlock, thenCount)) {
+                setBranchWeights(branch, thenCount, count - min(count, thenCount));
+            }
 
+            mCodeGen->mIRBuilder.SetInsertPoint(thenBB);
+            emitProfileCounter(ifStatement->thenBlock, PS_Block);
+            emitBranch(ifStatement->thenBlock, thenBB, mergeBlock);
             if(elseBB != nullptr) {
-                IRBuilder<> builder(elseBB);
-                builder.CreateBr(mergeBlock);
-            } else {
-                elseBB = mergeBlock;
+                emitBranch(ifStatement->elseBlock, elseBB, mergeBlock);
             }
 
-            Value* conditionValue = getValue(ifStatement->condition);
-            mCodeGen->mIRBuilder.CreateCondBr(conditionValue, thenBB, elseBB);
-
-
+            parent->getBasicBlockList().push_back(mergeBlock);
             mScope->mBasicBlock = mergeBlock;
             mCodeGen->mIRBuilder.SetInsertPoint(mergeBlock);
 
         }
 
+        /**
+         * The loop is marked for vectorization at the simd width. The vectorizer emits the scalar loop for the
+         * iterations left over itself, so the body is only emitted once.
+         */
+        void visit(NForeach* foreach) {
+
+            if(mCodeGen->mCompilerContext->debugSymobols){
+                emitDebugLocation(foreach);
+            }
+
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+            const unsigned width = mSimdWidth;
+
+            Value* start = convertScalar(getValue(foreach->start), irBuilder.getInt32Ty());
+            Value* end = convertScalar(getValue(foreach->end), irBuilder.getInt32Ty());
+
+            push();
+            mScope->mBasicBlock = irBuilder.GetInsertBlock();
+
+            emitProfileCounter(foreach, PS_Block);
+
+            AllocaInst* counter = createEntryAlloca(irBuilder.getInt32Ty(), foreach->var);
+            mValues[foreach] = counter;
+            irBuilder.CreateStore(start, counter);
+
+            emitForeachLoop(foreach, counter, end, createLoopID(width));
+
+            BasicBlock* exitBlock = irBuilder.GetInsertBlock();
+            pop();
+            mScope->mBasicBlock = exitBlock;
+        }
+
+        void visit(NArrayElementPtr* arrayElementPtr) {
+
+            if(mCodeGen->mCompilerContext->debugSymobols){
+                emitDebugLocation(arrayElementPtr);
+            }
+
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+
+            StapleType* baseType = getStapleType(arrayElementPtr->base);
+            Value* base = getValue(arrayElementPtr->base);
+            Value* index = getValue(arrayElementPtr->expr);
+
+            if(isa<StapleSlice>(baseType)) {
+                //base is the slice value { data, length }
+                if(arrayElementPtr->checkBounds) {
+                    emitBoundsCheck(index, irBuilder.CreateExtractValue(base, 1));
+                }
+                mValues[arrayElementPtr] = irBuilder.CreateInBoundsGEP(irBuilder.CreateExtractValue(base, 0), index);
+
+            } else if(isa<StaplePointer>(baseType)) {
+                mValues[arrayElementPtr] = irBuilder.CreateGEP(base, index);
+
+            } else {
+                //base is the address of the array
+                StapleArray* arrayType = cast<StapleArray>(baseType);
+                if(arrayElementPtr->checkBounds) {
+                    emitBoundsCheck(index, irBuilder.getInt32(arrayType->getSize()));
+                }
+                mValues[arrayElementPtr] = irBuilder.CreateInBoundsGEP(base, vector<Value*>{
+                        irBuilder.getInt32(0),
+                        index
+                });
+            }
+        }
+
         void visit(NMemberAccess* memberAccess) {
 
             if(mCodeGen->mCompilerContext->debugSymobols){
@@ -640,22 +1302,207 @@ namespace staple {
             StapleClass* classPtr = nullptr;
             if((ptr = dyn_cast<StaplePointer>(baseType)) && (classPtr = dyn_cast<StapleClass>(ptr->getElementType()))) {
                 Value* basePtr = getValue(memberAccess->base);
-                LLVMStapleObject* stapleObject = LLVMStapleObject::get(classPtr);
-                Value* fieldPtr = stapleObject->getFieldPtr(memberAccess->field, mCodeGen->mIRBuilder, basePtr);
+                LLVMStapleObject* stapleObject = LLVMStapleObject::get(mCodeGen, classPtr);
+                Value* fieldPtr = stapleObject->getFieldPtr(memberAccess->fieldIndex, mCodeGen->mIRBuilder, basePtr);
 
                 mValues[memberAccess] = fieldPtr;
+
+            } else if((classPtr = dyn_cast<StapleClass>(baseType))) {
+                LLVMStapleObject* stapleObject = LLVMStapleObject::get(mCodeGen, classPtr);
+
+                NArrayElementPtr* element = matchNode<NArrayElementPtr>(memberAccess->base);
+                StapleArray* arrayType = element != nullptr
+                                         ? dyn_cast<StapleArray>(mCodeGen->mCompilerContext->typeTable[element->base])
+                                         : nullptr;
+
+                if(arrayType != nullptr && arrayType->isSoa()) {
+                    //soa elements have no address of their own, index straight into the field's column
+                    Value* arrayPtr = getValue(element->base);
+                    Value* index = getValue(element->expr);
+                    if(element->checkBounds) {
+                        emitBoundsCheck(index, mCodeGen->mIRBuilder.getInt32(arrayType->getSize()));
+                    }
+                    mValues[memberAccess] = stapleObject->getSoaFieldPtr(memberAccess->fieldIndex, mCodeGen->mIRBuilder, arrayPtr, index);
+                } else {
+                    Value* basePtr = getValue(memberAccess->base);
+                    mValues[memberAccess] = stapleObject->getFieldPtr(memberAccess->fieldIndex, mCodeGen->mIRBuilder, basePtr);
+                }
             }
 
 
         }
 
+        void emitBuiltin(NFunctionCall* functionCall) {
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+            switch(functionCall->builtin) {
+                case BI_Len: {
+                    NExpression* arg = functionCall->arguments[0];
+                    if(StapleArray* arrayType = dyn_cast<StapleArray>(getStapleType(arg))) {
+                        mValues[functionCall] = mCodeGen->mIRBuilder.getInt32(arrayType->getSize());
+                    } else {
+                        mValues[functionCall] = mCodeGen->mIRBuilder.CreateExtractValue(getValue(arg), 1);
+                    }
+                    break;
+                }
+
+                case BI_Splat: {
+                    VectorType* vectorType = cast<VectorType>(getNodeType(functionCall));
+                    Value* scalar = convertScalar(getValue(functionCall->arguments[0]), vectorType->getElementType());
+                    mValues[functionCall] = irBuilder.CreateVectorSplat(vectorType->getNumElements(), scalar);
+                    break;
+                }
+
+                case BI_Extract: {
+                    Value* vector = getValue(functionCall->arguments[0]);
+                    Value* index = getLaneIndex(functionCall->arguments[1], vector);
+                    mValues[functionCall] = irBuilder.CreateExtractElement(vector, index);
+                    break;
+                }
+
+                case BI_Insert: {
+                    Value* vector = getValue(functionCall->arguments[0]);
+                    Value* index = getLaneIndex(functionCall->arguments[1], vector);
+                    Type* laneType = cast<VectorType>(vector->getType())->getElementType();
+                    mValues[functionCall] = irBuilder.CreateInsertElement(vector,
+                                                                          convertScalar(getValue(functionCall->arguments[2]), laneType),
+                                                                          index);
+                    break;
+                }
+
+                case BI_Shuffle: {
+                    std::vector<Constant*> mask;
+                    for(size_t i=2;i<functionCall->arguments.size();i++) {
+                        NIntLiteral* lane = matchNode<NIntLiteral>(functionCall->arguments[i]);
+                        mask.push_back(irBuilder.getInt32(atoi(lane->str.c_str())));
+                    }
+                    mValues[functionCall] = irBuilder.CreateShuffleVector(getValue(functionCall->arguments[0]),
+                                                                          getValue(functionCall->arguments[1]),
+                                                                          ConstantVector::get(mask));
+                    break;
+                }
+
+                case BI_Select:
+                    mValues[functionCall] = irBuilder.CreateSelect(getValue(functionCall->arguments[0]),
+                                                                   getValue(functionCall->arguments[1]),
+                                                                   getValue(functionCall->arguments[2]));
+                    break;
+
+                case BI_ReduceAdd:
+                case BI_ReduceMul:
+                case BI_ReduceMin:
+                case BI_ReduceMax:
+                    mValues[functionCall] = emitReduction(functionCall->builtin, getValue(functionCall->arguments[0]),
+                                                          isUnsignedVector(functionCall->arguments[0]));
+                    break;
+
+                case BI_VLoad: {
+                    VectorType* vectorType = cast<VectorType>(getNodeType(functionCall));
+                    Value* ptr = getLanesPtr(functionCall->arguments[0], getValue(functionCall->arguments[1]), vectorType);
+                    mValues[functionCall] = irBuilder.CreateAlignedLoad(ptr, getLaneAlignment(vectorType));
+                    break;
+                }
+
+                case BI_VStore: {
+                    Value* vector = getValue(functionCall->arguments[2]);
+                    VectorType* vectorType = cast<VectorType>(vector->getType());
+                    Value* ptr = getLanesPtr(functionCall->arguments[0], getValue(functionCall->arguments[1]), vectorType);
+                    mValues[functionCall] = irBuilder.CreateAlignedStore(vector, ptr, getLaneAlignment(vectorType));
+                    break;
+                }
+
+                default:
+                    break;
+            }
+        }
+
+        /**
+         * combines the lanes of vector with a tree of half width shuffles, so n lanes reduce in log2(n) steps.
+         * Float sums are therefore reassociated compared to a sequential loop.
+         */
+        Value* emitReduction(Builtin builtin, Value* vector, bool isUnsigned) {
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+            bool isFloat = vector->getType()->isFPOrFPVectorTy();
+            unsigned numLanes = cast<VectorType>(vector->getType())->getNumElements();
+
+            while(numLanes > 1) {
+                numLanes /= 2;
+                std::vector<Constant*> lowMask, highMask;
+                for(unsigned i=0;i<numLanes;i++) {
+                    lowMask.push_back(irBuilder.getInt32(i));
+                    highMask.push_back(irBuilder.getInt32(i + numLanes));
+                }
+                Value* undef = UndefValue::get(vector->getType());
+                Value* low = irBuilder.CreateShuffleVector(vector, undef, ConstantVector::get(lowMask));
+                Value* high = irBuilder.CreateShuffleVector(vector, undef, ConstantVector::get(highMask));
+
+                switch(builtin) {
+                    case BI_ReduceAdd:
+                        vector = isFloat ? irBuilder.CreateFAdd(low, high) : irBuilder.CreateAdd(low, high);
+                        break;
+                    case BI_ReduceMul:
+                        vector = isFloat ? irBuilder.CreateFMul(low, high) : irBuilder.CreateMul(low, high);
+                        break;
+                    case BI_ReduceMin: {
+                        Value* less = isFloat ? irBuilder.CreateFCmpOLT(low, high)
+                                    : isUnsigned ? irBuilder.CreateICmpULT(low, high) : irBuilder.CreateICmpSLT(low, high);
+                        vector = irBuilder.CreateSelect(less, low, high);
+                        break;
+                    }
+                    default: {
+                        Value* greater = isFloat ? irBuilder.CreateFCmpOGT(low, high)
+                                       : isUnsigned ? irBuilder.CreateICmpUGT(low, high) : irBuilder.CreateICmpSGT(low, high);
+                        vector = irBuilder.CreateSelect(greater, low, high);
+                        break;
+                    }
+                }
+            }
+
+            return irBuilder.CreateExtractElement(vector, irBuilder.getInt32(0));
+        }
+
+        /**
+         * pointer to the lanes of vectorType starting at array[index], after checking all of them are in bounds
+         */
+        Value* getLanesPtr(NExpression* array, Value* index, VectorType* vectorType) {
+            IRBuilder<>& irBuilder = mCodeGen->mIRBuilder;
+            Value* data;
+            Value* length;
+            if(StapleArray* arrayType = dyn_cast<StapleArray>(getStapleType(array))) {
+                data = irBuilder.CreateConstGEP2_32(getValue(array), 0, 0);
+                length = irBuilder.getInt32(arrayType->getSize());
+            } else {
+                Value* slice = getValue(array);
+                data = irBuilder.CreateExtractValue(slice, 0);
+                length = irBuilder.CreateExtractValue(slice, 1);
+            }
+
+            index = irBuilder.CreateIntCast(index, length->getType(), true);
+            emitBoundsCheck(index, length);
+            emitBoundsCheck(irBuilder.CreateAdd(index, irBuilder.getInt32(vectorType->getNumElements() - 1)), length);
+
+            Value* elementPtr = irBuilder.CreateGEP(data, index);
+            return irBuilder.CreatePointerCast(elementPtr, PointerType::getUnqual(vectorType));
+        }
+
+        /**
+         * array storage is only guaranteed to be aligned to its elements, which are all naturally aligned scalars
+         */
+        unsigned getLaneAlignment(VectorType* vectorType) {
+            return vectorType->getElementType()->getPrimitiveSizeInBits() / 8;
+        }
+
         void visit(NFunctionCall* functionCall) {
 
             if(mCodeGen->mCompilerContext->debugSymobols){
                 emitDebugLocation(functionCall);
             }
 
-            Function* function = cast<Function>(mScope->lookupSymbol(functionCall->name));
+            if(functionCall->builtin != BI_None) {
+                emitBuiltin(functionCall);
+                return;
+            }
+
+            Function* function = cast<Function>(mValues[functionCall->declaration]);
 
             vector<Value*> argValues;
             for(NExpression* argExp : functionCall->arguments) {
@@ -677,13 +1524,11 @@ namespace staple {
             StapleClass* classPtr = nullptr;
             if((ptr = dyn_cast<StaplePointer>(baseType)) && (classPtr = dyn_cast<StapleClass>(ptr->getElementType()))) {
                 Value* basePtr = getValue(methodCall->base);
-                LLVMStapleObject* stapleObject = LLVMStapleObject::get(classPtr);
-
-                string functionName = mCodeGen->createClassSymbolName(classPtr) + "_" + methodCall->name;
-                Function* function = mCodeGen->mModule.getFunction(functionName.c_str());
+                Function* function = mCodeGen->getMethodFunction(methodCall->method);
 
+                //an inherited method takes this as the class declaring it
                 vector<Value*> argValues;
-                argValues.push_back(basePtr);
+                argValues.push_back(mCodeGen->mIRBuilder.CreatePointerCast(basePtr, function->arg_begin()->getType()));
                 for(NExpression* argExp : methodCall->arguments) {
                     argValues.push_back(getValue(argExp));
                 }
@@ -699,26 +1544,26 @@ namespace staple {
 
         void visit(NBlock* block) {
 
-            Function* parent = mCodeGen->mIRBuilder.GetInsertBlock()->getParent();
-            BasicBlock* basicBlock = BasicBlock::Create(getGlobalContext(), "", parent);
-            mValues[block] = basicBlock;
-
             push();
 
             if(mCodeGen->mCompilerContext->debugSymobols) {
                 mScope->mDIScope = mCodeGen->mDIBuider->createLexicalBlock(mScope->getParent()->mDIScope, mScope->mDebugInfo->mFile, block->location.first_line, block->location.first_column, 0);
             }
 
-            mScope->mBasicBlock = basicBlock;
-            mCodeGen->mIRBuilder.SetInsertPoint(mScope->mBasicBlock);
+            mScope->mBasicBlock = mCodeGen->mIRBuilder.GetInsertBlock();
 
             for(NStatement* statement : block->statements) {
                 statement->accept(this);
             }
 
+            //statements may have split the block, continue wherever they left off
+            BasicBlock* exitBlock = mCodeGen->mIRBuilder.GetInsertBlock();
+            mScope->mBasicBlock = exitBlock;
+
             pop();
 
-            mCodeGen->mIRBuilder.SetInsertPoint(mScope->mBasicBlock);
+            mScope->mBasicBlock = exitBlock;
+            mCodeGen->mIRBuilder.SetInsertPoint(exitBlock);
 
         }
 
@@ -734,11 +1579,23 @@ namespace staple {
 
     };
 
-    LLVMCodeGenerator::LLVMCodeGenerator(CompilerContext *compilerContext)
+    LLVMCodeGenerator::LLVMCodeGenerator(CompilerContext *compilerContext, LLVMContext& context,
+                                         const string& inputFilename)
+    : LLVMCodeGenerator(compilerContext, context, inputFilename, 0, 1) {}
+
+    LLVMCodeGenerator::LLVMCodeGenerator(CompilerContext *compilerContext, LLVMContext& context,
+                                         const string& inputFilename, unsigned partition, unsigned numPartitions)
     : mCompilerContext(compilerContext),
-      mIRBuilder(getGlobalContext()),
-      mModule(mCompilerContext->inputFilename.c_str(), getGlobalContext()),
-      mFunctionPassManager(&mModule)
+      mInputFilename(inputFilename),
+      mContext(context),
+      mIRBuilder(mContext),
+      mDIBuider(nullptr),
+      mModule(mInputFilename.c_str(), mContext),
+      mPartition(partition),
+      mNumPartitions(numPartitions),
+      mObjInstanceType(nullptr),
+      mObjClassDefType(nullptr),
+      mObjVtableType(nullptr)
 
     {
         if(mCompilerContext->debugSymobols) {
@@ -747,6 +1604,19 @@ namespace staple {
 
             mDIBuider = new DIBuilder(mModule);
         }
+
+        initTarget();
+    }
+
+    LLVMCodeGenerator::~LLVMCodeGenerator() {
+        for(auto& entry : mStapleObjects) {
+            delete entry.second;
+        }
+        delete mDIBuider;
+    }
+
+    bool LLVMCodeGenerator::exportsClassDefs() const {
+        return isPartitioned() || mCompilerContext->inputFilenames.size() > 1;
     }
 
     string LLVMCodeGenerator::createNamespaceSymbolName(const string &name) {
@@ -756,12 +1626,30 @@ namespace staple {
         return retval;
     }
 
+    string LLVMCodeGenerator::createFunctionSymbolName(Symbol name) {
+        return name == SYM_MAIN ? name.str() : createNamespaceSymbolName(name);
+    }
+
     string LLVMCodeGenerator::createClassSymbolName(const StapleClass *stapleClass) {
         string retval = stapleClass->getClassName();
         replace(retval.begin(), retval.end(), '.', '_');
         return retval;
     }
 
+    string LLVMCodeGenerator::createMethodSymbolName(const StapleClass* stapleClass, Symbol method) {
+        return createClassSymbolName(stapleClass) + "_" + method;
+    }
+
+    Function* LLVMCodeGenerator::getMethodFunction(StapleMethodFunction* method) {
+        Function*& retval = mMethodFunctions[method];
+        if(retval == nullptr) {
+            string name = createMethodSymbolName(method->getClass(), method->getName());
+            FunctionType* functionType = cast<FunctionType>(getLLVMType(method));
+            retval = cast<Function>(mModule.getOrInsertFunction(name.c_str(), functionType));
+        }
+        return retval;
+    }
+
     /*
     std::map<StapleClass*, StructType*> mClassStructCache;
 
@@ -775,22 +1663,47 @@ namespace staple {
      */
 
     Type* LLVMCodeGenerator::getLLVMType(StapleType* stapleType) {
+        auto cached = mLLVMTypes.find(stapleType);
+        if(cached != mLLVMTypes.end()) {
+            return cached->second;
+        }
+
         Type* retval = nullptr;
         if(stapleType == StapleType::getVoidType()) {
-            retval = Type::getVoidTy(getGlobalContext());
+            retval = Type::getVoidTy(mContext);
         } else if(stapleType == StapleType::getBoolType()) {
-            retval = Type::getInt1Ty(getGlobalContext());
+            retval = Type::getInt1Ty(mContext);
         } else if(StapleInt* intType = dyn_cast<StapleInt>(stapleType)) {
-            retval = Type::getIntNTy(getGlobalContext(), intType->getWidth());
+            retval = Type::getIntNTy(mContext, intType->getWidth());
+        } else if(StapleFloat* floatType = dyn_cast<StapleFloat>(stapleType)) {
+            switch(floatType->getWidth()) {
+                case 16: retval = Type::getHalfTy(mContext); break;
+                case 64: retval = Type::getDoubleTy(mContext); break;
+                default: retval = Type::getFloatTy(mContext); break;
+            }
+        } else if(StapleVector* vectorType = dyn_cast<StapleVector>(stapleType)) {
+            retval = VectorType::get(getLLVMType(vectorType->getElementType()), vectorType->getNumLanes());
         } else if(StaplePointer* ptrType = dyn_cast<StaplePointer>(stapleType)) {
             retval = PointerType::getUnqual(getLLVMType(ptrType->getElementType()));
         } else if(StapleClass* classType = dyn_cast<StapleClass>(stapleType)) {
-            LLVMStapleObject* objHelper = LLVMStapleObject::get(classType);
+            LLVMStapleObject* objHelper = LLVMStapleObject::get(this, classType);
             retval = objHelper->getObjectType(this);
         } else if(StapleField* field = dyn_cast<StapleField>(stapleType)) {
             retval = getLLVMType(field->getElementType());
+        } else if(StapleSlice* sliceType = dyn_cast<StapleSlice>(stapleType)) {
+            retval = StructType::get(mContext, vector<Type*>{
+                    PointerType::getUnqual(getLLVMType(sliceType->getElementType())), // data
+                    Type::getInt32Ty(mContext) // length
+            });
+        } else if(StapleArray* arrayType = dyn_cast<StapleArray>(stapleType)) {
+            if(arrayType->isSoa()) {
+                LLVMStapleObject* objHelper = LLVMStapleObject::get(this, cast<StapleClass>(arrayType->getElementType()));
+                retval = objHelper->getSoaType(this, arrayType->getSize());
+            } else {
+                retval = ArrayType::get(getLLVMType(arrayType->getElementType()), arrayType->getSize());
+            }
         } else if(StapleClassDef* classDef = dyn_cast<StapleClassDef>(stapleType)) {
-            LLVMStapleObject* llvmStapleObject = LLVMStapleObject::get(classDef->getClass());
+            LLVMStapleObject* llvmStapleObject = LLVMStapleObject::get(this, classDef->getClass());
             retval = llvmStapleObject->getClassDefType(this);
         } else if(StapleMethodFunction* method = dyn_cast<StapleMethodFunction>(stapleType)){
             vector<Type*> argTypes;
@@ -807,42 +1720,382 @@ namespace staple {
             retval = FunctionType::get(getLLVMType(function->getReturnType()), argTypes, function->getIsVarg());
         }
 
+        if(retval != nullptr) {
+            mLLVMTypes[stapleType] = retval;
+        }
         return retval;
     }
 
-    Function* LLVMCodeGenerator::getMallocFunction() {
+    Function* LLVMCodeGenerator::getAllocFunction() {
 
-        Function* retval = mModule.getFunction("malloc");
+        Function* retval = mModule.getFunction("stp_alloc");
         if(retval == NULL) {
             std::vector<Type*> argTypes;
-            argTypes.push_back(IntegerType::getInt32Ty(getGlobalContext()));
+            argTypes.push_back(IntegerType::getInt32Ty(mContext));
+            argTypes.push_back(Type::getInt8PtrTy(mContext));
 
-            Type* returnType = Type::getInt8PtrTy(getGlobalContext());
+            Type* returnType = Type::getInt8PtrTy(mContext);
             FunctionType *ftype = FunctionType::get(returnType, argTypes, false);
-            retval = Function::Create(ftype, Function::LinkageTypes::ExternalLinkage, "malloc", &mModule);
+            retval = Function::Create(ftype, Function::LinkageTypes::ExternalLinkage, "stp_alloc", &mModule);
         }
 
         return retval;
     }
 
     Function* LLVMCodeGenerator::getFreeFunction() {
-        Function* retval = mModule.getFunction("free");
+        Function* retval = mModule.getFunction("stp_free");
         if(retval == NULL) {
             std::vector<Type*> argTypes;
-            argTypes.push_back(Type::getInt8PtrTy(getGlobalContext()));
+            argTypes.push_back(Type::getInt8PtrTy(mContext));
 
-            FunctionType *ftype = FunctionType::get(Type::getVoidTy(getGlobalContext()), argTypes, false);
-            retval = Function::Create(ftype, Function::LinkageTypes::ExternalLinkage, "free", &mModule);
+            FunctionType *ftype = FunctionType::get(Type::getVoidTy(mContext), argTypes, false);
+            retval = Function::Create(ftype, Function::LinkageTypes::ExternalLinkage, "stp_free", &mModule);
         }
 
         return retval;
     }
 
+    Function* LLVMCodeGenerator::getTraceFunction(const string& name) {
+        LLVMContext& context = mContext;
+        return cast<Function>(mModule.getOrInsertFunction(name, Type::getVoidTy(context), Type::getInt8PtrTy(context), NULL));
+    }
+
+    Constant* LLVMCodeGenerator::getStringConstant(const string& str) {
+        Constant*& retval = mStringConstants[str];
+        if(retval == nullptr) {
+            Constant* value = ConstantDataArray::getString(mContext, str.c_str());
+            GlobalVariable* global = new GlobalVariable(mModule, value->getType(), true, GlobalValue::LinkageTypes::PrivateLinkage, value);
+            retval = ConstantExpr::getPointerCast(global, Type::getInt8PtrTy(mContext));
+        }
+        return retval;
+    }
+
+    Constant* LLVMCodeGenerator::createAllocSite(const string& typeName, const string& function, const YYLTYPE& location) {
+        LLVMContext& context = mContext;
+
+        // { i8* type, i8* function, i32 line, i32 column, [8 x i64] runtime statistics }
+        ArrayType* statsType = ArrayType::get(Type::getInt64Ty(context), 8);
+        StructType* siteType = StructType::get(context, vector<Type*>{
+                Type::getInt8PtrTy(context), Type::getInt8PtrTy(context),
+                Type::getInt32Ty(context), Type::getInt32Ty(context), statsType
+        });
+
+        Constant* site = ConstantStruct::get(siteType, vector<Constant*>{
+                getStringConstant(typeName),
+                getStringConstant(function),
+                ConstantInt::get(Type::getInt32Ty(context), location.first_line),
+                ConstantInt::get(Type::getInt32Ty(context), location.first_column),
+                ConstantAggregateZero::get(statsType)
+        });
+
+        GlobalVariable* global = new GlobalVariable(mModule, siteType, false, GlobalValue::LinkageTypes::InternalLinkage,
+                                                    site, "__stp_alloc_site");
+        return ConstantExpr::getPointerCast(global, Type::getInt8PtrTy(context));
+    }
+
+    /**
+     * --heap-profile: turns the heap profiler on before main, STP_HEAP_PROFILE does the same without recompiling
+     */
+    void LLVMCodeGenerator::emitHeapProfileInit() {
+        LLVMContext& context = mContext;
+
+        Function* init = Function::Create(FunctionType::get(Type::getVoidTy(context), false),
+                                          Function::LinkageTypes::InternalLinkage, "__stp_heap_profile_init", &mModule);
+        IRBuilder<> builder(BasicBlock::Create(context, "entry", init));
+
+        Function* enableFunction = cast<Function>(mModule.getOrInsertFunction("stp_heap_profile_enable",
+                Type::getVoidTy(context), Type::getInt8PtrTy(context), NULL));
+        builder.CreateCall(enableFunction, getStringConstant(mCompilerContext->heapProfile));
+        builder.CreateRetVoid();
+
+        appendToGlobalCtors(mModule, init, 0);
+    }
+
+    void LLVMCodeGenerator::initTarget() {
+        //resolved by the first generator, the later ones may be made on other threads and only read the result
+        if(!mCompilerContext->targetResolved) {
+            string& cpu = mCompilerContext->targetCPU;
+            string features;
+
+            if(cpu == "native" || mCompilerContext->targetFeatures == "native") {
+                StringMap<bool> hostFeatures;
+                if(sys::getHostCPUFeatures(hostFeatures)) {
+                    for(StringMap<bool>::iterator it = hostFeatures.begin(); it != hostFeatures.end(); ++it) {
+                        features += string(features.empty() ? "" : ",") + (it->getValue() ? "+" : "-") + it->getKey().str();
+                    }
+                }
+            }
+            if(cpu == "native") {
+                cpu = sys::getHostCPUName();
+            }
+            if(!mCompilerContext->targetFeatures.empty() && mCompilerContext->targetFeatures != "native") {
+                //later entries override the host's
+                features += string(features.empty() ? "" : ",") + mCompilerContext->targetFeatures;
+            }
+            mCompilerContext->targetFeatures = features;
+
+            if(mCompilerContext->targetTriple.empty()) {
+                mCompilerContext->targetTriple = sys::getDefaultTargetTriple();
+            }
+
+            InitializeAllTargetInfos();
+            InitializeAllTargets();
+            InitializeAllTargetMCs();
+            InitializeAllAsmPrinters();
+
+            mCompilerContext->simdWidth = getSimdWidth(mCompilerContext->targetTriple, cpu, features);
+            mCompilerContext->targetResolved = true;
+        }
+
+        mTargetMachine = createTargetMachine(mCompilerContext);
+        mModule.setTargetTriple(mCompilerContext->targetTriple);
+        mModule.setDataLayout(mTargetMachine->getDataLayout());
+    }
+
+    TargetMachine* LLVMCodeGenerator::createTargetMachine(CompilerContext* compilerContext) {
+        string error;
+        const Target* target = TargetRegistry::lookupTarget(compilerContext->targetTriple, error);
+        if(target == nullptr) {
+            fprintf(stderr, "%s\n", error.c_str());
+            exit(1);
+        }
+
+        return target->createTargetMachine(compilerContext->targetTriple, compilerContext->targetCPU,
+                                           compilerContext->targetFeatures, TargetOptions());
+    }
+
+    /**
+     * lanes of 32 bit values in the widest vector registers of the subtarget for cpu and features. The subtarget
+     * knows the features every cpu implies, but its feature bits have no public names, so each feature is looked up
+     * by toggling it in a fresh copy: only toggling a disabled feature sets new bits.
+     */
+    unsigned LLVMCodeGenerator::getSimdWidth(const string& triple, const string& cpu, const string& features) {
+        Triple::ArchType arch = Triple(triple).getArch();
+        string error;
+        const Target* target = TargetRegistry::lookupTarget(triple, error);
+        //other targets do not know the x86 feature names and complain about them
+        if(target == nullptr || (arch != Triple::x86 && arch != Triple::x86_64)) {
+            return 4;
+        }
+
+        auto hasFeature = [&](const char* feature) {
+            unique_ptr<MCSubtargetInfo> subtarget(target->createMCSubtargetInfo(triple, cpu, features));
+            uint64_t before = subtarget->getFeatureBits();
+            uint64_t after = subtarget->ToggleFeature(feature);
+            return (after & ~before) == 0;
+        };
+
+        unsigned retval = 4;
+        if(hasFeature("avx512f")) {
+            retval = 16;
+        } else if(hasFeature("avx2") || hasFeature("avx")) {
+            retval = 8;
+        }
+        return retval;
+    }
+
+    string LLVMCodeGenerator::getTargetFeatures(const string& cloneFeatures) {
+        string retval = mCompilerContext->targetFeatures;
+        stringstream stream(cloneFeatures);
+        string feature;
+        while(getline(stream, feature, ',')) {
+            retval += string(retval.empty() ? "" : ",") + "+" + feature;
+        }
+        return retval;
+    }
+
+    unsigned LLVMCodeGenerator::getCloneSimdWidth(const string& cloneFeatures) {
+        return getSimdWidth(mCompilerContext->targetTriple, mCompilerContext->targetCPU, getTargetFeatures(cloneFeatures));
+    }
+
+    Function* LLVMCodeGenerator::getCpuSupportsFunction() {
+        Function* retval = mModule.getFunction("stp_cpu_supports");
+        if(retval == NULL) {
+            FunctionType *ftype = FunctionType::get(Type::getInt32Ty(mContext), Type::getInt8PtrTy(mContext), false);
+            retval = Function::Create(ftype, Function::LinkageTypes::ExternalLinkage, "stp_cpu_supports", &mModule);
+        }
+        return retval;
+    }
+
+    void LLVMCodeGenerator::emitCounterRegistration(const string& name, const string& registerFunction,
+                                                    const string& filename, const vector<ProfileCounter>& counters) {
+        LLVMContext& context = mContext;
+
+        Function* init = Function::Create(FunctionType::get(Type::getVoidTy(context), false),
+                                          Function::LinkageTypes::InternalLinkage, name + "_init", &mModule);
+        IRBuilder<> builder(BasicBlock::Create(context, "entry", init));
+
+        // { i8* function, i32 line, i32 column, i32 kind, i64* counter }
+        StructType* siteType = StructType::get(context, vector<Type*>{
+                Type::getInt8PtrTy(context), builder.getInt32Ty(), builder.getInt32Ty(), builder.getInt32Ty(),
+                PointerType::getUnqual(builder.getInt64Ty())
+        });
+
+        vector<Constant*> sites;
+        for(const ProfileCounter& counter : counters) {
+            sites.push_back(ConstantStruct::get(siteType, vector<Constant*>{
+                    getStringConstant(counter.site.function),
+                    builder.getInt32(counter.site.line),
+                    builder.getInt32(counter.site.column),
+                    builder.getInt32(counter.kind),
+                    counter.counter
+            }));
+        }
+
+        ArrayType* tableType = ArrayType::get(siteType, sites.size());
+        GlobalVariable* table = new GlobalVariable(mModule, tableType, true, GlobalValue::LinkageTypes::InternalLinkage,
+                                                   ConstantArray::get(tableType, sites), name + "_sites");
+
+        Function* function = cast<Function>(mModule.getOrInsertFunction(registerFunction,
+                Type::getVoidTy(context), Type::getInt8PtrTy(context), Type::getInt8PtrTy(context), builder.getInt32Ty(), NULL));
+
+        builder.CreateCall(function, std::vector<Value*>{
+                getStringConstant(filename),
+                builder.CreatePointerCast(table, Type::getInt8PtrTy(context)),
+                builder.getInt32(sites.size())
+        });
+        builder.CreateRetVoid();
+
+        appendToGlobalCtors(mModule, init, 0);
+    }
+
+    void LLVMCodeGenerator::emitRefcountCounter(IRBuilder<>& builder, RefcountOp op, const string& function,
+                                                const YYLTYPE& location) {
+        if(mCompilerContext->refcountProfile.empty()) {
+            return;
+        }
+
+        GlobalVariable* counter = new GlobalVariable(mModule, builder.getInt64Ty(), false,
+                                                     GlobalValue::LinkageTypes::InternalLinkage, builder.getInt64(0),
+                                                     "__stp_rc_counter");
+        ProfileSite site{function, location.first_line, location.first_column};
+        mRefcountCounters.push_back(ProfileCounter{site, op, counter});
+
+        //objects are shared between threads, so the count is too
+        builder.CreateAtomicRMW(AtomicRMWInst::Add, counter, builder.getInt64(1), Monotonic);
+    }
+
+    /**
+     * the standard -O pipeline with the target's cost model, so inlining and vectorization decide like clang's would.
+     * Optimization remarks are reported while it runs.
+     */
+    void LLVMCodeGenerator::optimize(OptRemarks& remarks) {
+        remarks.install(mContext);
+        runOptimizationPasses(mModule, mTargetMachine, mCompilerContext->optLevel);
+        mContext.setDiagnosticHandler(nullptr);
+    }
+
+    void LLVMCodeGenerator::runOptimizationPasses(Module& module, TargetMachine* targetMachine, unsigned optLevel) {
+        PassManagerBuilder builder;
+        builder.OptLevel = optLevel;
+        builder.Inliner = createFunctionInliningPass(builder.OptLevel, 0);
+        builder.LoopVectorize = builder.OptLevel > 1;
+        builder.SLPVectorize = builder.OptLevel > 1;
+
+        FunctionPassManager functionPassManager(&module);
+        functionPassManager.add(new DataLayoutPass(&module));
+        targetMachine->addAnalysisPasses(functionPassManager);
+        builder.populateFunctionPassManager(functionPassManager);
+
+        PassManager modulePassManager;
+        modulePassManager.add(new DataLayoutPass(&module));
+        targetMachine->addAnalysisPasses(modulePassManager);
+        builder.populateModulePassManager(modulePassManager);
+
+        functionPassManager.doInitialization();
+        for(Function& function : module) {
+            functionPassManager.run(function);
+        }
+        functionPassManager.doFinalization();
+        modulePassManager.run(module);
+    }
+
+    void LLVMCodeGenerator::runInterproceduralPasses(Module& module, TargetMachine* targetMachine, unsigned optLevel) {
+        PassManager passManager;
+        passManager.add(new DataLayoutPass(&module));
+        targetMachine->addAnalysisPasses(passManager);
+
+        passManager.add(createGlobalOptimizerPass());
+        passManager.add(createIPSCCPPass());
+        //the inliner judges callees by their size, which mem2reg and a cfg cleanup bring close to the final one
+        passManager.add(createPromoteMemoryToRegisterPass());
+        passManager.add(createCFGSimplificationPass());
+        passManager.add(createFunctionInliningPass(optLevel, 0));
+        passManager.add(createFunctionAttrsPass());
+        passManager.add(createGlobalDCEPass());
+        passManager.run(module);
+    }
+
+    bool LLVMCodeGenerator::emitObject(const string& filename, string& error) {
+        return emitObjectFile(mModule, mTargetMachine, filename, error);
+    }
+
+    bool LLVMCodeGenerator::emitObjectFile(Module& module, TargetMachine* targetMachine, const string& filename,
+                                           string& error) {
+        string openError;
+        raw_fd_ostream output(filename.c_str(), openError, sys::fs::OpenFlags::F_None);
+        if(!openError.empty()) {
+            error = "cannot open " + filename + ": " + openError;
+            return false;
+        }
+
+        PassManager passManager;
+        passManager.add(new DataLayoutPass(&module));
+        targetMachine->addAnalysisPasses(passManager);
+
+        formatted_raw_ostream formattedOutput(output);
+        if(targetMachine->addPassesToEmitFile(passManager, formattedOutput, TargetMachine::CGFT_ObjectFile)) {
+            error = "the target cannot emit object files";
+            return false;
+        }
+        passManager.run(module);
+        return true;
+    }
+
     void LLVMCodeGenerator::generateCode(NCompileUnit *compileUnit) {
 
+        for(NClassDeclaration* classDeclaration : compileUnit->classes) {
+            mUnitClasses.insert(cast<StapleClass>(mCompilerContext->typeTable[classDeclaration]));
+        }
+
         LLVMCodeGenVisitor visitor(this);
         compileUnit->accept(&visitor);
 
+        //--profile-generate: the runtime appends the counts to the profile at exit
+        if(!mProfileCounters.empty()) {
+            emitCounterRegistration("__stp_prof", "stp_prof_register", mCompilerContext->profileGenerate, mProfileCounters);
+        }
+
+        //--refcount-profile: the runtime writes a table of the busiest refcount sites at exit
+        if(!mRefcountCounters.empty()) {
+            emitCounterRegistration("__stp_rc", "stp_rc_register", mCompilerContext->refcountProfile, mRefcountCounters);
+        }
+
+        //once per program, from the first file's module
+        if(!mCompilerContext->heapProfile.empty() && mPartition == 0
+           && mInputFilename == mCompilerContext->inputFilenames.front()) {
+            emitHeapProfileInit();
+        }
+
+        //target_clones versions already carry their own features
+        for(Function& function : mModule) {
+            if(function.isDeclaration()) {
+                continue;
+            }
+            if(!mCompilerContext->targetCPU.empty()) {
+                function.addFnAttr("target-cpu", mCompilerContext->targetCPU);
+            }
+            if(!mCompilerContext->targetFeatures.empty()
+               && !function.getAttributes().hasAttribute(AttributeSet::FunctionIndex, "target-features")) {
+                function.addFnAttr("target-features", mCompilerContext->targetFeatures);
+            }
+            //LLVM 3.5's spelling of frame-pointer=all
+            if(mCompilerContext->keepFramePointers) {
+                function.addFnAttr("no-frame-pointer-elim", "true");
+                function.addFnAttr("no-frame-pointer-elim-non-leaf");
+            }
+        }
+
         if(mCompilerContext->debugSymobols) {
             mDIBuider->finalize();
         }
@@ -851,6 +2104,80 @@ namespace staple {
 
     }
 
+    bool LLVMCodeGenerator::generateCode(NCompileUnit* compileUnit, unsigned numThreads, string& error) {
+        //one debug info compile unit describes the file, the partitions would each add their own
+        if(numThreads <= 1 || mCompilerContext->debugSymobols) {
+            generateCode(compileUnit);
+            return true;
+        }
+
+        //the threads share the AST and the semantic types, which must only be read from here on
+        mCompilerContext->typeTable.reserve(ASTNode::count());
+        for(NClassDeclaration* classDeclaration : compileUnit->classes) {
+            cast<StapleClass>(mCompilerContext->typeTable[classDeclaration])->getLayout();
+        }
+
+        mNumPartitions = numThreads;
+
+        //made on this thread, initTarget writes the resolved target back to the compiler context
+        vector<unique_ptr<LLVMContext>> contexts;
+        vector<unique_ptr<LLVMCodeGenerator>> partitions;
+        for(unsigned i = 1; i < numThreads; i++) {
+            contexts.emplace_back(new LLVMContext());
+            partitions.emplace_back(new LLVMCodeGenerator(mCompilerContext, *contexts.back(), mInputFilename, i,
+                                                          numThreads));
+        }
+
+        //modules cannot be linked across contexts, so each partition hands over its module as bitcode
+        vector<string> bitcode(partitions.size());
+        vector<thread> threads;
+        for(size_t i = 0; i < partitions.size(); i++) {
+            threads.emplace_back([&, i]() {
+                partitions[i]->generateCode(compileUnit);
+                {
+                    raw_string_ostream stream(bitcode[i]);
+                    WriteBitcodeToFile(partitions[i]->getModule(), stream);
+                }
+                partitions[i].reset();
+            });
+        }
+
+        generateCode(compileUnit);
+
+        for(thread& worker : threads) {
+            worker.join();
+        }
+
+        for(size_t i = 0; i < bitcode.size(); i++) {
+            unique_ptr<MemoryBuffer> buffer(MemoryBuffer::getMemBuffer(bitcode[i], mModule.getModuleIdentifier(), false));
+            ErrorOr<Module*> module = parseBitcodeFile(buffer.get(), mContext);
+            if(!module) {
+                error = "codegen partition " + to_string(i + 1) + ": " + module.getError().message();
+                return false;
+            }
+
+            string linkError;
+            unique_ptr<Module> partition(module.get());
+            if(Linker::LinkModules(&mModule, partition.get(), Linker::DestroySource, &linkError)) {
+                error = "codegen partition " + to_string(i + 1) + ": " + linkError;
+                return false;
+            }
+        }
+
+        //nothing outside the module refers to the class defs, as in a single threaded compile. The other files'
+        //modules do when there are several
+        if(mCompilerContext->inputFilenames.size() > 1) {
+            return true;
+        }
+        for(auto& entry : mStapleObjects) {
+            if(entry.first != CompilerContext::getStpObjClass()) {
+                entry.second->getClassDefinition(this)->setLinkage(GlobalValue::LinkageTypes::PrivateLinkage);
+            }
+        }
+
+        return true;
+    }
+
 
     /*
 
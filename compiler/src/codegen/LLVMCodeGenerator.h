@@ -3,13 +3,18 @@
 #ifndef STAPLE_LLVMCODEGENERATOR_H
 #define STAPLE_LLVMCODEGENERATOR_H
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
 #include <llvm/PassManager.h>
 #include <llvm/IR/DIBuilder.h>
+#include <llvm/Target/TargetMachine.h>
 #include "../node.h"
+#include "../profiledata.h"
 #include "../types/stapletype.h"
 
+#include <map>
 #include <string>
 
 namespace staple {
@@ -21,6 +26,8 @@ namespace staple {
     class NCompileUnit;
     class StapleType;
     class StapleClass;
+    class LLVMStapleObject;
+    class OptRemarks;
 
     class LLVMCodeGenerator {
     friend class LLVMCodeGenVisitor;
@@ -30,26 +37,147 @@ namespace staple {
     friend class LLVMDebugInfo;
     private:
         CompilerContext* mCompilerContext;
+        //the file the module is generated from
+        string mInputFilename;
+        //every type and value of the module lives in it, so generators with their own context can run in parallel
+        LLVMContext& mContext;
         IRBuilder<> mIRBuilder;
         DIBuilder* mDIBuider;
         Module mModule;
-        FunctionPassManager mFunctionPassManager;
+        TargetMachine* mTargetMachine;
+
+        //--codegen-threads: this generator defines the functions and methods numbered mPartition modulo
+        //mNumPartitions and declares the rest. Partition 0 also defines the class support functions and class defs
+        unsigned mPartition;
+        unsigned mNumPartitions;
+
+        //classes declared in the generated file. The modules of the other files define the rest
+        DenseSet<StapleClass*> mUnitClasses;
+
+        LLVMCodeGenerator(CompilerContext* compilerContext, LLVMContext& context, const string& inputFilename,
+                          unsigned partition, unsigned numPartitions);
+
+        //init and kill functions, class def and vtable of stapleClass
+        bool definesClassSupport(StapleClass* stapleClass) const {
+            return mPartition == 0 && mUnitClasses.count(stapleClass) > 0;
+        }
+        bool isPartitioned() const { return mNumPartitions > 1; }
+        bool definesFunction(unsigned index) const { return index % mNumPartitions == mPartition; }
+        //the class defs are linked against by other modules, by the other partitions or the other files'
+        bool exportsClassDefs() const;
+
+        //getLLVMType results, types are unique so this is keyed by identity
+        DenseMap<StapleType*, Type*> mLLVMTypes;
+        DenseMap<StapleClass*, LLVMStapleObject*> mStapleObjects;
+        StructType* mObjInstanceType;
+        StructType* mObjClassDefType;
+        StructType* mObjVtableType;
+
+        /**
+         * resolves "native" cpu and features and records the target triple and data layout in the module
+         */
+        void initTarget();
+        static unsigned getSimdWidth(const string& triple, const string& cpu, const string& features);
+
+        //kind is a ProfileSiteKind or RefcountOp
+        struct ProfileCounter {
+            ProfileSite site;
+            int kind;
+            GlobalVariable* counter;
+        };
+        vector<ProfileCounter> mProfileCounters;
+        vector<ProfileCounter> mRefcountCounters;
+
+        /**
+         * a constructor passes the counters as a table of { i8* function, i32 line, i32 column, i32 kind, i64* counter }
+         * to registerFunction(filename, table, count) in the runtime
+         */
+        void emitCounterRegistration(const string& name, const string& registerFunction, const string& filename,
+                                     const vector<ProfileCounter>& counters);
+        void emitHeapProfileInit();
+
+        map<string, Constant*> mStringConstants;
+        DenseMap<StapleMethodFunction*, Function*> mMethodFunctions;
 
     public:
-        LLVMCodeGenerator(CompilerContext* compilerContext);
+        LLVMCodeGenerator(CompilerContext* compilerContext, LLVMContext& context, const string& inputFilename);
+        ~LLVMCodeGenerator();
 
         void generateCode(NCompileUnit* compileUnit);
 
+        /**
+         * generates the functions and methods of compileUnit on numThreads threads, each with its own LLVMContext,
+         * and links their modules into this one in partition order, so the output does not depend on which thread
+         * finished first. Debug info is generated on one thread. False with error when a partition fails to link.
+         */
+        bool generateCode(NCompileUnit* compileUnit, unsigned numThreads, string& error);
+
+        /**
+         * runs the -O pipeline over the generated module, reporting remarks and other diagnostics to remarks
+         */
+        void optimize(OptRemarks& remarks);
+
+        //writes the module as a native object file for the target
+        bool emitObject(const string& filename, string& error);
+
+        /**
+         * machine for the target triple, cpu and features of compilerContext, after the first generator resolved
+         * "native" in them
+         */
+        static TargetMachine* createTargetMachine(CompilerContext* compilerContext);
+        //the standard -O pipeline, without remarks
+        static void runOptimizationPasses(Module& module, TargetMachine* targetMachine, unsigned optLevel);
+        //just the passes that look across functions, inlining first, for a module about to be split into parts
+        static void runInterproceduralPasses(Module& module, TargetMachine* targetMachine, unsigned optLevel);
+        static bool emitObjectFile(Module& module, TargetMachine* targetMachine, const string& filename, string& error);
+
         Module* getModule() {
             return &mModule;
         }
 
+        LLVMContext& getContext() {
+            return mContext;
+        }
+
         Type* getLLVMType(StapleType* stapleType);
-        Function* getMallocFunction();
+        //runtime allocator, the heap profiler hooks in there
+        Function* getAllocFunction();
         Function* getFreeFunction();
 
+        Constant* getStringConstant(const string& str);
+
+        /**
+         * per allocation site record passed to stp_alloc, the heap profiler keeps its statistics in it
+         */
+        Constant* createAllocSite(const string& typeName, const string& function, const YYLTYPE& location);
+        Function* getCpuSupportsFunction();
+        //stp_trace_enter or stp_trace_exit, both take the function's name
+        Function* getTraceFunction(const string& name);
+
+        enum RefcountOp {
+            RC_StoreStrong = 0,
+            RC_ScopeRelease = 1,
+            RC_TempRelease = 2
+        };
+
+        /**
+         * --refcount-profile: counts the refcount call about to be emitted at builder's insert point
+         */
+        void emitRefcountCounter(IRBuilder<>& builder, RefcountOp op, const string& function, const YYLTYPE& location);
+
+        //module features plus the comma separated features of a target_clones version
+        string getTargetFeatures(const string& cloneFeatures);
+        //simd width of a target_clones version
+        unsigned getCloneSimdWidth(const string& cloneFeatures);
+
         string createNamespaceSymbolName(const string &name);
+        //symbol of a free function, and of extern prototypes declaring it: the package name, main keeps its own
+        string createFunctionSymbolName(Symbol name);
         static string createClassSymbolName(const StapleClass* stapleClass);
+        //Class_method
+        static string createMethodSymbolName(const StapleClass* stapleClass, Symbol method);
+        //the method's function, declared on first use
+        Function* getMethodFunction(StapleMethodFunction* method);
 
     };
 
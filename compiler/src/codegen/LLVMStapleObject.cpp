@@ -8,40 +8,37 @@ namespace staple {
 
     using namespace llvm;
 
-    StructType* STPOBJ_INSTANCE_TYPE = StructType::create(getGlobalContext(), "obj");
-    StructType* STPOBJ_CLASSDEF_TYPE = StructType::create(getGlobalContext(), "obj_class");
-    StructType* STPOBJ_VTABLE_TYPE = StructType::create(getGlobalContext(), "obj_vtable");
-
-    GlobalVariable* STPOBJ_CLASS_VALUE = nullptr;
-
-
-    StructType* LLVMStapleObject::getStpObjVtableType() {
-        if(STPOBJ_VTABLE_TYPE->isEmptyTy()) {
-            STPOBJ_VTABLE_TYPE->setBody(
-              PointerType::getUnqual(LLVMStapleObject::getKillFunctionType()),
+    StructType* LLVMStapleObject::getStpObjVtableType(LLVMCodeGenerator* codeGenerator) {
+        StructType*& retval = codeGenerator->mObjVtableType;
+        if(retval == nullptr) {
+            retval = StructType::create(codeGenerator->mContext, "obj_vtable");
+            retval->setBody(
+              PointerType::getUnqual(LLVMStapleObject::getKillFunctionType(codeGenerator)),
               NULL
             );
         }
-        return STPOBJ_VTABLE_TYPE;
+        return retval;
     }
 
 
-    StructType* LLVMStapleObject::getStpClassDefType() {
-        if(STPOBJ_CLASSDEF_TYPE->isEmptyTy()) {
-            STPOBJ_CLASSDEF_TYPE->setBody(
-                    Type::getInt8PtrTy(getGlobalContext()), // FQ class name
-                    PointerType::getUnqual(STPOBJ_CLASSDEF_TYPE), // parent class
-                    LLVMStapleObject::getStpObjVtableType(), // vtable
+    StructType* LLVMStapleObject::getStpClassDefType(LLVMCodeGenerator* codeGenerator) {
+        StructType*& retval = codeGenerator->mObjClassDefType;
+        if(retval == nullptr) {
+            retval = StructType::create(codeGenerator->mContext, "obj_class");
+            retval->setBody(
+                    Type::getInt8PtrTy(codeGenerator->mContext), // FQ class name
+                    PointerType::getUnqual(retval), // parent class
+                    LLVMStapleObject::getStpObjVtableType(codeGenerator), // vtable
                     NULL
             );
         }
-        return STPOBJ_CLASSDEF_TYPE;
+        return retval;
     }
 
-    FunctionType* LLVMStapleObject::getKillFunctionType() {
-        vector<Type*> args {PointerType::getUnqual(STPOBJ_INSTANCE_TYPE)};
+    FunctionType* LLVMStapleObject::getKillFunctionType(LLVMCodeGenerator* codeGenerator) {
+        vector<Type*> args {PointerType::getUnqual(getStpObjInstanceType(codeGenerator))};
         FunctionType* retval = FunctionType::get(
-                Type::getVoidTy(getGlobalContext()),
+                Type::getVoidTy(codeGenerator->mContext),
                 args,
                 false
         );
@@ -49,13 +46,14 @@ namespace staple {
         return retval;
     }
 
-    Function* LLVMStapleObject::getStoreStrongFunction(Module *module) {
+    Function* LLVMStapleObject::getStoreStrongFunction(LLVMCodeGenerator* codeGenerator) {
+        Module* module = &codeGenerator->mModule;
         Function* retval = module->getFunction("stp_storeStrong");
         if(retval == NULL) {
-            FunctionType *ftype = FunctionType::get(Type::getVoidTy(getGlobalContext()),
+            FunctionType *ftype = FunctionType::get(Type::getVoidTy(codeGenerator->mContext),
                                                     std::vector<Type*>{
-                                                            PointerType::getUnqual(PointerType::getUnqual(getStpObjInstanceType())),
-                                                            PointerType::getUnqual(getStpObjInstanceType())
+                                                            PointerType::getUnqual(PointerType::getUnqual(getStpObjInstanceType(codeGenerator))),
+                                                            PointerType::getUnqual(getStpObjInstanceType(codeGenerator))
                                                     },
                                                     false);
             retval = Function::Create(ftype, GlobalValue::ExternalLinkage, "stp_storeStrong", module);
@@ -64,12 +62,13 @@ namespace staple {
         return retval;
     }
 
-    Function* LLVMStapleObject::getReleaseFunction(Module *module) {
+    Function* LLVMStapleObject::getReleaseFunction(LLVMCodeGenerator* codeGenerator) {
+        Module* module = &codeGenerator->mModule;
         Function* retval = module->getFunction("stp_release");
         if(retval == NULL) {
             FunctionType* fType = FunctionType::get(
-                    Type::getVoidTy(getGlobalContext()),
-                    vector<Type*>{PointerType::getUnqual(getStpObjInstanceType())}, false);
+                    Type::getVoidTy(codeGenerator->mContext),
+                    vector<Type*>{PointerType::getUnqual(getStpObjInstanceType(codeGenerator))}, false);
             retval = Function::Create(fType, GlobalValue::ExternalLinkage, "stp_release", module);
 
         }
@@ -77,15 +76,18 @@ namespace staple {
     }
 
 
-    StructType* LLVMStapleObject::getStpObjInstanceType() {
-        if(STPOBJ_INSTANCE_TYPE->isEmptyTy()){
-            STPOBJ_INSTANCE_TYPE->setBody(
-                    PointerType::getUnqual(LLVMStapleObject::getStpClassDefType()), // runtime class ptr
-                    Type::getInt32Ty(getGlobalContext()), //refCount
+    StructType* LLVMStapleObject::getStpObjInstanceType(LLVMCodeGenerator* codeGenerator) {
+        //created before its body, the class def type points back at it through the kill function
+        StructType*& retval = codeGenerator->mObjInstanceType;
+        if(retval == nullptr) {
+            retval = StructType::create(codeGenerator->mContext, "obj");
+            retval->setBody(
+                    PointerType::getUnqual(LLVMStapleObject::getStpClassDefType(codeGenerator)), // runtime class ptr
+                    Type::getInt32Ty(codeGenerator->mContext), //refCount
                     NULL
             );
         }
-        return STPOBJ_INSTANCE_TYPE;
+        return retval;
     }
 
     class LLVMBaseObject : public LLVMStapleObject {
@@ -98,8 +100,8 @@ namespace staple {
         Function* getInitFunction(LLVMCodeGenerator *codeGenerator) {
             if(mInitFunction == nullptr) {
                 FunctionType *functionType = FunctionType::get(
-                        Type::getVoidTy(getGlobalContext()),
-                        vector<Type *>{PointerType::getUnqual(STPOBJ_INSTANCE_TYPE)},
+                        Type::getVoidTy(codeGenerator->mContext),
+                        vector<Type *>{PointerType::getUnqual(getStpObjInstanceType(codeGenerator))},
                         false
                 );
 
@@ -115,7 +117,7 @@ namespace staple {
 
         Function* getKillFunction(LLVMCodeGenerator* codeGenerator) {
             if(mKillFunction == nullptr) {
-                FunctionType* functionType = getKillFunctionType();
+                FunctionType* functionType = getKillFunctionType(codeGenerator);
 
                 mKillFunction = Function::Create(functionType,
                                                 Function::LinkageTypes::ExternalLinkage,
@@ -126,24 +128,24 @@ namespace staple {
         }
 
         llvm::StructType* getClassDefType(LLVMCodeGenerator* codeGenerator) {
-            return getStpClassDefType();
+            return getStpClassDefType(codeGenerator);
         }
 
 
         llvm::StructType* getObjectType(LLVMCodeGenerator* codeGenerator) {
-            return getStpObjInstanceType();
+            return getStpObjInstanceType(codeGenerator);
         }
 
 
         llvm::StructType* getVtableType(LLVMCodeGenerator* codeGenerator) {
-            return getStpObjVtableType();
+            return getStpObjVtableType(codeGenerator);
         }
 
         llvm::GlobalVariable* getClassDefinition(LLVMCodeGenerator* codeGenerator) {
-            if(STPOBJ_CLASS_VALUE == nullptr) {
-                STPOBJ_CLASS_VALUE = new GlobalVariable(codeGenerator->mModule, getStpClassDefType(), true, GlobalValue::LinkageTypes::ExternalLinkage, nullptr, "obj_class_def");
+            if(mClassDefValue == nullptr) {
+                mClassDefValue = new GlobalVariable(codeGenerator->mModule, getStpClassDefType(codeGenerator), true, GlobalValue::LinkageTypes::ExternalLinkage, nullptr, "obj_class_def");
             }
-            return STPOBJ_CLASS_VALUE;
+            return mClassDefValue;
         }
 
         /*
@@ -161,56 +163,59 @@ namespace staple {
          */
     };
 
-    map<StapleClass*, LLVMStapleObject*> createCache() {
-        map<StapleClass*, LLVMStapleObject*> retval;
-        retval[CompilerContext::getStpObjClass()] = new LLVMBaseObject();
-        return retval;
-    }
-
-    map<StapleClass*, LLVMStapleObject*> LLVMStapleObject::Cache = createCache();
-
     LLVMStapleObject::LLVMStapleObject(StapleClass *classType)
-    : mClassType(classType), mClassDefType(nullptr), mVtableType(nullptr), mObjectStruct(nullptr),
+    : mClassType(classType), mClassDefType(nullptr), mClassNameValue(nullptr), mClassDefValue(nullptr),
+      mClassVTableValue(nullptr), mVtableType(nullptr), mObjectStruct(nullptr),
       mFieldsStruct(nullptr), mInitFunction(nullptr), mKillFunction(nullptr)
     {
 
     }
 
-    LLVMStapleObject* LLVMStapleObject::get(StapleClass* classType) {
-
-        LLVMStapleObject* retval = nullptr;
-        auto it = Cache.find(classType);
-        if(it == Cache.end()) {
-            retval = new LLVMStapleObject(classType);
-            Cache[classType] = retval;
-        } else {
-            retval = it->second;
+    LLVMStapleObject* LLVMStapleObject::get(LLVMCodeGenerator* codeGenerator, StapleClass* classType) {
+        LLVMStapleObject*& retval = codeGenerator->mStapleObjects[classType];
+        if(retval == nullptr) {
+            if(classType == CompilerContext::getStpObjClass()) {
+                retval = new LLVMBaseObject();
+            } else {
+                retval = new LLVMStapleObject(classType);
+            }
         }
 
         return retval;
     }
 
-    Value* LLVMStapleObject::getFieldPtr(const string& name, llvm::IRBuilder<> &irBuilder, llvm::Value *thisPtr) {
-        uint fieldIndex = 1; // start at index 1 to account for the ref counter
-        mClassType->getField(name, fieldIndex);
-        return irBuilder.CreateConstGEP2_32(thisPtr, 0, fieldIndex);
+    Value* LLVMStapleObject::getFieldPtr(uint fieldIndex, llvm::IRBuilder<> &irBuilder, llvm::Value *thisPtr) {
+        // +1 to account for the ref counter
+        return irBuilder.CreateConstGEP2_32(thisPtr, 0, fieldIndex + 1);
+
+    }
 
+    Value* LLVMStapleObject::getSoaFieldPtr(uint fieldIndex, llvm::IRBuilder<> &irBuilder, llvm::Value *arrayPtr, llvm::Value* index) {
+        // the runtime 'class' field has no column
+        return irBuilder.CreateInBoundsGEP(arrayPtr, vector<Value*>{
+                irBuilder.getInt32(0),
+                irBuilder.getInt32(fieldIndex - 1),
+                index
+        });
     }
 
     Function* LLVMStapleObject::getKillFunction(LLVMCodeGenerator *codeGenerator) {
         if(mKillFunction == nullptr) {
-            FunctionType* functionType = getKillFunctionType();
+            FunctionType* functionType = getKillFunctionType(codeGenerator);
 
             string functionName = codeGenerator->createClassSymbolName(mClassType) + "_kill";
             mKillFunction = Function::Create(functionType, Function::LinkageTypes::ExternalLinkage, functionName, &codeGenerator->mModule);
+            if(!codeGenerator->definesClassSupport(mClassType)) {
+                return mKillFunction;
+            }
 
-            BasicBlock* bblock = BasicBlock::Create(getGlobalContext(), "entry", mKillFunction);
+            BasicBlock* bblock = BasicBlock::Create(codeGenerator->mContext, "entry", mKillFunction);
             IRBuilder<> irBuilder(bblock);
 
             Value* thisPtr = mKillFunction->arg_begin();
 
             if(mClassType->getParent() != nullptr) {
-                LLVMStapleObject* parentStapleObj = LLVMStapleObject::get(mClassType->getParent());
+                LLVMStapleObject* parentStapleObj = LLVMStapleObject::get(codeGenerator, mClassType->getParent());
 
                 Type* destType = PointerType::getUnqual(parentStapleObj->getObjectType(codeGenerator));
                 Value* superPtr = irBuilder.CreatePointerCast(thisPtr, destType);
@@ -232,15 +237,18 @@ namespace staple {
     Function *LLVMStapleObject::getInitFunction(LLVMCodeGenerator *codeGenerator) {
         if(mInitFunction == nullptr) {
             FunctionType* functionType = FunctionType::get(
-                    Type::getVoidTy(getGlobalContext()),
+                    Type::getVoidTy(codeGenerator->mContext),
                     vector<Type*>{PointerType::getUnqual(getObjectType(codeGenerator))},
                     false
             );
 
             string functionName = codeGenerator->createClassSymbolName(mClassType) + "_init";
             mInitFunction = Function::Create(functionType, Function::LinkageTypes::ExternalLinkage, functionName, &codeGenerator->mModule);
+            if(!codeGenerator->definesClassSupport(mClassType)) {
+                return mInitFunction;
+            }
 
-            BasicBlock *bblock = BasicBlock::Create(getGlobalContext(), "entry", mInitFunction);
+            BasicBlock *bblock = BasicBlock::Create(codeGenerator->mContext, "entry", mInitFunction);
             IRBuilder<> irBuilder(bblock);
 
             Value* thisPtr = mInitFunction->arg_begin();
@@ -250,7 +258,7 @@ namespace staple {
 
 
             if(mClassType->getParent() != nullptr) {
-                LLVMStapleObject* parentStapleObj = LLVMStapleObject::get(mClassType->getParent());
+                LLVMStapleObject* parentStapleObj = LLVMStapleObject::get(codeGenerator, mClassType->getParent());
 
                 Type* destType = PointerType::getUnqual(parentStapleObj->getObjectType(codeGenerator));
                 Value* superPtr = irBuilder.CreatePointerCast(thisPtr, destType);
@@ -258,14 +266,16 @@ namespace staple {
                 irBuilder.CreateCall(parentStapleObj->getInitFunction(codeGenerator), superPtr);
             }
 
-            for(StapleField* field : mClassType->getFields()) {
-                StapleType* fieldType = field->getElementType();
+            //the class's own fields are the last slots of its layout
+            const StapleClassLayout& layout = mClassType->getLayout();
+            for(uint i = layout.fields.size() - mClassType->getFields().size(); i < layout.fields.size(); i++) {
+                StapleType* fieldType = layout.fields[i]->getElementType();
                 if(StapleInt* intType = dyn_cast<StapleInt>(fieldType)) {
                     irBuilder.CreateStore(irBuilder.getInt(APInt(intType->getWidth(), 0)),
-                                          getFieldPtr(field->getName(), irBuilder, thisPtr));
+                                          getFieldPtr(i, irBuilder, thisPtr));
                 } else if(StaplePointer* ptrType = dyn_cast<StaplePointer>(fieldType)) {
                     irBuilder.CreateStore(ConstantPointerNull::get(PointerType::getUnqual(codeGenerator->getLLVMType(ptrType->getElementType()))),
-                                          getFieldPtr(field->getName(), irBuilder, thisPtr));
+                                          getFieldPtr(i, irBuilder, thisPtr));
 
                 }
             }
@@ -278,7 +288,7 @@ namespace staple {
 
     GlobalVariable* LLVMStapleObject::getClassNameValue(LLVMCodeGenerator *codeGenerator) {
         if(mClassNameValue == nullptr) {
-            Constant* classNameValue = ConstantDataArray::getString(getGlobalContext(), mClassType->getClassName().c_str());
+            Constant* classNameValue = ConstantDataArray::getString(codeGenerator->mContext, mClassType->getClassName().c_str());
             mClassNameValue = new GlobalVariable(codeGenerator->mModule, classNameValue->getType(), true, GlobalValue::LinkageTypes::PrivateLinkage, classNameValue);
         }
         return mClassNameValue;
@@ -286,52 +296,52 @@ namespace staple {
 
     GlobalVariable* LLVMStapleObject::getClassDefinition(LLVMCodeGenerator *codeGenerator) {
         if(mClassDefValue == nullptr) {
+            string classDefName = codeGenerator->createClassSymbolName(mClassType) + "_class_def";
+            if(!codeGenerator->definesClassSupport(mClassType)) {
+                mClassDefValue = new GlobalVariable(codeGenerator->mModule, getClassDefType(codeGenerator), true,
+                                                    GlobalValue::LinkageTypes::ExternalLinkage, nullptr, classDefName);
+                return mClassDefValue;
+            }
 
             Value* parentPtr;
             if(mClassType->getParent() == nullptr) {
-                parentPtr = ConstantPointerNull::get(PointerType::getUnqual(getStpClassDefType()));
+                parentPtr = ConstantPointerNull::get(PointerType::getUnqual(getStpClassDefType(codeGenerator)));
             } else {
-                LLVMStapleObject* parent = LLVMStapleObject::get(mClassType->getParent());
+                LLVMStapleObject* parent = LLVMStapleObject::get(codeGenerator, mClassType->getParent());
                 parentPtr = parent->getClassDefinition(codeGenerator);
             }
 
             Constant* classDef = ConstantStruct::get(getClassDefType(codeGenerator),
-                                  ConstantExpr::getPointerCast(getClassNameValue(codeGenerator), Type::getInt8PtrTy(getGlobalContext())),
+                                  ConstantExpr::getPointerCast(getClassNameValue(codeGenerator), Type::getInt8PtrTy(codeGenerator->mContext)),
                                   parentPtr,
                                   getClassVTableValue(codeGenerator),
                                   NULL);
 
-            mClassDefValue = new GlobalVariable(codeGenerator->mModule, classDef->getType(), true, GlobalValue::LinkageTypes::PrivateLinkage, classDef);
+            //the other partitions and files link against it by name, partitions make it private again once linked
+            GlobalValue::LinkageTypes linkage = codeGenerator->exportsClassDefs() ? GlobalValue::LinkageTypes::ExternalLinkage
+                                                                                  : GlobalValue::LinkageTypes::PrivateLinkage;
+            mClassDefValue = new GlobalVariable(codeGenerator->mModule, classDef->getType(), true, linkage, classDef, classDefName);
 
         }
         return mClassDefValue;
     }
 
-    void unrollVtableValues(StapleClass* stapleClass, vector<Constant*>& elements, LLVMCodeGenerator *codeGenerator) {
-
-        if(stapleClass->getParent() != nullptr) {
-            unrollVtableValues(stapleClass->getParent(), elements, codeGenerator);
-        }
-
-        for(StapleMethodFunction* methodFunction : stapleClass->getMethods()) {
-            if(methodFunction->getType() == StapleMethodFunction::Type::Virtual && methodFunction->getName().compare("kill") != 0) {
-                string methodName =
-                        codeGenerator->createClassSymbolName(stapleClass) + "_" + methodFunction->getName();
-                FunctionType* functionType = cast<FunctionType>(codeGenerator->getLLVMType(methodFunction));
-
-                elements.push_back(codeGenerator->getModule()->getOrInsertFunction(methodName.c_str(), functionType));
-            }
-        }
-    }
-
     Constant* LLVMStapleObject::getClassVTableValue(LLVMCodeGenerator *codeGenerator) {
         if(mClassVTableValue == nullptr) {
 
+            //entry i is the layout's vtable slot i
+            const StapleClassLayout& layout = mClassType->getLayout();
+            StructType* vtableType = getVtableType(codeGenerator);
             vector<Constant*> methods;
-            methods.push_back(getKillFunction(codeGenerator));
-            unrollVtableValues(mClassType, methods, codeGenerator);
-            Constant* classVTable = ConstantStruct::get(getVtableType(codeGenerator),
-                                                        methods);
+            for(uint i = 0; i < layout.vtable.size(); i++) {
+                StapleMethodFunction* methodFunction = layout.vtable[i];
+                Constant* function = methodFunction->getName() == SYM_KILL
+                                     ? getKillFunction(codeGenerator)
+                                     : codeGenerator->getMethodFunction(methodFunction);
+                //an override takes this as its own class, the slot keeps the type of the method it overrides
+                methods.push_back(ConstantExpr::getPointerCast(function, vtableType->getElementType(i)));
+            }
+            Constant* classVTable = ConstantStruct::get(vtableType, methods);
 
             mClassVTableValue = classVTable;
         }
@@ -342,13 +352,13 @@ namespace staple {
         if(mClassDefType == nullptr) {
 
             string classDefName = codeGenerator->createClassSymbolName(mClassType) + "_class";
-            mClassDefType = StructType::create(getGlobalContext(), classDefName.c_str());
+            mClassDefType = StructType::create(codeGenerator->mContext, classDefName.c_str());
 
             mClassDefType->setBody(
-                    Type::getInt8PtrTy(getGlobalContext()), // FQ class name
+                    Type::getInt8PtrTy(codeGenerator->mContext), // FQ class name
                     mClassType->getParent() != nullptr
-                      ? PointerType::getUnqual(LLVMStapleObject::get(mClassType->getParent())->getClassDefType(codeGenerator))
-                      : PointerType::getUnqual(STPOBJ_CLASSDEF_TYPE), // parent class ptr
+                      ? PointerType::getUnqual(LLVMStapleObject::get(codeGenerator, mClassType->getParent())->getClassDefType(codeGenerator))
+                      : PointerType::getUnqual(getStpClassDefType(codeGenerator)), // parent class ptr
                     getVtableType(codeGenerator),
                     NULL);
 
@@ -356,28 +366,24 @@ namespace staple {
         return mClassDefType;
     }
 
-    void unrollVtable(StapleClass* stapleClass, vector<Type*>& elements, LLVMCodeGenerator *codeGenerator) {
-
-        if(stapleClass->getParent() != nullptr) {
-            unrollVtable(stapleClass->getParent(), elements, codeGenerator);
-        }
-
-        for(StapleMethodFunction* methodFunction : stapleClass->getMethods()) {
-            if(methodFunction->getType() == StapleMethodFunction::Type::Virtual) {
-                elements.push_back(PointerType::getUnqual(codeGenerator->getLLVMType(methodFunction)));
-            }
-        }
-    }
-
     StructType* LLVMStapleObject::getVtableType(LLVMCodeGenerator *codeGenerator) {
         if(mVtableType == nullptr) {
 
             string vtableName = codeGenerator->createClassSymbolName(mClassType) + "_vtable";
 
-            mVtableType = StructType::create(getGlobalContext(), vtableName.c_str());
+            mVtableType = StructType::create(codeGenerator->mContext, vtableName.c_str());
 
+            //the parent's vtable is a prefix, so a classdef can be used through any ancestor's type
             vector<Type*> vtable;
-            unrollVtable(mClassType, vtable, codeGenerator);
+            if(mClassType->getParent() != nullptr) {
+                StructType* parentVtable = LLVMStapleObject::get(codeGenerator, mClassType->getParent())->getVtableType(codeGenerator);
+                vtable.assign(parentVtable->element_begin(), parentVtable->element_end());
+            }
+
+            const StapleClassLayout& layout = mClassType->getLayout();
+            for(uint i = vtable.size(); i < layout.vtable.size(); i++) {
+                vtable.push_back(PointerType::getUnqual(codeGenerator->getLLVMType(layout.vtable[i])));
+            }
 
             mVtableType->setBody(vtable);
         }
@@ -386,26 +392,33 @@ namespace staple {
     }
 
     void unrollFields(StapleClass* stapleClass, vector<Type*>& elements, LLVMCodeGenerator *codeGenerator) {
-
-        if(stapleClass->getParent() != nullptr) {
-            unrollFields(stapleClass->getParent(), elements, codeGenerator);
-        }
-
-        for(StapleField* fieldType : stapleClass->getFields()) {
-            if(fieldType->getName().compare("class") != 0) {
+        for(StapleField* fieldType : stapleClass->getLayout().fields) {
+            if(fieldType->getName() != SYM_CLASS) {
                 elements.push_back(codeGenerator->getLLVMType(fieldType));
             }
         }
     }
 
+    llvm::StructType* LLVMStapleObject::getSoaType(LLVMCodeGenerator *codeGenerator, uint64_t size) {
+        vector<Type*> fields;
+        unrollFields(mClassType, fields, codeGenerator);
+
+        vector<Type*> columns;
+        for(Type* fieldType : fields) {
+            columns.push_back(ArrayType::get(fieldType, size));
+        }
+
+        return StructType::get(codeGenerator->mContext, columns);
+    }
+
     llvm::StructType* LLVMStapleObject::getObjectType(LLVMCodeGenerator *codeGenerator) {
         if(mObjectStruct == nullptr) {
-            mObjectStruct = StructType::create(getGlobalContext(),
+            mObjectStruct = StructType::create(codeGenerator->mContext,
                                                codeGenerator->createClassSymbolName(mClassType));
 
             vector<Type*> elements;
             elements.push_back(PointerType::getUnqual(getClassDefType(codeGenerator))); // class def pointer
-            elements.push_back(Type::getInt32Ty(getGlobalContext())); // refCounter
+            elements.push_back(Type::getInt32Ty(codeGenerator->mContext)); // refCounter
 
             unrollFields(mClassType, elements, codeGenerator);
 
@@ -20,7 +20,6 @@ namespace staple {
     class LLVMStapleObject {
 
     private:
-        static map<StapleClass*, LLVMStapleObject*> Cache;
         map<StapleMethodFunction*, llvm::Function*> mMethodMap;
 
     protected:
@@ -38,19 +37,34 @@ namespace staple {
         LLVMStapleObject(StapleClass* classType);
 
     public:
-
-        static llvm::StructType* getStpObjInstanceType();
-        static llvm::StructType* getStpClassDefType();
-        static llvm::StructType* getStpObjVtableType();
-        static llvm::FunctionType* getKillFunctionType();
-        static llvm::GlobalVariable* getStpClassValue();
-
-        static llvm::Function* getReleaseFunction(Module* module);
-        static llvm::Function* getStoreStrongFunction(Module* module);
-
-        static LLVMStapleObject* get(StapleClass* classType);
-
-        llvm::Value* getFieldPtr(const string& name, llvm::IRBuilder<>& irBuilder, llvm::Value* thisPtr);
+        virtual ~LLVMStapleObject() {}
+
+        //the runtime's obj types, created in the generator's LLVMContext
+        static llvm::StructType* getStpObjInstanceType(LLVMCodeGenerator* codeGenerator);
+        static llvm::StructType* getStpClassDefType(LLVMCodeGenerator* codeGenerator);
+        static llvm::StructType* getStpObjVtableType(LLVMCodeGenerator* codeGenerator);
+        static llvm::FunctionType* getKillFunctionType(LLVMCodeGenerator* codeGenerator);
+
+        static llvm::Function* getReleaseFunction(LLVMCodeGenerator* codeGenerator);
+        static llvm::Function* getStoreStrongFunction(LLVMCodeGenerator* codeGenerator);
+
+        /**
+         * helper for classType, one per class and generator since its llvm types and values belong to the
+         * generator's context
+         */
+        static LLVMStapleObject* get(LLVMCodeGenerator* codeGenerator, StapleClass* classType);
+
+        /**
+         * address of the field in slot fieldIndex of the class layout
+         */
+        llvm::Value* getFieldPtr(uint fieldIndex, llvm::IRBuilder<>& irBuilder, llvm::Value* thisPtr);
+
+        /**
+         * struct-of-arrays storage for size elements of this class: one array per field.
+         * The object header (class def and ref count) is not stored.
+         */
+        llvm::StructType* getSoaType(LLVMCodeGenerator* codeGenerator, uint64_t size);
+        llvm::Value* getSoaFieldPtr(uint fieldIndex, llvm::IRBuilder<>& irBuilder, llvm::Value* arrayPtr, llvm::Value* index);
 
         virtual llvm::GlobalVariable* getClassDefinition(LLVMCodeGenerator* codeGenerator);
         llvm::GlobalVariable* getClassNameValue(LLVMCodeGenerator* codeGenerator);
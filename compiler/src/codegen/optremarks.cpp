@@ -0,0 +1,149 @@
+#include "optremarks.h"
+#include "../compilercontext.h"
+
+#include <llvm/IR/DebugLoc.h>
+#include <llvm/IR/DiagnosticPrinter.h>
+#include <llvm/IR/Function.h>
+#include <llvm/Support/FileSystem.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace staple {
+
+    static bool compilePattern(const string& pattern, unique_ptr<Regex>& regex, string& error) {
+        if(pattern.empty()) {
+            return true;
+        }
+        regex.reset(new Regex(pattern));
+        string regexError;
+        if(!regex->isValid(regexError)) {
+            error = "invalid remark pattern '" + pattern + "': " + regexError;
+            return false;
+        }
+        return true;
+    }
+
+    //single quoted YAML scalar
+    static string yamlQuote(const string& str) {
+        string retval = "'";
+        for(char c : str) {
+            retval += c;
+            if(c == '\'') {
+                retval += '\'';
+            }
+        }
+        return retval + "'";
+    }
+
+    OptRemarks::OptRemarks(CompilerContext* compilerContext)
+    : mCompilerContext(compilerContext) {}
+
+    bool OptRemarks::init(string& error) {
+        if(!compilePattern(mCompilerContext->remarksPassed, mPassed, error)
+           || !compilePattern(mCompilerContext->remarksMissed, mMissed, error)
+           || !compilePattern(mCompilerContext->remarksAnalysis, mAnalysis, error)) {
+            return false;
+        }
+
+        if(!mCompilerContext->remarksYaml.empty()) {
+            string errorInfo;
+            mYaml.reset(new raw_fd_ostream(mCompilerContext->remarksYaml.c_str(), errorInfo, sys::fs::OpenFlags::F_Text));
+            if(!errorInfo.empty()) {
+                error = "cannot write remarks: " + errorInfo;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void OptRemarks::install(LLVMContext& context) {
+        context.setDiagnosticHandler(handleDiagnostic, this);
+    }
+
+    void OptRemarks::handleDiagnostic(const DiagnosticInfo& info, void* context) {
+        OptRemarks* remarks = static_cast<OptRemarks*>(context);
+
+        switch(info.getKind()) {
+            case DK_OptimizationRemark: {
+                const DiagnosticInfoOptimizationRemarkBase& remark = static_cast<const DiagnosticInfoOptimizationRemarkBase&>(info);
+                if(remarks->mPassed && remarks->mPassed->match(remark.getPassName())) {
+                    remarks->emitRemark(remark, "Passed", "-Rpass");
+                }
+                return;
+            }
+
+            case DK_OptimizationRemarkMissed: {
+                const DiagnosticInfoOptimizationRemarkBase& remark = static_cast<const DiagnosticInfoOptimizationRemarkBase&>(info);
+                if(remarks->mMissed && remarks->mMissed->match(remark.getPassName())) {
+                    remarks->emitRemark(remark, "Missed", "-Rpass-missed");
+                }
+                return;
+            }
+
+            case DK_OptimizationRemarkAnalysis: {
+                const DiagnosticInfoOptimizationRemarkBase& remark = static_cast<const DiagnosticInfoOptimizationRemarkBase&>(info);
+                if(remarks->mAnalysis && remarks->mAnalysis->match(remark.getPassName())) {
+                    remarks->emitRemark(remark, "Analysis", "-Rpass-analysis");
+                }
+                return;
+            }
+
+            default:
+                break;
+        }
+
+        const char* severity = "";
+        switch(info.getSeverity()) {
+            case DS_Error: severity = "error: "; break;
+            case DS_Warning: severity = "warning: "; break;
+            case DS_Remark: severity = "remark: "; break;
+            case DS_Note: severity = "note: "; break;
+        }
+
+        lock_guard<mutex> guard(remarks->mLock);
+        raw_ostream& out = errs();
+        DiagnosticPrinterRawOStream printer(out);
+        out << severity;
+        info.print(printer);
+        out << "\n";
+
+        if(info.getSeverity() == DS_Error) {
+            exit(1);
+        }
+    }
+
+    void OptRemarks::emitRemark(const DiagnosticInfoOptimizationRemarkBase& remark, const char* kind, const char* option) {
+        const string filename = remark.getFunction().getParent()->getModuleIdentifier();
+        const string function = remark.getFunction().getName();
+        const string message = remark.getMsg().str();
+
+        //every function has a location from the code generator, remarks about whole functions may not
+        const DebugLoc& location = remark.getDebugLoc();
+        unsigned line = location.isUnknown() ? 0 : location.getLine();
+        unsigned column = location.isUnknown() ? 0 : location.getCol();
+
+        lock_guard<mutex> guard(mLock);
+        raw_ostream& out = errs();
+        if(line > 0) {
+            out << filename << ":" << line << ":" << column << ": ";
+        } else {
+            out << filename << ": in " << function << ": ";
+        }
+        out << "remark: " << message << " [" << option << "=" << remark.getPassName() << "]\n";
+
+        if(mYaml) {
+            *mYaml << "--- !" << kind << "\n"
+                   << "Pass:            " << yamlQuote(remark.getPassName()) << "\n";
+            if(line > 0) {
+                *mYaml << "DebugLoc:        { File: " << yamlQuote(filename) << ", Line: " << line
+                       << ", Column: " << column << " }\n";
+            }
+            *mYaml << "Function:        " << yamlQuote(function) << "\n"
+                   << "Args:\n"
+                   << "  - String:          " << yamlQuote(message) << "\n"
+                   << "...\n";
+        }
+    }
+
+} // namespace staple
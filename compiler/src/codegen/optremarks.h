@@ -0,0 +1,53 @@
+#ifndef STAPLE_OPTREMARKS_H
+#define STAPLE_OPTREMARKS_H
+
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/Regex.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace staple {
+
+    using namespace std;
+    using namespace llvm;
+
+    class CompilerContext;
+
+    /**
+     * LLVM's optimization remarks for -Rpass, -Rpass-missed and -Rpass-analysis. Remarks whose pass name matches the
+     * pattern of their kind are printed to stderr as file:line:column: remark, and with --remarks-yaml also written to
+     * a YAML file. Every other diagnostic is printed like LLVM's default handler would. One OptRemarks serves the
+     * modules of all input files, a remark is reported at the file of its module.
+     */
+    class OptRemarks {
+    private:
+        CompilerContext* mCompilerContext;
+        unique_ptr<Regex> mPassed;
+        unique_ptr<Regex> mMissed;
+        unique_ptr<Regex> mAnalysis;
+        unique_ptr<raw_fd_ostream> mYaml;
+        //modules may be optimized on several threads
+        mutex mLock;
+
+        static void handleDiagnostic(const DiagnosticInfo& info, void* context);
+        void emitRemark(const DiagnosticInfoOptimizationRemarkBase& remark, const char* kind, const char* option);
+
+    public:
+        OptRemarks(CompilerContext* compilerContext);
+
+        /**
+         * compiles the patterns and opens the YAML file, false with error when a pattern or the file is invalid
+         */
+        bool init(string& error);
+
+        //reports the diagnostics of context until its handler is reset
+        void install(LLVMContext& context);
+    };
+
+} // namespace staple
+
+#endif //STAPLE_OPTREMARKS_H
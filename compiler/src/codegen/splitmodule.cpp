@@ -0,0 +1,315 @@
+#include "splitmodule.h"
+#include "LLVMCodeGenerator.h"
+#include "../compilercontext.h"
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <thread>
+
+namespace staple {
+
+    namespace {
+
+        string writeBitcode(const Module& module) {
+            string retval;
+            raw_string_ostream stream(retval);
+            WriteBitcodeToFile(&module, stream);
+            stream.flush();
+            return retval;
+        }
+
+        //nullptr with error when the bitcode cannot be read
+        Module* readBitcode(const string& bitcode, const string& name, LLVMContext& context, string& error) {
+            unique_ptr<MemoryBuffer> buffer(MemoryBuffer::getMemBuffer(bitcode, name, false));
+            ErrorOr<Module*> module = parseBitcodeFile(buffer.get(), context);
+            if(!module) {
+                error = name + ": " + module.getError().message();
+                return nullptr;
+            }
+            return module.get();
+        }
+
+        //function(i) for i in [0, count), 0 on the calling thread
+        template<typename Function>
+        void runOnThreads(size_t count, Function function) {
+            vector<thread> threads;
+            for(size_t i = 1; i < count; i++) {
+                threads.emplace_back(function, i);
+            }
+            function(0);
+            for(thread& worker : threads) {
+                worker.join();
+            }
+        }
+
+        //global initializers are part 0's, constants are looked through to the instructions using them
+        bool usedOutside(Value* value, unsigned part, const DenseMap<const Function*, unsigned>& functionParts) {
+            for(User* user : value->users()) {
+                if(Instruction* instruction = dyn_cast<Instruction>(user)) {
+                    if(functionParts.lookup(instruction->getParent()->getParent()) != part) {
+                        return true;
+                    }
+                } else if(isa<GlobalVariable>(user)) {
+                    if(part != 0) {
+                        return true;
+                    }
+                } else if(isa<Constant>(user) && usedOutside(user, part, functionParts)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    }
+
+    SplitModule::SplitModule(CompilerContext* compilerContext)
+    : mCompilerContext(compilerContext) {}
+
+    void SplitModule::externalizeSharedLocals(Module& module, unsigned numParts) {
+        DenseMap<const Function*, unsigned> functionParts;
+        unsigned index = 0;
+        for(Function& function : module) {
+            if(!function.isDeclaration()) {
+                functionParts[&function] = index++ % numParts;
+            }
+        }
+
+        //hidden symbols of two modules linked into one program must not clash
+        MD5 hash;
+        hash.update(module.getModuleIdentifier());
+        MD5::MD5Result result;
+        hash.final(result);
+        SmallString<32> digest;
+        MD5::stringifyResult(result, digest);
+        const string suffix = "." + digest.str().substr(0, 8).str();
+
+        vector<GlobalValue*> shared;
+        for(Function& function : module) {
+            if(function.hasLocalLinkage() && usedOutside(&function, functionParts.lookup(&function), functionParts)) {
+                shared.push_back(&function);
+            }
+        }
+        for(Module::global_iterator it = module.global_begin(); it != module.global_end(); ++it) {
+            if(it->hasLocalLinkage() && usedOutside(&*it, 0, functionParts)) {
+                shared.push_back(&*it);
+            }
+        }
+
+        for(GlobalValue* global : shared) {
+            string name = global->hasName() ? global->getName().str() : "__stp_anon";
+            global->setName(name + suffix);
+            global->setLinkage(GlobalValue::ExternalLinkage);
+            global->setVisibility(GlobalValue::HiddenVisibility);
+            mLocalSymbols.push_back(global->getName().str());
+        }
+    }
+
+    void SplitModule::keepPart(Module& module, unsigned part, unsigned numParts) {
+        //locals left out of the part are only used by other parts' code, so they can go
+        vector<GlobalValue*> dropped;
+        unsigned index = 0;
+        for(Function& function : module) {
+            if(function.isDeclaration() || index++ % numParts == part) {
+                continue;
+            }
+            bool local = function.hasLocalLinkage();
+            function.deleteBody();
+            if(local) {
+                dropped.push_back(&function);
+            }
+        }
+
+        if(part != 0) {
+            for(Module::global_iterator it = module.global_begin(); it != module.global_end(); ++it) {
+                if(!it->hasInitializer()) {
+                    continue;
+                }
+                //part 0 has the only copy of the data, and of llvm.global_ctors
+                if(it->hasAppendingLinkage() || it->hasLocalLinkage()) {
+                    it->setInitializer(nullptr);
+                    dropped.push_back(&*it);
+                } else {
+                    it->setInitializer(nullptr);
+                    it->setLinkage(GlobalValue::ExternalLinkage);
+                }
+            }
+        }
+
+        for(GlobalValue* global : dropped) {
+            global->removeDeadConstantUsers();
+            if(global->use_empty()) {
+                global->eraseFromParent();
+            } else {
+                global->setLinkage(GlobalValue::ExternalLinkage);
+            }
+        }
+    }
+
+    bool SplitModule::split(Module& module, unsigned numParts, string& error) {
+        if(mCompilerContext->optLevel > 0) {
+            unique_ptr<TargetMachine> targetMachine(LLVMCodeGenerator::createTargetMachine(mCompilerContext));
+            LLVMCodeGenerator::runInterproceduralPasses(module, targetMachine.get(), mCompilerContext->optLevel);
+        }
+
+        externalizeSharedLocals(module, numParts);
+        const string bitcode = writeBitcode(module);
+
+        //made here, a target machine is not shared between threads
+        mParts.resize(numParts);
+        for(Part& part : mParts) {
+            part.context.reset(new LLVMContext());
+            part.targetMachine.reset(LLVMCodeGenerator::createTargetMachine(mCompilerContext));
+        }
+
+        vector<string> errors(numParts);
+        runOnThreads(numParts, [&](size_t i) {
+            Part& part = mParts[i];
+            part.module.reset(readBitcode(bitcode, module.getModuleIdentifier(), *part.context, errors[i]));
+            if(part.module) {
+                keepPart(*part.module, i, numParts);
+            }
+        });
+
+        for(const string& partError : errors) {
+            if(!partError.empty()) {
+                error = partError;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void SplitModule::optimize() {
+        runOnThreads(mParts.size(), [&](size_t i) {
+            LLVMCodeGenerator::runOptimizationPasses(*mParts[i].module, mParts[i].targetMachine.get(),
+                                                     mCompilerContext->optLevel);
+        });
+    }
+
+    bool SplitModule::emitObject(const string& filename, string& error) {
+        vector<string> paths(mParts.size());
+        for(string& path : paths) {
+            SmallString<128> tempPath;
+            if(std::error_code code = sys::fs::createTemporaryFile("stp-part", "o", tempPath)) {
+                error = "cannot create a temporary file: " + code.message();
+                return false;
+            }
+            path = tempPath.str().str();
+        }
+
+        vector<string> errors(mParts.size());
+        runOnThreads(mParts.size(), [&](size_t i) {
+            LLVMCodeGenerator::emitObjectFile(*mParts[i].module, mParts[i].targetMachine.get(), paths[i], errors[i]);
+        });
+
+        for(const string& partError : errors) {
+            if(!partError.empty() && error.empty()) {
+                error = partError;
+            }
+        }
+
+        if(error.empty()) {
+            string ld = sys::FindProgramByName("ld");
+            if(ld.empty()) {
+                error = "cannot find ld to combine the objects of --split-module";
+            } else {
+                vector<const char*> args{ld.c_str(), "-r", "-o", filename.c_str()};
+                for(const string& path : paths) {
+                    args.push_back(path.c_str());
+                }
+                args.push_back(nullptr);
+
+                string execError;
+                if(sys::ExecuteAndWait(ld, args.data(), nullptr, nullptr, 0, 0, &execError) != 0) {
+                    error = "ld -r failed" + (execError.empty() ? string() : ": " + execError);
+                }
+            }
+        }
+
+        if(error.empty() && !mLocalSymbols.empty()) {
+            localizeSymbols(filename, error);
+        }
+
+        for(const string& path : paths) {
+            sys::fs::remove(path);
+        }
+        return error.empty();
+    }
+
+    bool SplitModule::localizeSymbols(const string& filename, string& error) {
+        string objcopy = sys::FindProgramByName("objcopy");
+        if(objcopy.empty()) {
+            error = "cannot find objcopy to make the shared locals of --split-module local again";
+            return false;
+        }
+
+        vector<string> options;
+        for(const string& name : mLocalSymbols) {
+            options.push_back("--localize-symbol=" + name);
+        }
+        vector<const char*> args{objcopy.c_str()};
+        for(const string& option : options) {
+            args.push_back(option.c_str());
+        }
+        args.push_back(filename.c_str());
+        args.push_back(nullptr);
+
+        string execError;
+        if(sys::ExecuteAndWait(objcopy, args.data(), nullptr, nullptr, 0, 0, &execError) != 0) {
+            error = "objcopy failed" + (execError.empty() ? string() : ": " + execError);
+            return false;
+        }
+        return true;
+    }
+
+    unique_ptr<Module> SplitModule::merge(LLVMContext& context, string& error) {
+        vector<string> bitcode(mParts.size());
+        runOnThreads(mParts.size(), [&](size_t i) {
+            bitcode[i] = writeBitcode(*mParts[i].module);
+        });
+
+        unique_ptr<Module> retval;
+        for(size_t i = 0; i < bitcode.size(); i++) {
+            unique_ptr<Module> part(readBitcode(bitcode[i], mParts[i].module->getModuleIdentifier(), context, error));
+            if(!part) {
+                return nullptr;
+            }
+
+            if(retval == nullptr) {
+                retval = std::move(part);
+            } else {
+                string linkError;
+                if(Linker::LinkModules(retval.get(), part.get(), Linker::DestroySource, &linkError)) {
+                    error = "cannot merge the parts of --split-module: " + linkError;
+                    return nullptr;
+                }
+            }
+        }
+
+        for(const string& name : mLocalSymbols) {
+            if(GlobalValue* global = retval->getNamedValue(name)) {
+                global->setVisibility(GlobalValue::DefaultVisibility);
+                global->setLinkage(GlobalValue::InternalLinkage);
+            }
+        }
+        return retval;
+    }
+
+    vector<Module*> SplitModule::getModules() const {
+        vector<Module*> retval;
+        for(const Part& part : mParts) {
+            retval.push_back(part.module.get());
+        }
+        return retval;
+    }
+
+}
@@ -0,0 +1,71 @@
+#ifndef STAPLE_SPLITMODULE_H
+#define STAPLE_SPLITMODULE_H
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace staple {
+
+    using namespace std;
+    using namespace llvm;
+
+    class CompilerContext;
+
+    /**
+     * --split-module: the generated module cut into parts that are optimized and emitted in parallel, one thread and
+     * LLVMContext each. With optimization on, the inliner and the other interprocedural passes first run on the whole
+     * module, as a part cannot inline a function dealt to another. Defined functions are then dealt out round robin in
+     * module order and global variables stay in part 0, so a module always splits the same way. Internal symbols used
+     * from another part than their own become hidden globals named after the module, and are internal again in
+     * merge() and local in the object of emitObject().
+     */
+    class SplitModule {
+    private:
+        struct Part {
+            unique_ptr<LLVMContext> context;
+            unique_ptr<Module> module;
+            unique_ptr<TargetMachine> targetMachine;
+        };
+
+        CompilerContext* mCompilerContext;
+        vector<Part> mParts;
+        //made global by split()
+        vector<string> mLocalSymbols;
+
+        void externalizeSharedLocals(Module& module, unsigned numParts);
+        //the shared locals made local symbols of the object file again, in place
+        bool localizeSymbols(const string& filename, string& error);
+        static void keepPart(Module& module, unsigned part, unsigned numParts);
+
+    public:
+        SplitModule(CompilerContext* compilerContext);
+
+        /**
+         * copies module into numParts parts, module itself is left inlined and with the shared locals made global.
+         * False with error when a copy cannot be read back.
+         */
+        bool split(Module& module, unsigned numParts, string& error);
+
+        //the -O pipeline on every part
+        void optimize();
+
+        /**
+         * emits every part as an object file and combines them into filename with ld -r, in part order. objcopy then
+         * makes the shared locals local symbols again.
+         */
+        bool emitObject(const string& filename, string& error);
+
+        //the parts linked back into one module in context, in part order
+        unique_ptr<Module> merge(LLVMContext& context, string& error);
+
+        vector<Module*> getModules() const;
+    };
+
+}
+
+#endif //STAPLE_SPLITMODULE_H
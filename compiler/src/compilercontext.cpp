@@ -18,28 +18,54 @@ using namespace std;
     }
 
 
-CompilerContext::CompilerContext() {
+CompilerContext::CompilerContext()
+: types(arena) {
 
-    STP_OBJ_CLASS->addField("class", new StaplePointer(new StapleClassDef(STP_OBJ_CLASS)));
+    STP_OBJ_CLASS->addField(SYM_CLASS, new StaplePointer(new StapleClassDef(STP_OBJ_CLASS)));
     //STP_OBJ_CLASS->addField("refCount", StapleType::getInt32Type());
 
     {
         vector<StapleType *> args{};
-        STP_OBJ_CLASS->addMethod("init", StapleType::getVoidType(), args, false, StapleMethodFunction::Type::Static);
+        STP_OBJ_CLASS->addMethod(SYM_INIT, StapleType::getVoidType(), args, false, StapleMethodFunction::Type::Static);
     }
 
     {
         vector<StapleType *> args{};
-        STP_OBJ_CLASS->addMethod("kill", StapleType::getVoidType(), args, false, StapleMethodFunction::Type::Virtual);
+        STP_OBJ_CLASS->addMethod(SYM_KILL, StapleType::getVoidType(), args, false, StapleMethodFunction::Type::Virtual);
     }
 
 
     defineClass(STP_OBJ_CLASS);
 };
 
-void CompilerContext::defineClass(StapleClass *localClass) {
+StapleClass* CompilerContext::defineClass(StapleClass *localClass, NClassDeclaration* declaration) {
     string fqClassName = localClass->getClassName();
+    auto it = mClasses.find(fqClassName);
+    if(it != mClasses.end()) {
+        return it->second;
+    }
     mClasses[fqClassName] = localClass;
+    mClassDeclarations[localClass] = declaration;
+    return nullptr;
+}
+
+NClassDeclaration* CompilerContext::getClassDeclaration(const StapleClass* stapleClass) const {
+    auto it = mClassDeclarations.find(stapleClass);
+    return it != mClassDeclarations.end() ? it->second : nullptr;
+}
+
+NFunction* CompilerContext::defineFunction(NFunction* function) {
+    auto it = mFunctions.find(function->name);
+    if(it != mFunctions.end()) {
+        return it->second;
+    }
+    mFunctions[function->name] = function;
+    return nullptr;
+}
+
+NFunction* CompilerContext::lookupFunction(Symbol name) const {
+    auto it = mFunctions.find(name);
+    return it != mFunctions.end() ? it->second : nullptr;
 }
 
 StapleClass* CompilerContext::lookupClassName(const std::string &className) {
@@ -4,8 +4,11 @@
 #include <string>
 #include <map>
 
+#include "arena.h"
 #include "node.h"
+#include "profiledata.h"
 #include "types/stapletype.h"
+#include "types/typecontext.h"
 
 #include <llvm/IR/Type.h>
 
@@ -13,27 +16,99 @@ namespace staple {
 
     using namespace std;
 
+    /**
+     * one input file. Its AST and token strings live in an arena of their own, apart from the other files', so files
+     * can be parsed and checked side by side
+     */
+    class SourceFile {
+    public:
+        string filename;
+        Arena arena;
+        NCompileUnit* compileUnit = nullptr;
+
+        SourceFile(const string& filename) : filename(filename) {}
+    };
+
     class CompilerContext {
     private:
         //fully qualifed name class map
         map<string, StapleClass*> mClasses;
+        //where the classes of the input files are declared
+        map<const StapleClass*, NClassDeclaration*> mClassDeclarations;
+        //free functions of every file by name
+        map<Symbol, NFunction*> mFunctions;
 
     public:
-        string inputFilename;
-        string outputFilename;
+        //every file of the compile, each is generated into a module of its own
+        vector<string> inputFilenames;
         bool debugSymobols;
+        //false keeps the debug locations for optimization remarks but leaves debug info out of the object
+        bool emitDebugInfo = true;
+        //-gline-tables-only: functions and line numbers without variables or types
+        bool lineTablesOnly = false;
+        //--keep-frame-pointers: every function keeps its frame pointer so profilers can unwind without DWARF
+        bool keepFramePointers = false;
+
+        //-O level the module is optimized at before it is written, 0 leaves it as generated
+        unsigned optLevel = 0;
+        //-Rpass, -Rpass-missed and -Rpass-analysis patterns matched against pass names, empty when off
+        string remarksPassed;
+        string remarksMissed;
+        string remarksAnalysis;
+        //--remarks-yaml output file
+        string remarksYaml;
+
+        //empty triple is the host default, cpu and features may be "native"
+        string targetTriple;
+        string targetCPU;
+        string targetFeatures;
+        //set once the first code generator resolved "native" and the default triple
+        bool targetResolved = false;
+
+        //--profile-generate output file, empty when not instrumenting
+        string profileGenerate;
+        //--profile-use counts
+        ProfileData profile;
+        //--heap-profile report file, empty when the profiler is left to STP_HEAP_PROFILE
+        string heapProfile;
+        //--refcount-profile report file, empty when refcount calls are not counted
+        string refcountProfile;
+        //--instrument-functions: call the runtime's trace hooks on entry and exit of every function
+        bool instrumentFunctions = false;
+
+        //lanes of 32 bit values per vector register, foreach loops are vectorized to this width. Set from the target cpu
+        unsigned simdWidth = 4;
 
         string package;
         vector<string> includes;
 
+        //owns the semantic types of the compile, freed all at once with the context. The AST is in the SourceFiles
+        Arena arena;
+        //pointer, array, slice, vector and function types, unique per structure
+        TypeContext types;
+
         static StapleClass* getStpObjClass();
         static StapleClassDef* getStpObjClassDef();
 
-        void defineClass(StapleClass *localClass);
+        /**
+         * declares a class under its FQ name. Returns the class already declared with that name, the new one is
+         * then left out.
+         */
+        StapleClass* defineClass(StapleClass *localClass, NClassDeclaration* declaration = nullptr);
+        //declaration of a class of the input files, NULL for the runtime's
+        NClassDeclaration* getClassDeclaration(const StapleClass* stapleClass) const;
         StapleClass *lookupClassName(const string &className);
+        size_t numClasses() const { return mClasses.size(); }
+
+        /**
+         * declares a free function for every file of the compile, before any body is checked. Returns the function
+         * already declared with the same name, the new one is then left out.
+         */
+        NFunction* defineFunction(NFunction* function);
+        //free function of any file called name, NULL if there is none
+        NFunction* lookupFunction(Symbol name) const;
 
-        map<ASTNode*, StapleType*> typeTable;
-        map<StapleType*, llvm::Type*> llvmType;
+        NodeMap<StapleType*> typeTable;
 
         CompilerContext();
 
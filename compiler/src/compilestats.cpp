@@ -0,0 +1,111 @@
+#include "compilestats.h"
+
+#include <chrono>
+
+#include <sys/resource.h>
+
+namespace staple {
+
+    static double seconds(const struct timeval& time) {
+        return time.tv_sec + time.tv_usec / 1e6;
+    }
+
+    static double wallSeconds() {
+        return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static string jsonQuote(const string& str) {
+        string retval = "\"";
+        for(char c : str) {
+            switch(c) {
+                case '"': retval += "\\\""; break;
+                case '\\': retval += "\\\\"; break;
+                case '\n': retval += "\\n"; break;
+                case '\t': retval += "\\t"; break;
+                default:
+                    if((unsigned char)c < 0x20) {
+                        char escaped[8];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        retval += escaped;
+                    } else {
+                        retval += c;
+                    }
+            }
+        }
+        return retval + "\"";
+    }
+
+    void CompileStats::startPhase(const string& name) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        mPhase = name;
+        mWallStart = wallSeconds();
+        mUserStart = seconds(usage.ru_utime);
+        mSystemStart = seconds(usage.ru_stime);
+    }
+
+    void CompileStats::endPhase() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        //ru_maxrss is in kilobytes on Linux
+        mPhases.push_back(PhaseTime{mPhase, wallSeconds() - mWallStart, seconds(usage.ru_utime) - mUserStart,
+                                    seconds(usage.ru_stime) - mSystemStart, usage.ru_maxrss});
+    }
+
+    void CompileStats::addCount(const string& name, uint64_t value) {
+        mCounts.push_back(make_pair(name, value));
+    }
+
+    void CompileStats::printTimeReport(FILE* out) const {
+        double wall = 0, user = 0, system = 0;
+        long peak = 0;
+
+        fprintf(out, "===-- stp time report --===\n");
+        fprintf(out, "%-10s %12s %12s %12s %16s\n", "phase", "wall (s)", "user (s)", "system (s)", "peak RSS (KB)");
+        for(const PhaseTime& phase : mPhases) {
+            fprintf(out, "%-10s %12.4f %12.4f %12.4f %16ld\n", phase.name.c_str(), phase.wall, phase.user,
+                    phase.system, phase.peakRSSKb);
+            wall += phase.wall;
+            user += phase.user;
+            system += phase.system;
+            peak = phase.peakRSSKb > peak ? phase.peakRSSKb : peak;
+        }
+        fprintf(out, "%-10s %12.4f %12.4f %12.4f %16ld\n", "total", wall, user, system, peak);
+
+        if(!mPassReport.empty()) {
+            fprintf(out, "\n%s", mPassReport.c_str());
+        }
+    }
+
+    void CompileStats::printStats(FILE* out) const {
+        fprintf(out, "===-- stp statistics --===\n");
+        for(const pair<string, uint64_t>& count : mCounts) {
+            fprintf(out, "%12llu %s\n", (unsigned long long)count.second, count.first.c_str());
+        }
+    }
+
+    bool CompileStats::writeJSON(const string& filename, string& error) const {
+        FILE* out = fopen(filename.c_str(), "w");
+        if(out == NULL) {
+            error = "cannot write statistics: " + filename;
+            return false;
+        }
+
+        fprintf(out, "{\n  \"phases\": [");
+        for(size_t i = 0; i < mPhases.size(); i++) {
+            const PhaseTime& phase = mPhases[i];
+            fprintf(out, "%s\n    {\"name\": %s, \"wall_s\": %.6f, \"user_s\": %.6f, \"system_s\": %.6f, "
+                    "\"peak_rss_kb\": %ld}", i > 0 ? "," : "", jsonQuote(phase.name).c_str(), phase.wall, phase.user,
+                    phase.system, phase.peakRSSKb);
+        }
+        fprintf(out, "\n  ],\n  \"counts\": {");
+        for(size_t i = 0; i < mCounts.size(); i++) {
+            fprintf(out, "%s\n    %s: %llu", i > 0 ? "," : "", jsonQuote(mCounts[i].first).c_str(),
+                    (unsigned long long)mCounts[i].second);
+        }
+        fprintf(out, "\n  },\n  \"llvm_pass_report\": %s\n}\n", jsonQuote(mPassReport).c_str());
+        fclose(out);
+        return true;
+    }
+
+}
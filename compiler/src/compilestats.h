@@ -0,0 +1,55 @@
+#ifndef STAPLE_COMPILESTATS_H
+#define STAPLE_COMPILESTATS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace staple {
+
+    using namespace std;
+
+    /**
+     * --time-report and --stats: wall time, CPU time and peak memory of every compiler phase and counts of what the
+     * phases built. Printed as tables to stderr, or written as JSON with --stats-json.
+     */
+    class CompileStats {
+    private:
+        struct PhaseTime {
+            string name;
+            double wall;
+            double user;
+            double system;
+            //high water mark of the process at the end of the phase
+            long peakRSSKb;
+        };
+
+        vector<PhaseTime> mPhases;
+        vector<pair<string, uint64_t>> mCounts;
+        //LLVM's own pass timing table, empty when nothing was optimized
+        string mPassReport;
+
+        string mPhase;
+        double mWallStart;
+        double mUserStart;
+        double mSystemStart;
+
+    public:
+        CompileStats() : mWallStart(0), mUserStart(0), mSystemStart(0) {}
+
+        void startPhase(const string& name);
+        void endPhase();
+
+        void addCount(const string& name, uint64_t value);
+        void setPassReport(const string& report) { mPassReport = report; }
+
+        void printTimeReport(FILE* out) const;
+        void printStats(FILE* out) const;
+        bool writeJSON(const string& filename, string& error) const;
+    };
+
+}
+
+#endif //STAPLE_COMPILESTATS_H
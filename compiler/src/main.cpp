@@ -1,29 +1,30 @@
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <iostream>
+#include <set>
 #include <system_error>
+#include <thread>
 
 #include "compilercontext.h"
+#include "compilestats.h"
 #include "node.h"
 #include "sempass.h"
 #include "codegen/LLVMCodeGenerator.h"
+#include "codegen/optremarks.h"
+#include "codegen/splitmodule.h"
 
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Pass.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Timer.h>
 #include <llvm/Support/raw_ostream.h>
 
 #include "optionparser.h"
 
-extern "C" int yylex();
-int yyparse();
-extern "C" FILE *yyin;
-extern "C" int yydebug;
-
-char *filename;
-
 using namespace std;
 using namespace staple;
 
-extern NCompileUnit* compileUnit;
-
 
 struct Arg : public option::Arg
 {
@@ -38,25 +39,131 @@ struct Arg : public option::Arg
     }
 };
 
-enum optionIndex { UNKNOWN, PACKAGE, OUTPUT, INPUT, DEBUG };
+enum optionIndex { UNKNOWN, PACKAGE, OUTPUT, INPUT, DEBUG, MARCH, MCPU, MATTR, PROFILE_GENERATE, PROFILE_USE, HEAP_PROFILE, REFCOUNT_PROFILE,
+                   INSTRUMENT_FUNCTIONS, OPTIMIZE, RPASS, RPASS_MISSED, RPASS_ANALYSIS, REMARKS_YAML,
+                   LINE_TABLES_ONLY, KEEP_FRAME_POINTERS, JOBS, CODEGEN_THREADS, SPLIT_MODULE, FILETYPE, STOP_AFTER, TIME_REPORT, STATS, STATS_JSON };
+
+//compiler phases in the order they run, --stop-after ends the compile after one of them
+enum Phase { PHASE_LEX, PHASE_PARSE, PHASE_SEMA, PHASE_CODEGEN, PHASE_OPTIMIZE, PHASE_EMIT, NUM_PHASES };
+static const char* phaseNames[NUM_PHASES] = { "lex", "parse", "sema", "codegen", "optimize", "emit" };
 const option::Descriptor usage[] =
 {
-    {UNKNOWN, 0, "", "", option::Arg::None, "USAGE: stp [-o] output.ll input.stp\n\n"
+    {UNKNOWN, 0, "", "", option::Arg::None, "USAGE: stp [-o output.ll] input.stp...\n\n"
                                                     "Options:"},
     {PACKAGE, 0, "p", "package", Arg::Required, "-p <package name>, --package <package name> \tThe package name"},
-    {OUTPUT, 0, "o", "output", Arg::Required, "-o <output.ll>, --output <output.ll> \tThe output LLVM file"},
+    {OUTPUT, 0, "o", "output", Arg::Required, "-o <output.ll>, --output <output.ll> \tThe output LLVM or object file of a single input file"},
+    {FILETYPE, 0, "", "filetype", Arg::Required, "--filetype=<ll|obj> \tWrite LLVM assembly (default) or a native object file"},
     {DEBUG, 0, "g", "debug", Arg::None, "-g\toutput debug symbols"},
-    {UNKNOWN, 0, "", "", option::Arg::None, "<input.stp>\tThe input file"},
+    {LINE_TABLES_ONLY, 0, "", "gline-tables-only", Arg::None, "-gline-tables-only \tOnly output function names and line tables, enough for profilers to symbolize"},
+    {KEEP_FRAME_POINTERS, 0, "", "keep-frame-pointers", Arg::None, "--keep-frame-pointers \tKeep the frame pointer in every function, so profilers can unwind the stack cheaply"},
+    {MARCH, 0, "", "march", Arg::Required, "-march=<cpu> \tGenerate code for the cpu, 'native' for the host"},
+    {MCPU, 0, "", "mcpu", Arg::Required, "-mcpu=<cpu> \tSame as -march"},
+    {MATTR, 0, "", "mattr", Arg::Required, "-mattr=<+feature,-feature> \tEnable or disable cpu features, 'native' for the host's"},
+    {PROFILE_GENERATE, 0, "", "profile-generate", option::Arg::Optional, "--profile-generate[=<file>] \tCount executions, the program adds them to file (default.stpprof) at exit"},
+    {PROFILE_USE, 0, "", "profile-use", Arg::Required, "--profile-use=<file> \tOptimize using the counts from a --profile-generate build"},
+    {HEAP_PROFILE, 0, "", "heap-profile", option::Arg::Optional, "--heap-profile[=<file>] \tRecord heap allocations per class and site, report to file (stp.heapprofile) at exit"},
+    {REFCOUNT_PROFILE, 0, "", "refcount-profile", option::Arg::Optional, "--refcount-profile[=<file>] \tCount retain/release calls per source location, report to file (stp.rcprofile) at exit"},
+    {INSTRUMENT_FUNCTIONS, 0, "", "instrument-functions", option::Arg::None, "--instrument-functions \tTrace entry and exit of every function, written to stp-trace.json at exit"},
+    {OPTIMIZE, 0, "O", "", option::Arg::Optional, "-O<level> \tOptimize at level 0 to 3 (-O is -O2)"},
+    {RPASS, 0, "", "Rpass", Arg::Required, "-Rpass=<regex> \tReport optimizations done by passes matching regex, implies -O2"},
+    {RPASS_MISSED, 0, "", "Rpass-missed", Arg::Required, "-Rpass-missed=<regex> \tReport optimizations that passes matching regex failed to do"},
+    {RPASS_ANALYSIS, 0, "", "Rpass-analysis", Arg::Required, "-Rpass-analysis=<regex> \tReport the analysis behind the decisions of passes matching regex"},
+    {REMARKS_YAML, 0, "", "remarks-yaml", Arg::Required, "--remarks-yaml=<file> \tAlso write the reported remarks to file as YAML"},
+    {JOBS, 0, "j", "jobs", Arg::Required, "-j <n>, --jobs=<n> \tCompile up to n input files at the same time, the number of cpus by default"},
+    {CODEGEN_THREADS, 0, "", "codegen-threads", Arg::Required, "--codegen-threads=<n> \tGenerate the LLVM module on n threads"},
+    {SPLIT_MODULE, 0, "", "split-module", Arg::Required, "--split-module=<n> \tOptimize and emit the module as n parts on n threads"},
+    {STOP_AFTER, 0, "", "stop-after", Arg::Required, "--stop-after=<phase> \tStop after lex, parse, sema, codegen or optimize without writing output"},
+    {TIME_REPORT, 0, "", "time-report", option::Arg::None, "--time-report \tPrint wall and CPU time and peak memory of every phase and LLVM's pass timings"},
+    {STATS, 0, "", "stats", option::Arg::None, "--stats \tPrint the number of AST nodes, types and LLVM instructions"},
+    {STATS_JSON, 0, "", "stats-json", Arg::Required, "--stats-json=<file> \tWrite the time report and statistics to file as JSON"},
+    {UNKNOWN, 0, "", "", option::Arg::None, "<input.stp...>\tThe input files, each compiled to input.ll or input.o next to it when there are several"},
     { 0, 0, 0, 0, 0, 0 }
 };
 
+static void countModules(CompileStats& compileStats, const vector<Module*>& modules, const string& prefix) {
+    uint64_t functions = 0, blocks = 0, instructions = 0;
+    for(Module* module : modules) {
+        for(Function& function : *module) {
+            if(function.isDeclaration()) {
+                continue;
+            }
+            functions++;
+            for(BasicBlock& block : function) {
+                blocks++;
+                instructions += block.size();
+            }
+        }
+    }
+    compileStats.addCount(prefix + "functions", functions);
+    compileStats.addCount(prefix + "basic blocks", blocks);
+    compileStats.addCount(prefix + "instructions", instructions);
+}
+
+//an input file and what the compile made of it
+struct Input {
+    SourceFile source;
+    string outputFilename;
+    unique_ptr<SemPass> semPass;
+    unique_ptr<LLVMContext> llvmContext;
+    unique_ptr<LLVMCodeGenerator> codeGenerator;
+    //--split-module
+    unique_ptr<SplitModule> splitModule;
+
+    Input(const string& filename) : source(filename) {}
+};
+
+/**
+ * calls function(i) for every i in [0, count) on up to jobs threads, the calling thread included. A thread takes the
+ * next i when it is done with one, so a large file does not hold up the small ones behind it
+ */
+template<typename Function>
+static void runJobs(size_t count, unsigned jobs, Function function) {
+    atomic<size_t> next(0);
+    auto work = [&]() {
+        for(size_t i = next++; i < count; i = next++) {
+            function(i);
+        }
+    };
+
+    vector<thread> threads;
+    for(size_t i = 1; i < jobs && i < count; i++) {
+        threads.emplace_back(work);
+    }
+    work();
+    for(thread& worker : threads) {
+        worker.join();
+    }
+}
+
+//the first error of the jobs, false if there was one
+static bool reportErrors(const vector<string>& errors) {
+    for(const string& error : errors) {
+        if(!error.empty()) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+//dir/input.stp to dir/input<extension>
+static string replaceExtension(const string& filename, const string& extension) {
+    size_t dot = filename.find_last_of('.');
+    size_t slash = filename.find_last_of('/');
+    if(dot == string::npos || (slash != string::npos && dot < slash)) {
+        dot = filename.size();
+    }
+    return filename.substr(0, dot) + extension;
+}
+
 int main(int argc, char **argv)
 {
 
     argc-=(argc>0); argv+=(argc>0); // skip program name argv[0] if present
-    option::Stats stats(usage, argc, argv);
+    //single dash long options for the -march style flags
+    option::Stats stats(usage, argc, argv, 0, true);
     option::Option options[stats.options_max], buffer[stats.buffer_max];
-    option::Parser parse(usage, argc, argv, options, buffer);
+    option::Parser parse(usage, argc, argv, options, buffer, 0, true);
 
     if (parse.error())
         return 1;
@@ -68,12 +175,38 @@ int main(int argc, char **argv)
     }
 
     CompilerContext context;
-    context.inputFilename = parse.nonOption(0);
+    for(int i = 0; i < parse.nonOptionsCount(); i++) {
+        context.inputFilenames.push_back(parse.nonOption(i));
+    }
+    if(context.inputFilenames.empty()) {
+        fprintf(stderr, "no input files\n");
+        return 1;
+    }
 
-    if(options[OUTPUT]) {
-        context.outputFilename = options[OUTPUT].arg;
+    bool emitObject = false;
+    if(options[FILETYPE]) {
+        const string fileType = options[FILETYPE].last()->arg;
+        if(fileType != "ll" && fileType != "obj") {
+            fprintf(stderr, "unknown file type: %s\n", fileType.c_str());
+            return 1;
+        }
+        emitObject = fileType == "obj";
+    }
+
+    vector<unique_ptr<Input>> inputs;
+    for(const string& inputFilename : context.inputFilenames) {
+        inputs.emplace_back(new Input(inputFilename));
+    }
+
+    if(inputs.size() == 1) {
+        inputs[0]->outputFilename = options[OUTPUT] ? options[OUTPUT].arg : emitObject ? "output.o" : "output.ll";
+    } else if(options[OUTPUT]) {
+        fprintf(stderr, "-o cannot be used with several input files\n");
+        return 1;
     } else {
-        context.outputFilename = "output.ll";
+        for(unique_ptr<Input>& input : inputs) {
+            input->outputFilename = replaceExtension(input->source.filename, emitObject ? ".o" : ".ll");
+        }
     }
 
     if(options[PACKAGE]) {
@@ -82,40 +215,384 @@ int main(int argc, char **argv)
         context.package = "";
     }
 
-    context.debugSymobols = options[DEBUG] ? true : false;
+    context.debugSymobols = options[DEBUG] || options[LINE_TABLES_ONLY] ? true : false;
+    //a full -g wins over line tables
+    context.lineTablesOnly = options[LINE_TABLES_ONLY] && !options[DEBUG] ? true : false;
+    context.keepFramePointers = options[KEEP_FRAME_POINTERS] ? true : false;
+    context.instrumentFunctions = options[INSTRUMENT_FUNCTIONS] ? true : false;
+
+    if(options[MCPU]) {
+        context.targetCPU = options[MCPU].last()->arg;
+    } else if(options[MARCH]) {
+        context.targetCPU = options[MARCH].last()->arg;
+    }
+
+    if(options[MATTR]) {
+        context.targetFeatures = options[MATTR].last()->arg;
+    }
+
+    if(options[PROFILE_GENERATE]) {
+        const char* profileFile = options[PROFILE_GENERATE].last()->arg;
+        context.profileGenerate = profileFile != NULL ? profileFile : "default.stpprof";
+    }
+
+    if(options[HEAP_PROFILE]) {
+        const char* heapProfileFile = options[HEAP_PROFILE].last()->arg;
+        context.heapProfile = heapProfileFile != NULL ? heapProfileFile : "stp.heapprofile";
+    }
+
+    if(options[REFCOUNT_PROFILE]) {
+        const char* refcountProfileFile = options[REFCOUNT_PROFILE].last()->arg;
+        context.refcountProfile = refcountProfileFile != NULL ? refcountProfileFile : "stp.rcprofile";
+    }
+
+    if(options[OPTIMIZE]) {
+        const char* level = options[OPTIMIZE].last()->arg;
+        context.optLevel = level != NULL ? atoi(level) : 2;
+        if(context.optLevel > 3) {
+            fprintf(stderr, "invalid optimization level: -O%s\n", level);
+            return 1;
+        }
+    }
+
+    if(options[RPASS]) {
+        context.remarksPassed = options[RPASS].last()->arg;
+    }
+    if(options[RPASS_MISSED]) {
+        context.remarksMissed = options[RPASS_MISSED].last()->arg;
+    }
+    if(options[RPASS_ANALYSIS]) {
+        context.remarksAnalysis = options[RPASS_ANALYSIS].last()->arg;
+    }
+    if(options[REMARKS_YAML]) {
+        context.remarksYaml = options[REMARKS_YAML].last()->arg;
+    }
+
+    //remarks need passes to report on and source locations to report them at
+    if(options[RPASS] || options[RPASS_MISSED] || options[RPASS_ANALYSIS]) {
+        if(!options[OPTIMIZE]) {
+            context.optLevel = 2;
+        }
+        if(!context.debugSymobols) {
+            context.debugSymobols = true;
+            context.lineTablesOnly = true;
+            context.emitDebugInfo = false;
+        }
+    }
+
+    if(options[PROFILE_USE]) {
+        string error;
+        if(!context.profile.load(options[PROFILE_USE].last()->arg, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    unsigned jobs = max(thread::hardware_concurrency(), 1u);
+    if(options[JOBS]) {
+        const char* arg = options[JOBS].last()->arg;
+        int jobsArg = atoi(arg);
+        if(jobsArg < 1) {
+            fprintf(stderr, "invalid number of jobs: %s\n", arg);
+            return 1;
+        }
+        jobs = jobsArg;
+    }
+
+    unsigned codegenThreads = 1;
+    if(options[CODEGEN_THREADS]) {
+        const char* arg = options[CODEGEN_THREADS].last()->arg;
+        int threads = atoi(arg);
+        if(threads < 1) {
+            fprintf(stderr, "invalid number of codegen threads: %s\n", arg);
+            return 1;
+        }
+        codegenThreads = threads;
+    }
 
-    //yydebug = 1;
+    unsigned splitParts = 1;
+    if(options[SPLIT_MODULE]) {
+        const char* arg = options[SPLIT_MODULE].last()->arg;
+        int parts = atoi(arg);
+        if(parts < 1) {
+            fprintf(stderr, "invalid number of module parts: %s\n", arg);
+            return 1;
+        }
+        splitParts = parts;
+    }
+    //remarks are printed and written to one file in the order the passes run, so they need a single pipeline
+    const bool remarks = !context.remarksPassed.empty() || !context.remarksMissed.empty()
+                         || !context.remarksAnalysis.empty();
+    if(remarks) {
+        splitParts = 1;
+    }
 
-    FILE *myfile = fopen(context.inputFilename.c_str(), "r");
-    if (!myfile) {
-        fprintf(stderr, "cannot open file: %s", context.inputFilename.c_str());
-        return -1;
+    Phase stopAfter = PHASE_EMIT;
+    if(options[STOP_AFTER]) {
+        const string phase = options[STOP_AFTER].last()->arg;
+        int i = 0;
+        while(i < NUM_PHASES && phase != phaseNames[i]) {
+            i++;
+        }
+        if(i == NUM_PHASES) {
+            fprintf(stderr, "unknown phase: %s\n", phase.c_str());
+            return 1;
+        }
+        stopAfter = (Phase)i;
     }
-    // set lex to read from it instead of defaulting to STDIN:
-    yyin = myfile;
 
-    // parse through the input until there is no more:
-    do {
-        yyparse();
-    } while (!feof(yyin));
+    const bool timeReport = options[TIME_REPORT] ? true : false;
+    const bool printStats = options[STATS] ? true : false;
+    const string statsJson = options[STATS_JSON] ? options[STATS_JSON].last()->arg : "";
+    CompileStats compileStats;
 
-    staple::SemPass semPass(context);
-    semPass.doSemPass(*compileUnit);
+    //the reports cover the phases that ran, also when --stop-after ended the compile early
+    auto finish = [&]() -> int {
+        if(timeReport) {
+            compileStats.printTimeReport(stderr);
+        }
+        if(printStats) {
+            compileStats.printStats(stderr);
+        }
+        if(!statsJson.empty()) {
+            string error;
+            if(!compileStats.writeJSON(statsJson, error)) {
+                fprintf(stderr, "%s\n", error.c_str());
+                return 1;
+            }
+        }
+        return 0;
+    };
 
-    if(semPass.hasErrors()) {
-        exit(1);
+    //the tokens alone, to time the lexer apart from the parser
+    if(stopAfter == PHASE_LEX) {
+        compileStats.startPhase("lex");
+        //char, every job writes its own element
+        vector<char> lexed(inputs.size());
+        runJobs(inputs.size(), jobs, [&](size_t i) {
+            lexed[i] = lexSourceFile(inputs[i]->source);
+        });
+        compileStats.endPhase();
+        if(find(lexed.begin(), lexed.end(), 0) != lexed.end()) {
+            return 1;
+        }
+        return finish();
     }
 
-    LLVMCodeGenerator codeGenerator(&context);
-    codeGenerator.generateCode(compileUnit);
+    //the parser pulls its tokens from the lexer, so this includes lexing. Every file has its own scanner, parser
+    //and arena
+    compileStats.startPhase("parse");
+    vector<char> parsed(inputs.size());
+    runJobs(inputs.size(), jobs, [&](size_t i) {
+        parsed[i] = parseSourceFile(inputs[i]->source);
+    });
+    compileStats.endPhase();
+    if(find(parsed.begin(), parsed.end(), 0) != parsed.end()) {
+        return 1;
+    }
+    compileStats.addCount("AST nodes", ASTNode::count());
+    compileStats.addCount("interned symbols", Symbol::getNumSymbols());
+
+    if(stopAfter == PHASE_PARSE) {
+        return finish();
+    }
+
+    compileStats.startPhase("sema");
+    for(unique_ptr<Input>& input : inputs) {
+        input->semPass.reset(new SemPass(context, input->source));
+    }
+    if(inputs.size() == 1) {
+        inputs[0]->semPass->doSemPass();
+    } else {
+        //every file's classes and their members are declared before any body is checked
+        for(unique_ptr<Input>& input : inputs) {
+            input->semPass->declareClasses();
+        }
+        for(unique_ptr<Input>& input : inputs) {
+            input->semPass->declareMembers();
+        }
+
+        //from here on the classes are only read, also their lazily computed layouts
+        for(unique_ptr<Input>& input : inputs) {
+            for(NClassDeclaration* classDeclaration : input->source.compileUnit->classes) {
+                cast<StapleClass>(context.typeTable[classDeclaration])->getLayout();
+            }
+        }
+        //checking a node adds at most one node, a load, or a slice for a coerced array, so twice the nodes so far
+        //bound the side table while the files are checked in parallel. Fixed, a node past that aborts rather than
+        //growing the table under the other threads
+        context.typeTable.reserve(2 * ASTNode::count());
+        context.typeTable.setFixed(true);
+
+        runJobs(inputs.size(), jobs, [&](size_t i) {
+            inputs[i]->semPass->checkBodies();
+        });
+        context.typeTable.setFixed(false);
+    }
+    compileStats.endPhase();
+
+    for(unique_ptr<Input>& input : inputs) {
+        if(input->semPass->hasErrors()) {
+            return 1;
+        }
+    }
+
+    set<StapleType*> types;
+    uint64_t typedNodes = 0;
+    context.typeTable.forEach([&](StapleType* type) {
+        if(type != NULL) {
+            types.insert(type);
+            typedNodes++;
+        }
+    });
+    size_t arenaBytes = context.arena.getBytesAllocated();
+    for(unique_ptr<Input>& input : inputs) {
+        arenaBytes += input->source.arena.getBytesAllocated();
+    }
+    compileStats.addCount("typed AST nodes", typedNodes);
+    compileStats.addCount("distinct types", types.size());
+    compileStats.addCount("interned composite types", context.types.getNumTypes());
+    compileStats.addCount("classes", context.numClasses());
+    compileStats.addCount("arena bytes", arenaBytes);
+
+    if(stopAfter == PHASE_SEMA) {
+        return finish();
+    }
+
+    //the modules of all files, or of all parts of the split ones
+    auto getModules = [&]() -> vector<Module*> {
+        vector<Module*> retval;
+        for(unique_ptr<Input>& input : inputs) {
+            if(input->splitModule) {
+                vector<Module*> parts = input->splitModule->getModules();
+                retval.insert(retval.end(), parts.begin(), parts.end());
+            } else {
+                retval.push_back(input->codeGenerator->getModule());
+            }
+        }
+        return retval;
+    };
+
+    compileStats.startPhase("codegen");
+    //made on this thread, the first one resolves the target for the others
+    for(unique_ptr<Input>& input : inputs) {
+        input->llvmContext.reset(new LLVMContext());
+        input->codeGenerator.reset(new LLVMCodeGenerator(&context, *input->llvmContext, input->source.filename));
+    }
+    {
+        //the AST side table is only read from here on, it must not grow while the files are generated
+        context.typeTable.reserve(ASTNode::count());
+        context.typeTable.setFixed(true);
+
+        vector<string> errors(inputs.size());
+        runJobs(inputs.size(), jobs, [&](size_t i) {
+            inputs[i]->codeGenerator->generateCode(inputs[i]->source.compileUnit, codegenThreads, errors[i]);
+        });
+        context.typeTable.setFixed(false);
+        if(!reportErrors(errors)) {
+            return 1;
+        }
+    }
+    compileStats.endPhase();
+    countModules(compileStats, getModules(), "LLVM ");
+
+    if(stopAfter == PHASE_CODEGEN) {
+        return finish();
+    }
+
+    //--split-module: nothing to gain for an unoptimized module written as LLVM assembly
+    auto split = [&](Input& input, string& error) -> bool {
+        input.splitModule.reset(new SplitModule(&context));
+        return input.splitModule->split(*input.codeGenerator->getModule(), splitParts, error);
+    };
+
+    if(context.optLevel > 0) {
+        //the pass managers time every pass into LLVM's timer groups, collected below. The groups are not thread safe
+        TimePassesIsEnabled = (timeReport || !statsJson.empty()) && splitParts == 1 && inputs.size() == 1;
+
+        OptRemarks optRemarks(&context);
+        {
+            string error;
+            if(!optRemarks.init(error)) {
+                fprintf(stderr, "%s\n", error.c_str());
+                return 1;
+            }
+        }
+
+        compileStats.startPhase("optimize");
+        vector<string> errors(inputs.size());
+        //remarks come out in the order the files are given
+        runJobs(inputs.size(), remarks ? 1 : jobs, [&](size_t i) {
+            Input& input = *inputs[i];
+            if(splitParts > 1) {
+                if(split(input, errors[i])) {
+                    input.splitModule->optimize();
+                }
+            } else {
+                input.codeGenerator->optimize(optRemarks);
+            }
+        });
+        compileStats.endPhase();
+        if(!reportErrors(errors)) {
+            return 1;
+        }
+        countModules(compileStats, getModules(), "optimized LLVM ");
+
+        if(TimePassesIsEnabled) {
+            string passReport;
+            raw_string_ostream passReportStream(passReport);
+            TimerGroup::printAll(passReportStream);
+            compileStats.setPassReport(passReportStream.str());
+        }
+    }
+
+    if(stopAfter == PHASE_OPTIMIZE) {
+        return finish();
+    }
 
     //CodeGenContext codeGen(context);
     //codeGen.generateCode(*compileUnit);
 
-    std::string errorCode;
-    raw_fd_ostream output(context.outputFilename.c_str(), errorCode, sys::fs::OpenFlags::F_None);
+    compileStats.startPhase("emit");
+    {
+        vector<string> errors(inputs.size());
+        runJobs(inputs.size(), jobs, [&](size_t i) {
+            Input& input = *inputs[i];
+            string& error = errors[i];
+            if(emitObject) {
+                if(splitParts > 1 && !input.splitModule && !split(input, error)) {
+                    return;
+                }
+
+                if(input.splitModule) {
+                    input.splitModule->emitObject(input.outputFilename, error);
+                } else {
+                    input.codeGenerator->emitObject(input.outputFilename, error);
+                }
+            } else {
+                unique_ptr<Module> merged;
+                if(input.splitModule) {
+                    merged = input.splitModule->merge(*input.llvmContext, error);
+                    if(!merged) {
+                        return;
+                    }
+                }
 
-    codeGenerator.getModule()->print(output, NULL);
+                std::string errorCode;
+                raw_fd_ostream output(input.outputFilename.c_str(), errorCode, sys::fs::OpenFlags::F_None);
+                if(!errorCode.empty()) {
+                    error = "cannot open " + input.outputFilename + ": " + errorCode;
+                    return;
+                }
+
+                (merged ? merged.get() : input.codeGenerator->getModule())->print(output, NULL);
+            }
+        });
+        if(!reportErrors(errors)) {
+            return 1;
+        }
+    }
+    compileStats.endPhase();
 
     /**
     * could also output to llvm bitcode using:
@@ -123,5 +600,5 @@ int main(int argc, char **argv)
     *   WriteBitcodeToFile
     */
 
-    return 0;
+    return finish();
 }
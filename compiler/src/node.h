@@ -2,14 +2,21 @@
 #define SNODE_H_
 
 
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include "parser.hpp"
+#include "builtins.h"
+#include "symbol.h"
 
 namespace staple {
 
 class CodeGenContext;
+class StapleMethodFunction;
 
 class ASTNode;
 class ASTVisitor;
@@ -27,6 +34,7 @@ class NAssignment;
 class NArrayElementPtr;
 class NIdentifier;
 class NIntLiteral;
+class NFloatLiteral;
 class NBlock;
 class NArgument;
 class NFunctionPrototype;
@@ -35,11 +43,14 @@ class NFunctionCall;
 class NExpressionStatement;
 class NStringLiteral;
 class NNew;
+class NNewArray;
+class NArraySlice;
 class NSizeOf;
 class NLoad;
 class NMethodFunction;
 class NMethodCall;
 class NIfStatement;
+class NForeach;
 class NBinaryOperator;
 
 typedef std::vector<NStatement*> StatementList;
@@ -51,11 +62,80 @@ class ASTNode {
 public:
     YYLTYPE location;
     std::vector<ASTNode*> children;
+    //dense index into NodeMap side tables, in order of creation. 0 is never used, so null nodes have a slot too
+    unsigned id;
+
+    ASTNode() : id(++count()) {}
+    //copies are nodes of their own and must not share the side table slots of the original
+    ASTNode(const ASTNode& other) : location(other.location), children(other.children), id(++count()) {}
+    ASTNode& operator=(const ASTNode& other) {
+        location = other.location;
+        children = other.children;
+        return *this;
+    }
     virtual ~ASTNode() {}
+
+    //nodes created so far, the highest id. Atomic, files are parsed and checked on several threads
+    static std::atomic<unsigned>& count() {
+        static std::atomic<unsigned> nodes(0);
+        return nodes;
+    }
     virtual void accept(ASTVisitor* visitor) {}
 
 };
 
+/**
+ * per node values indexed by ASTNode::id, in place of map<ASTNode*, T>. Like map's operator[], a node that was
+ * never set reads as T(). Slots live in fixed size chunks that never move, so a reference stays valid while nodes
+ * created later grow the table, i.e. in typeTable[node] = getType(child).
+ */
+template<typename T>
+class NodeMap {
+private:
+    enum { CHUNK_BITS = 10, CHUNK_SIZE = 1 << CHUNK_BITS };
+    std::vector<std::unique_ptr<T[]>> mChunks;
+    bool mFixed = false;
+
+public:
+    T& operator[](const ASTNode* node) {
+        unsigned id = node != NULL ? node->id : 0;
+        size_t chunk = id >> CHUNK_BITS;
+        while(chunk >= mChunks.size()) {
+            if(mFixed) {
+                fprintf(stderr, "internal error: node %u is past the reserved side table\n", id);
+                abort();
+            }
+            mChunks.emplace_back(new T[CHUNK_SIZE]());
+        }
+        return mChunks[chunk][id & (CHUNK_SIZE - 1)];
+    }
+
+    //makes the slots of nodes up to id, after which reading the table from several threads never grows it
+    void reserve(unsigned id) {
+        while((id >> CHUNK_BITS) >= mChunks.size()) {
+            mChunks.emplace_back(new T[CHUNK_SIZE]());
+        }
+    }
+
+    /**
+     * while fixed the table is shared between threads and must not grow, a node past the reserved slots aborts
+     * instead of racing the other threads' lookups
+     */
+    void setFixed(bool fixed) {
+        mFixed = fixed;
+    }
+
+    //calls function with every slot, including the ones never set
+    template<typename Function>
+    void forEach(Function function) const {
+        for(const std::unique_ptr<T[]>& chunk : mChunks) {
+            for(size_t i = 0; i < CHUNK_SIZE; i++) {
+                function(chunk[i]);
+            }
+        }
+    }
+};
+
 
 #define ACCEPT virtual void accept(ASTVisitor* visitor) { visitor->visit(this); }
 #define VISIT(x) virtual void visit(x* field) {}
@@ -80,26 +160,57 @@ public:
     VISIT(NArrayElementPtr)
     VISIT(NIdentifier)
     VISIT(NIntLiteral)
+    VISIT(NFloatLiteral)
     VISIT(NStringLiteral)
     VISIT(NMemberAccess)
     VISIT(NFunctionCall)
     VISIT(NExpressionStatement)
     VISIT(NNew)
+    VISIT(NNewArray)
+    VISIT(NArraySlice)
     VISIT(NSizeOf)
     VISIT(NLoad)
     VISIT(NMethodFunction)
     VISIT(NMethodCall)
     VISIT(NIfStatement)
+    VISIT(NForeach)
     VISIT(NBinaryOperator)
     VISIT(NBlock)
     VISIT(NFunctionPrototype)
 };
 
 
+/**
+ * Matches a node of type T without RTTI. Returns nullptr if node is not a T.
+ */
+template<typename T>
+class NodeMatcher : public ASTVisitor {
+public:
+    T* match;
+
+    NodeMatcher() : match(nullptr) {}
+
+    using ASTVisitor::visit;
+
+    void visit(T* node) {
+        match = node;
+    }
+};
+
+template<typename T>
+T* matchNode(ASTNode* node) {
+    NodeMatcher<T> matcher;
+    node->accept(&matcher);
+    return matcher.match;
+}
+
+
 class NType : public ASTNode {
 public:
     std::string name;
     bool isArray;
+    bool isSlice;
+    bool isSoa; // struct-of-arrays layout, only valid for arrays of classes
     union {
         int numPointers;
         int size;
@@ -107,18 +218,19 @@ public:
 
     ACCEPT
 
-    static NType* GetPointerType(const std::string& name, int numPtrs);
-    static NType* GetArrayType(const std::string& name, int size);
+    static NType* GetPointerType(Arena& arena, const std::string& name, int numPtrs);
+    static NType* GetArrayType(Arena& arena, const std::string& name, int size, bool isSoa = false);
+    static NType* GetSliceType(Arena& arena, const std::string& name);
 
 };
 
 class NField : public ASTNode {
 public:
     ACCEPT
-    const std::string name;
+    const Symbol name;
     NType type;
 
-    NField(const NType& type, const std::string& name)
+    NField(const NType& type, Symbol name)
     : type(type), name(name)
     {}
 
@@ -213,47 +325,56 @@ public:
 class NIdentifier : public NExpression {
 public:
     ACCEPT
-    std::string name;
-    NIdentifier(const std::string& name) : name(name) { }
+    Symbol name;
+    //bound by the semantic pass to the NVariableDeclaration, NArgument, NForeach, NFunctionPrototype or NField
+    //declaring name, or the enclosing NMethodFunction for "this". Fields of the enclosing class also get their slot
+    //in fieldIndex, which is -1 for everything else.
+    ASTNode* declaration;
+    int fieldIndex;
+    NIdentifier(Symbol name) : name(name), declaration(nullptr), fieldIndex(-1) { }
 };
 
 class NArgument : public ASTNode {
 public:
     ACCEPT
     NType type;
-    std::string name;
+    Symbol name;
 
     NArgument(const NType& type)
      : type(type) {}
 
-    NArgument(const NType& type, const std::string& name)
+    NArgument(const NType& type, Symbol name)
     : type(type), name(name) {}
 };
 
 class NFunctionCall : public NExpression {
 public:
     ACCEPT
-    std::string name;
+    Symbol name;
     ExpressionList arguments;
-    NFunctionCall(const std::string& name, ExpressionList& arguments)
-    : name(name), arguments(arguments) { }
-    NFunctionCall(const std::string& name)
-    : name(name) { }
+    Builtin builtin;
+    //NFunctionPrototype of the callee, bound by the semantic pass. NULL for builtins.
+    ASTNode* declaration;
+    NFunctionCall(Symbol name, ExpressionList& arguments)
+    : name(name), arguments(arguments), builtin(BI_None), declaration(nullptr) { }
+    NFunctionCall(Symbol name)
+    : name(name), builtin(BI_None), declaration(nullptr) { }
 
 };
 
 class NMethodCall : public NExpression {
 public:
     ACCEPT
-    std::string name;
+    Symbol name;
     ExpressionList arguments;
     NExpression* base;
 
-    int methodIndex;
+    //bound by the semantic pass: the most derived method of the base's static type, called directly
+    StapleMethodFunction* method;
 
 
-    NMethodCall(NExpression* base, const std::string& name, const ExpressionList& arguments)
-    : base(base), name(name), arguments(arguments), methodIndex(-1) {}
+    NMethodCall(NExpression* base, Symbol name, const ExpressionList& arguments)
+    : base(base), name(name), arguments(arguments), method(nullptr) {}
 
 };
 
@@ -262,9 +383,10 @@ public:
     ACCEPT
     NExpression* base;
     NExpression* expr;
+    bool checkBounds; // cleared by the semantic pass when the index is provably in range
 
     NArrayElementPtr(NExpression* id, NExpression* expr)
-    : base(id), expr(expr) {}
+    : base(id), expr(expr), checkBounds(true) {}
 
 
 };
@@ -280,6 +402,31 @@ public:
 
 };
 
+class NNewArray : public NExpression {
+public:
+    ACCEPT
+    NType* type;
+    NExpression* size;
+
+    NNewArray(NType* type, NExpression* size)
+    : type(type), size(size) {}
+
+};
+
+/**
+ * Implicit conversion of a fixed size array to a slice over all of its elements.
+ * Inserted by the semantic pass, expr is the address of the array.
+ */
+class NArraySlice : public NExpression {
+public:
+    ACCEPT
+    NExpression* expr;
+
+    NArraySlice(NExpression* expr)
+    : expr(expr) {}
+
+};
+
 class NSizeOf : public NExpression {
 public:
     ACCEPT
@@ -304,8 +451,8 @@ class NMemberAccess : public NExpression {
 public:
     ACCEPT
     NExpression* base;
-    std::string field;
-    NMemberAccess(NExpression* base, const std::string& field)
+    Symbol field;
+    NMemberAccess(NExpression* base, Symbol field)
     : base(base), field(field) {}
 
 
@@ -381,6 +528,22 @@ public:
 
 };
 
+/**
+ * foreach (var in start..end) body
+ * iterations may run in any order or in parallel, so they must not depend on each other.
+ */
+class NForeach : public NStatement {
+public:
+    ACCEPT
+    Symbol var;
+    NExpression* start;
+    NExpression* end;
+    NStatement* body;
+
+    NForeach(Symbol var, NExpression* start, NExpression* end, NStatement* body)
+    : var(var), start(start), end(end), body(body) {}
+};
+
 class NExpressionStatement : public NStatement {
 public:
     ACCEPT
@@ -394,11 +557,11 @@ class NVariableDeclaration : public NStatement {
 public:
     ACCEPT
     NType* type;
-    std::string name;
+    Symbol name;
     NExpression* assignmentExpr;
-    NVariableDeclaration(NType* type, const std::string& name) :
-        type(type), name(name) {}
-    NVariableDeclaration(NType* type, const std::string& name, NExpression *assignmentExpr) :
+    NVariableDeclaration(NType* type, Symbol name) :
+        type(type), name(name), assignmentExpr(nullptr) {}
+    NVariableDeclaration(NType* type, Symbol name, NExpression *assignmentExpr) :
         type(type), name(name), assignmentExpr(assignmentExpr) {}
 
 
@@ -408,13 +571,17 @@ class NFunctionPrototype : public ASTNode {
 public:
     ACCEPT
     NType returnType;
-    const std::string name;
+    const Symbol name;
     std::vector<NArgument*> arguments;
     const bool isVarg;
 
-    NFunctionPrototype(const NType& type, const std::string& name,
+    //bound by the semantic pass: the Staple function of this compile an extern prototype declares, possibly in
+    //another file. NULL for a C function, which keeps its plain symbol
+    NFunctionPrototype* definition;
+
+    NFunctionPrototype(const NType& type, Symbol name,
             const std::vector<NArgument*>& arguments, bool isVarg) :
-            returnType(type), name(name), arguments(arguments), isVarg(isVarg) {}
+            returnType(type), name(name), arguments(arguments), isVarg(isVarg), definition(nullptr) {}
 
 
 };
@@ -424,8 +591,11 @@ public:
     ACCEPT
     NBlock block;
 
+    //target_clones("avx2", "default"): one copy per cpu feature list, picked at startup
+    std::vector<std::string> targetClones;
+
 
-    NFunction(const NType& type, const std::string& name,
+    NFunction(const NType& type, Symbol name,
             const std::vector<NArgument*>& arguments, bool isVarg,
             const NBlock& block)
             : NFunctionPrototype(type, name, arguments, isVarg), block(block) {
@@ -441,7 +611,7 @@ public:
     NBlock block;
 
 
-    NMethodFunction(const NType& type, const std::string& name,
+    NMethodFunction(const NType& type, Symbol name,
             const std::vector<NArgument*>& arguments, bool isVarg,
             const NBlock& block)
             : NFunctionPrototype(type, name, arguments, isVarg), block(block) { }
@@ -3,44 +3,47 @@
 #include "node.h"
 using namespace staple;
 
-NCompileUnit *compileUnit; /* the top level root node of our final AST */
-
-extern int yylex();
-
 #define YYDEBUG 1
 
-extern int yylineno;
-extern char* yytext;
-
-void yyerror(const char *s)
+NType* NType::GetPointerType(Arena& arena, const std::string& name, int numPtrs)
 {
-    printf("%d: %s at: %s\n", yylineno, s, yytext);
-    exit(-1);
-}
-
-NType* NType::GetPointerType(const std::string& name, int numPtrs)
-{
-	NType* retval = new NType();
+	NType* retval = arena.make<NType>();
 	retval->name = name;
 	retval->isArray = false;
+	retval->isSlice = false;
+	retval->isSoa = false;
 	retval->numPointers = numPtrs;
 	return retval;
 }
 
-NType* NType::GetArrayType(const std::string& name, int size)
+NType* NType::GetArrayType(Arena& arena, const std::string& name, int size, bool isSoa)
 {
-	NType* retval = new NType();
+	NType* retval = arena.make<NType>();
 	retval->name = name;
 	retval->isArray = true;
+	retval->isSlice = false;
+	retval->isSoa = isSoa;
 	retval->size = size;
 	return retval;
 }
 
+NType* NType::GetSliceType(Arena& arena, const std::string& name)
+{
+	NType* retval = arena.make<NType>();
+	retval->name = name;
+	retval->isArray = false;
+	retval->isSlice = true;
+	retval->isSoa = false;
+	retval->size = 0;
+	return retval;
+}
+
 %}
 
 %code requires {
 
-extern char *filename; /* current filename here for the lexer */
+#include "arena.h"
+#include "symbol.h"
 
 #if ! defined YYLTYPE && ! defined YYLTYPE_IS_DECLARED
 typedef struct YYLTYPE
@@ -104,12 +107,64 @@ class NMethodFunction;
 class NMethodCall;
 class NIfStatement;
 class NBinaryOperator;
+class SourceFile;
+
+/**
+ * state of one parse, shared by the reentrant lexer and parser in place of globals. Every parse has its own, so
+ * several files can be parsed at the same time.
+ */
+struct ParseContext {
+    /* owns the nodes and token strings */
+    Arena* arena;
+    /* of the file, for the locations */
+    char* filename;
+    /* of the next token, the line is the scanner's yylineno */
+    int column;
+    /* the top level root node of the AST */
+    NCompileUnit* compileUnit;
+    /* reported by the lexer, which skips the bad character and goes on. The parse fails if there are any */
+    int numErrors;
+};
+
+}
 
 }
 
+%code provides {
+
+namespace staple {
+
+/**
+ * parses the file of source into source.compileUnit, allocating in source.arena. False when the file cannot be read
+ * or has a lexical or syntax error, which is printed. Safe to call for different files on several threads.
+ */
+bool parseSourceFile(SourceFile& source);
+
+/* runs the lexer alone over the file of source, for --stop-after=lex. False on an unknown token */
+bool lexSourceFile(SourceFile& source);
+
+}
+
+}
+
+%code {
+
+int yylex(YYSTYPE* lvalp, YYLTYPE* llocp, void* scanner);
+char* yyget_text(void* scanner);
+
+void yyerror(YYLTYPE* location, void* scanner, ParseContext* context, const char *s)
+{
+    fprintf(stderr, "%s:%d:%d: error: %s at: %s\n", context->filename, location->first_line, location->first_column,
+            s, yyget_text(scanner));
+}
 
 }
 
+%define api.pure full
+%locations
+%lex-param { void* scanner }
+%parse-param { void* scanner } { staple::ParseContext* context }
+
 
 /* Represents the many different ways we can access our data */
 %union {
@@ -121,7 +176,9 @@ class NBinaryOperator;
     staple::NVariableDeclaration *var_decl;
     std::vector<staple::NVariableDeclaration*> *varvec;
     std::vector<staple::NExpression*> *exprvec;
+    std::vector<std::string> *strvec;
     std::string *string;
+    const staple::SymbolEntry *symbol;
     int token;
     staple::ASTNode *nodelist;
     staple::NClassDeclaration *class_decl;
@@ -138,9 +195,10 @@ class NBinaryOperator;
    match our tokens.l lex file. We also define the ASTNode type
    they represent.
  */
-%token <string> TIDENTIFIER TINTEGER TDOUBLE TSTRINGLIT
-%token <token> TCLASS TRETURN TSEMI TEXTERN TELLIPSIS TINCLUDE TEXTENDS
-%token <token> TIF TELSE TAT TNEW TSIZEOF TNOT
+%token <symbol> TIDENTIFIER
+%token <string> TINTEGER TDOUBLE TSTRINGLIT
+%token <token> TCLASS TRETURN TSEMI TEXTERN TELLIPSIS TINCLUDE TEXTENDS TSOA
+%token <token> TIF TELSE TAT TNEW TSIZEOF TNOT TFOREACH TDOTDOT TTARGETCLONES
 %token <token> TCEQ TCNE TCLT TCLE TCGT TCGE TEQUAL
 %token <token> TLPAREN TRPAREN TLBRACE TRBRACE TLBRACKET TRBRACKET TCOMMA TDOT
 %token <token> TPLUS TMINUS TMUL TDIV
@@ -154,6 +212,7 @@ class NBinaryOperator;
 %type <block> block stmts
 %type <expr> expr lhs compexpr multexpr addexpr ident literal unaryexpr primary base arrayindex
 %type <exprvec> expr_list
+%type <strvec> clone_targets
 %type <stmt> stmt stmtexpr var_decl
 %type <token> comparison
 %type <nodelist> class_members
@@ -176,24 +235,24 @@ class NBinaryOperator;
 %%
 
 compileUnit
-        : { compileUnit = new NCompileUnit(); }
+        : { context->compileUnit = context->arena->make<NCompileUnit>(); }
           includes program
         ;
 
 includes
-        : includes TINCLUDE package { compileUnit->mIncludes.push_back(*$3); delete $3; }
+        : includes TINCLUDE package { context->compileUnit->mIncludes.push_back(*$3); }
         |
         ;
 
 package
-        : TIDENTIFIER { $$ = new std::string(*$1); delete $1; }
-        | package TDOT TIDENTIFIER { (*$$)+="."; (*$$)+=*$3; delete $3;  }
+        : TIDENTIFIER { $$ = context->arena->make<std::string>($1->str); }
+        | package TDOT TIDENTIFIER { (*$$)+="."; (*$$)+=$3->str; }
         ;
 
 program
-        : program class_decl { compileUnit->classes.push_back($2); }
-        | program global_func { compileUnit->functions.push_back($2); }
-        | program proto_func { compileUnit->externFunctions.push_back($2); }
+        : program class_decl { context->compileUnit->classes.push_back($2); }
+        | program global_func { context->compileUnit->functions.push_back($2); }
+        | program proto_func { context->compileUnit->externFunctions.push_back($2); }
         |
         ;
 
@@ -201,14 +260,21 @@ program
 
 proto_func
         : TEXTERN type TIDENTIFIER TLPAREN proto_args ellipse_arg TRPAREN
-         { $$ = new NFunctionPrototype(*$2, *$3, *$5, $6); delete $3; delete $5; }
+         { $$ = context->arena->make<NFunctionPrototype>(*$2, $3, *$5, $6); }
         ;
 
 ////// Global Functions /////
 
 global_func
         : type TIDENTIFIER TLPAREN proto_args ellipse_arg TRPAREN block
-         { $$ = new NFunction(*$1, *$2, *$4, $5, *$7); delete $2; delete $4; $$->location = @$; }
+         { $$ = context->arena->make<NFunction>(*$1, $2, *$4, $5, *$7); $$->location = @$; }
+        | TTARGETCLONES TLPAREN clone_targets TRPAREN global_func
+         { $$ = $5; $$->targetClones = *$3; }
+        ;
+
+clone_targets
+        : TSTRINGLIT { $$ = context->arena->make<std::vector<std::string>>(); $$->push_back($1->substr(1, $1->length()-2)); }
+        | clone_targets TCOMMA TSTRINGLIT { $1->push_back($3->substr(1, $3->length()-2)); }
         ;
 
 
@@ -217,11 +283,11 @@ ellipse_arg
         | TELLIPSIS { $$ = true; }
 
 proto_args
-        : type { $$ = new std::vector<NArgument*>(); $$->push_back(new NArgument(*$1)); delete $1; }
-        | type TIDENTIFIER { $$ = new std::vector<NArgument*>(); $$->push_back(new NArgument(*$1, *$2)); delete $1; delete $2; }
-        | { $$ = new std::vector<NArgument*>(); }
-        | proto_args TCOMMA type { $1->push_back(new NArgument(*$3)); delete $3; }
-        | proto_args TCOMMA type TIDENTIFIER { $1->push_back(new NArgument(*$3, *$4)); delete $3; delete $4; }
+        : type { $$ = context->arena->make<std::vector<NArgument*>>(); $$->push_back(context->arena->make<NArgument>(*$1)); }
+        | type TIDENTIFIER { $$ = context->arena->make<std::vector<NArgument*>>(); $$->push_back(context->arena->make<NArgument>(*$1, $2)); }
+        | { $$ = context->arena->make<std::vector<NArgument*>>(); }
+        | proto_args TCOMMA type { $1->push_back(context->arena->make<NArgument>(*$3)); }
+        | proto_args TCOMMA type TIDENTIFIER { $1->push_back(context->arena->make<NArgument>(*$3, $4)); }
         | proto_args TCOMMA { /*for the ellipse*/ }
         ;
 
@@ -230,54 +296,64 @@ proto_args
 
 class_decl
         : TCLASS TIDENTIFIER extends TLBRACE class_members TRBRACE
-         { $$ = new NClassDeclaration(*$2, *$3, $5); delete $2; delete $3; delete $5; $$->location = @$; }
+         { $$ = context->arena->make<NClassDeclaration>($2->str, *$3, $5); $$->location = @$; }
         ;
 
 extends
-        : { $$ = new std::string("obj"); }
-        | TEXTENDS TIDENTIFIER { $$ = $2; delete $2; }
+        : { $$ = context->arena->make<std::string>("obj"); }
+        | TEXTENDS TIDENTIFIER { $$ = context->arena->make<std::string>($2->str); }
         ;
 
 class_members
         : class_members field { $1->children.push_back($2); }
         | class_members method { $1->children.push_back($2); }
-        | { $$ = new ASTNode(); }
+        | { $$ = context->arena->make<ASTNode>(); }
 
 field
-        : type TIDENTIFIER TSEMI { $$ = new NField(*$1, *$2); delete $1; delete $2; $$->location = @$; }
+        : type TIDENTIFIER TSEMI { $$ = context->arena->make<NField>(*$1, $2); $$->location = @$; }
         ;
 
 method
         : type TIDENTIFIER TLPAREN proto_args ellipse_arg TRPAREN block
-         { $$ = new NMethodFunction(*$1, *$2, *$4, $5, *$7); delete $2; delete $4; $$->location = @$; }
+         { $$ = context->arena->make<NMethodFunction>(*$1, $2, *$4, $5, *$7); $$->location = @$; }
         ;
 
 ///// Statements //////
 
 block
-        : TLBRACE stmts TRBRACE { $$ = $2; }
+        : TLBRACE stmts TRBRACE { $$ = $2; $$->location = @$; }
         ;
 
 stmts
         : stmts stmt { $1->statements.push_back($2); }
-        | { $$ = new NBlock(); }
+        | { $$ = context->arena->make<NBlock>(); }
         ;
 
 stmt    : stmtexpr TSEMI { $$ = $1; }
-        | TRETURN expr TSEMI { $$ = new NReturn($2); $$->location = @1; }
-        | TIF TLPAREN expr TRPAREN stmt { $$ = new NIfStatement($3, $5, NULL); $$->location = @$; } %prec "then"
-        | TIF TLPAREN expr TRPAREN stmt TELSE stmt { $$ = new NIfStatement($3, $5, $7); $$->location = @$; }
+        | TRETURN expr TSEMI { $$ = context->arena->make<NReturn>($2); $$->location = @1; }
+        | TIF TLPAREN expr TRPAREN stmt { $$ = context->arena->make<NIfStatement>($3, $5, nullptr); $$->location = @$; } %prec "then"
+        | TIF TLPAREN expr TRPAREN stmt TELSE stmt { $$ = context->arena->make<NIfStatement>($3, $5, $7); $$->location = @$; }
+        /* 'in' is only a keyword here, it stays usable as a name elsewhere */
+        | TFOREACH TLPAREN TIDENTIFIER TIDENTIFIER expr TDOTDOT expr TRPAREN stmt {
+              if(Symbol($4) != SYM_IN) {
+                  yyerror(&@4, scanner, context, "expected 'in'");
+                  YYERROR;
+              }
+              $$ = context->arena->make<NForeach>($3, $5, $7, $9); $$->location = @$;
+          }
         | block { $$ = $1; }
         ;
 
 
-var_decl : type TIDENTIFIER { $$ = new NVariableDeclaration($1, *$2); delete $2; $$->location = @2; }
-         | type TIDENTIFIER TEQUAL expr { $$ = new NVariableDeclaration($1, *$2, $4); delete $2; $$->location = @2; }
+var_decl : type TIDENTIFIER { $$ = context->arena->make<NVariableDeclaration>($1, $2); $$->location = @2; }
+         | type TIDENTIFIER TEQUAL expr { $$ = context->arena->make<NVariableDeclaration>($1, $2, $4); $$->location = @2; }
          ;
 
 type
-        : TIDENTIFIER numPointers { $$ = NType::GetPointerType(*$1, $2); delete $1; $$->location = @$; }
-        | TIDENTIFIER TLBRACKET TINTEGER TRBRACKET { $$ = NType::GetArrayType(*$1, atoi($3->c_str())); delete $1; delete $3; $$->location = @$; }
+        : TIDENTIFIER numPointers { $$ = NType::GetPointerType(*context->arena, $1->str, $2); $$->location = @$; }
+        | TIDENTIFIER TLBRACKET TINTEGER TRBRACKET { $$ = NType::GetArrayType(*context->arena, $1->str, atoi($3->c_str())); $$->location = @$; }
+        | TIDENTIFIER TLBRACKET TRBRACKET { $$ = NType::GetSliceType(*context->arena, $1->str); $$->location = @$; }
+        | TSOA TIDENTIFIER TLBRACKET TINTEGER TRBRACKET { $$ = NType::GetArrayType(*context->arena, $2->str, atoi($4->c_str()), true); $$->location = @$; }
         ;
 
 numPointers
@@ -286,36 +362,37 @@ numPointers
         ;
 
 ident
-        : TIDENTIFIER { $$ = new NIdentifier(*$1); delete $1; $$->location = @$; }
+        : TIDENTIFIER { $$ = context->arena->make<NIdentifier>($1); $$->location = @$; }
         ;
 
-literal : TINTEGER { $$ = new NIntLiteral(*$1); delete $1; $$->location = @$; }
-        | TDOUBLE { $$ = new NFloatLiteral(*$1); delete $1; $$->location = @$; }
-        | TSTRINGLIT { std::string tmp = $1->substr(1, $1->length()-2); $$ = new NStringLiteral(tmp); delete $1; $$->location = @$; }
+literal : TINTEGER { $$ = context->arena->make<NIntLiteral>(*$1); $$->location = @$; }
+        | TDOUBLE { $$ = context->arena->make<NFloatLiteral>(*$1); $$->location = @$; }
+        | TSTRINGLIT { std::string tmp = $1->substr(1, $1->length()-2); $$ = context->arena->make<NStringLiteral>(tmp); $$->location = @$; }
         ;
 
 
 stmtexpr
         : var_decl
-        | TIDENTIFIER TLPAREN expr_list TRPAREN { NFunctionCall* fcall = new NFunctionCall(*$1, *$3); fcall->location = @1; $$ = new NExpressionStatement(fcall); delete $1; delete $3; $$->location = @$; }
-        | lhs TEQUAL expr { $$ = new NAssignment($1, $3); $$->location = @$; }
+        | TIDENTIFIER TLPAREN expr_list TRPAREN { NFunctionCall* fcall = context->arena->make<NFunctionCall>($1, *$3); fcall->location = @1; $$ = context->arena->make<NExpressionStatement>(fcall); $$->location = @$; }
+        | lhs TEQUAL expr { $$ = context->arena->make<NAssignment>($1, $3); $$->location = @$; }
         ;
 
 lhs
         : ident
-        | lhs TDOT TIDENTIFIER { $$ = new NMemberAccess($1, *$3); delete $3; $$->location = @$; }
+        | lhs TDOT TIDENTIFIER { $$ = context->arena->make<NMemberAccess>($1, $3); $$->location = @$; }
         | lhs TDOT TIDENTIFIER TLPAREN expr_list TRPAREN
-        | lhs TAT arrayindex { $$ = new NArrayElementPtr($1, $3); $$->location = @$; } /* array access */
+        | lhs TAT arrayindex { $$ = context->arena->make<NArrayElementPtr>($1, $3); $$->location = @$; } /* array access */
         ;
 
 expr
-        : TSIZEOF type { $$ = new NSizeOf($2); $$->location = @$; }
-        | TNEW TIDENTIFIER { $$ = new NNew(*$2); delete $2; $$->location = @$; }
+        : TSIZEOF type { $$ = context->arena->make<NSizeOf>($2); $$->location = @$; }
+        | TNEW TIDENTIFIER { $$ = context->arena->make<NNew>($2->str); $$->location = @$; }
+        | TNEW TIDENTIFIER TLBRACKET expr TRBRACKET { NType* type = NType::GetPointerType(*context->arena, $2->str, 0); type->location = @2; $$ = context->arena->make<NNewArray>(type, $4); $$->location = @$; }
         | compexpr { $$ = $1; }
         ;
 
 compexpr
-        : addexpr comparison addexpr { $$ = new NBinaryOperator($1, $2, $3); $$->location = @$; }
+        : addexpr comparison addexpr { $$ = context->arena->make<NBinaryOperator>($1, $2, $3); $$->location = @$; }
         | addexpr { $$ = $1; }
         ;
 
@@ -323,19 +400,19 @@ comparison
         : TCEQ | TCNE | TCLT | TCLE | TCGT | TCGE
         ;
 
-addexpr : multexpr TPLUS multexpr { $$ = new NBinaryOperator($1, $2, $3); $$->location = @$; }
-        | multexpr TMINUS multexpr { $$ = new NBinaryOperator($1, $2, $3); $$->location = @$; }
+addexpr : multexpr TPLUS multexpr { $$ = context->arena->make<NBinaryOperator>($1, $2, $3); $$->location = @$; }
+        | multexpr TMINUS multexpr { $$ = context->arena->make<NBinaryOperator>($1, $2, $3); $$->location = @$; }
         | multexpr { $$ = $1; }
         ;
 
-multexpr : unaryexpr TMUL unaryexpr { $$ = new NBinaryOperator($1, $2, $3); $$->location = @$; }
-         | unaryexpr TDIV unaryexpr { $$ = new NBinaryOperator($1, $2, $3); $$->location = @$; }
+multexpr : unaryexpr TMUL unaryexpr { $$ = context->arena->make<NBinaryOperator>($1, $2, $3); $$->location = @$; }
+         | unaryexpr TDIV unaryexpr { $$ = context->arena->make<NBinaryOperator>($1, $2, $3); $$->location = @$; }
          | unaryexpr { $$ = $1; }
          ;
 
 unaryexpr
-        : TNOT primary { $$ = new NNot($2); $$->location = @$; }
-        | TMINUS primary { $$ = new NNegitive($2); $$->location = @$; }
+        : TNOT primary { $$ = context->arena->make<NNot>($2); $$->location = @$; }
+        | TMINUS primary { $$ = context->arena->make<NNegitive>($2); $$->location = @$; }
         | primary
         ;
 
@@ -343,28 +420,28 @@ primary
         : TLPAREN expr_list TRPAREN { if($2->size() == 1) { $$ = (*$2)[0]; } } %prec "order"
         | literal { $$ = $1; }
         | base { $$ = $1; }
-        | TIDENTIFIER TLPAREN expr_list TRPAREN { $$ = new NFunctionCall(*$1, *$3); delete $1; delete $3; $$->location = @$; }
+        | TIDENTIFIER TLPAREN expr_list TRPAREN { $$ = context->arena->make<NFunctionCall>($1, *$3); $$->location = @$; }
         | TLPAREN expr_list TRPAREN TMINUS TCGT stmt /* anonymous function */
         ;
 
 expr_list
-        : expr { $$ = new ExpressionList(); $$->push_back($1); }
+        : expr { $$ = context->arena->make<ExpressionList>(); $$->push_back($1); }
         | expr_list TCOMMA expr { $$->push_back($3); }
-        | { $$ = new ExpressionList(); }
+        | { $$ = context->arena->make<ExpressionList>(); }
         ;
 
 
 arrayindex
-        : ident { $$ = $1; }
-        | TINTEGER { $$ = new NIntLiteral(*$1); delete $1; $$->location = @$; }
+        : ident { $$ = context->arena->make<NLoad>($1); $$->location = @$; }
+        | TINTEGER { $$ = context->arena->make<NIntLiteral>(*$1); $$->location = @$; }
         | TLPAREN expr TRPAREN { $$ = $2; }
         ;
 
 base
-        : ident { $$ = new NLoad($1); $$->location = @$; }
-        | base TAT arrayindex { $$ = new NLoad(new NArrayElementPtr($1, $3)); $$->location = @$; }
-        | base TDOT TIDENTIFIER { $$ = new NLoad(new NMemberAccess($1, *$3)); delete $3; $$->location = @$; }
-        | base TDOT TIDENTIFIER TLPAREN expr_list TRPAREN { $$ = new NMethodCall($1, *$3, *$5); delete $3; delete $5; $$->location = @$; }
+        : ident { $$ = context->arena->make<NLoad>($1); $$->location = @$; }
+        | base TAT arrayindex { $$ = context->arena->make<NLoad>(context->arena->make<NArrayElementPtr>($1, $3)); $$->location = @$; }
+        | base TDOT TIDENTIFIER { $$ = context->arena->make<NLoad>(context->arena->make<NMemberAccess>($1, $3)); $$->location = @$; }
+        | base TDOT TIDENTIFIER TLPAREN expr_list TRPAREN { $$ = context->arena->make<NMethodCall>($1, $3, *$5); $$->location = @$; }
         ;
 
 
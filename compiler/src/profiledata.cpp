@@ -0,0 +1,53 @@
+#include "profiledata.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace staple {
+
+    bool ProfileData::load(const string& filename, string& error) {
+        ifstream input(filename.c_str());
+        if(!input) {
+            error = "cannot open profile: " + filename;
+            return false;
+        }
+
+        string line;
+        int lineNumber = 0;
+        while(getline(input, line)) {
+            lineNumber++;
+            if(line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            stringstream fields(line);
+            ProfileSite site;
+            int kind;
+            uint64_t count;
+            if(!(fields >> site.function >> site.line >> site.column >> kind >> count)) {
+                stringstream message;
+                message << filename << ":" << lineNumber << ": malformed profile entry";
+                error = message.str();
+                return false;
+            }
+
+            //several copies of the same code (target_clones versions) and repeated runs share a site
+            uint64_t& total = mCounts[site];
+            total += count;
+            if(kind == PS_FunctionEntry && total > mMaxFunctionCount) {
+                mMaxFunctionCount = total;
+            }
+        }
+        return true;
+    }
+
+    bool ProfileData::getCount(const ProfileSite& site, uint64_t& count) const {
+        auto it = mCounts.find(site);
+        if(it == mCounts.end()) {
+            return false;
+        }
+        count = it->second;
+        return true;
+    }
+
+}
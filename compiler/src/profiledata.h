@@ -0,0 +1,57 @@
+#ifndef STAPLE_PROFILEDATA_H
+#define STAPLE_PROFILEDATA_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace staple {
+
+    using namespace std;
+
+    /**
+     * a counted node: the symbol of the function it is in plus its source location. Counts stay attached to
+     * their code when other functions change.
+     */
+    struct ProfileSite {
+        string function;
+        int line;
+        int column;
+
+        bool operator<(const ProfileSite& other) const {
+            if(function != other.function) {
+                return function < other.function;
+            }
+            return line != other.line ? line < other.line : column < other.column;
+        }
+    };
+
+    enum ProfileSiteKind {
+        PS_FunctionEntry = 0,
+        PS_Block = 1
+    };
+
+    /**
+     * execution counts written by a program compiled with --profile-generate. One site per line:
+     * <function> <line> <column> <kind> <count>
+     */
+    class ProfileData {
+    private:
+        map<ProfileSite, uint64_t> mCounts;
+        uint64_t mMaxFunctionCount;
+
+    public:
+        ProfileData() : mMaxFunctionCount(0) {}
+
+        bool load(const string& filename, string& error);
+        bool empty() const { return mCounts.empty(); }
+
+        bool getCount(const ProfileSite& site, uint64_t& count) const;
+
+        //highest function entry count, the reference for hot and cold functions
+        uint64_t getMaxFunctionCount() const { return mMaxFunctionCount; }
+    };
+
+}
+
+#endif //STAPLE_PROFILEDATA_H
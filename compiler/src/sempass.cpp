@@ -1,4 +1,6 @@
 #include <cstdarg>
+#include <set>
+#include <sstream>
 
 #include "node.h"
 #include "types/stapletype.h"
@@ -6,6 +8,8 @@
 #include "sempass.h"
 #include "sempass/Pass1ClassVisitor.h"
 
+#include <llvm/ADT/DenseMap.h>
+
 namespace staple {
 
 using namespace std;
@@ -18,17 +22,97 @@ if(type == NULL) { \
     positive \
 }
 
+/**
+ * builtin scalar type names, NULL if name is not a scalar type
+ */
+static StapleType* getScalarType(const string& name) {
+    StapleType* retval = NULL;
+    if(name.compare("void") == 0) {
+        retval = StapleType::getVoidType();
+    } else if(name.compare("uint") == 0 || name.compare("int") == 0 || name.compare("int32") == 0 || name.compare("uint32") == 0){
+        retval = StapleType::getInt32Type();
+    } else if(name.compare("uint8") == 0 || name.compare("int8") == 0) {
+        retval = StapleType::getInt8Type();
+    } else if(name.compare("uint16") == 0 || name.compare("int16") == 0) {
+        retval = StapleType::getInt16Type();
+    } else if(name.compare("uint64") == 0 || name.compare("int64") == 0) {
+        retval = StapleType::getInt64Type();
+    } else if(name.compare("float") == 0 || name.compare("float32") == 0) {
+        retval = StapleType::getFloat32Type();
+    } else if(name.compare("float64") == 0) {
+        retval = StapleType::getFloat64Type();
+    } else if(name.compare("bool") == 0) {
+        retval = StapleType::getBoolType();
+    }
+    return retval;
+}
+
+static bool isValidNumLanes(long numLanes) {
+    return numLanes >= 2 && numLanes <= 64 && (numLanes & (numLanes - 1)) == 0;
+}
+
+/**
+ * SIMD vector type names are <scalar>x<lanes>, i.e. float32x4, int32x8 or uint8x16.
+ * NULL if name is not a vector type
+ */
+static StapleType* getVectorType(const string& name, TypeContext& types) {
+    size_t pos = name.find_last_of('x');
+    if(pos == string::npos || pos + 1 >= name.size()) {
+        return NULL;
+    }
+
+    StapleType* elementType = getScalarType(name.substr(0, pos));
+    if(elementType == NULL || elementType == StapleType::getVoidType() || elementType == StapleType::getBoolType()) {
+        return NULL;
+    }
+
+    char* end;
+    long numLanes = strtol(name.c_str() + pos + 1, &end, 10);
+    if(*end != '\0' || !isValidNumLanes(numLanes)) {
+        return NULL;
+    }
+
+    bool isUnsigned = name[0] == 'u' && isa<StapleInt>(elementType);
+    return types.getVectorType(elementType, numLanes, isUnsigned);
+}
+
+/**
+ * cpu features the runtime can detect when picking a target_clones version
+ */
+static bool isCloneFeature(const string& name) {
+    static const set<string> features{
+            "sse3", "ssse3", "sse4.1", "sse4.2", "popcnt", "avx", "avx2", "fma", "bmi", "bmi2", "f16c",
+            "avx512f", "avx512dq", "avx512cd", "avx512bw", "avx512vl"
+    };
+    return features.find(name) != features.end();
+}
+
+/**
+ * what a name refers to: its type and declaring node, plus the slot for fields of the enclosing class
+ */
+struct Binding {
+    StapleType* type;
+    ASTNode* declaration;
+    int fieldIndex;
+};
+
+/**
+ * names defined in one block, keyed by symbol id
+ */
 class Scope {
 public:
     Scope* parent;
-    map<string, StapleType*> table;
+    SmallDenseMap<unsigned, Binding, 8> table;
 
-    StapleType* get(const string& name) {
-        StapleType* retval = NULL;
+    /**
+     * innermost binding of name, NULL if undefined
+     */
+    Binding* get(Symbol name) {
+        Binding* retval = NULL;
 
-        map<string, StapleType*>::iterator it;
-        if((it = table.find(name)) != table.end()) {
-            retval = it->second;
+        auto it = table.find(name.getId());
+        if(it != table.end()) {
+            retval = &it->second;
         } else if(parent != NULL) {
             retval = parent->get(name);
         }
@@ -37,16 +121,45 @@ public:
     }
 };
 
+/**
+ * identifier named by expr, looking through a load
+ */
+static NIdentifier* getIdentifier(NExpression* expr) {
+    if(NLoad* load = matchNode<NLoad>(expr)) {
+        expr = load->expr;
+    }
+    return matchNode<NIdentifier>(expr);
+}
+
+/**
+ * range of an enclosing foreach. The index is read only, so when the range starts at a constant and ends at len(array)
+ * of an array that is not reassigned in the body, indexing that array by it never needs a bounds check.
+ */
+struct ForeachRange {
+    NForeach* foreach;
+    //declaration of the array, NULL when the range is not len(array)
+    ASTNode* array;
+    long constEnd;
+    bool arrayAssigned;
+    vector<NArrayElementPtr*> accesses;
+};
+
 
 class TypeVisitor : public ASTVisitor {
 public:
     StapleFunction* mCurrentFunctionType;
     StapleClass *currentClass;
+    NClassDeclaration* currentClassDeclaration;
     Scope* scope;
     SemPass* sempass;
+    vector<ForeachRange> foreachRanges;
+    //scope whose exit frees the storage of a local array, or the storage a local slice refers to
+    DenseMap<ASTNode*, Scope*> arrayOwners;
 
     TypeVisitor(SemPass* sempass)
-    : scope(NULL)
+    : currentClass(NULL)
+    , currentClassDeclaration(NULL)
+    , scope(NULL)
     , sempass(sempass) {}
 
     using ASTVisitor::visit;
@@ -63,8 +176,79 @@ public:
         delete oldScope;
     }
 
-    void define(const string& name, StapleType* type) {
-        scope->table[name] = type;
+    void define(Symbol name, StapleType* type, ASTNode* declaration, int fieldIndex = -1) {
+        scope->table[name.getId()] = Binding{type, declaration, fieldIndex};
+    }
+
+    /**
+     * scope that binds name, NULL if undefined
+     */
+    Scope* getDeclaringScope(Symbol name) {
+        Scope* retval = scope;
+        while(retval != NULL && retval->table.count(name.getId()) == 0) {
+            retval = retval->parent;
+        }
+        return retval;
+    }
+
+    static bool isWithin(Scope* inner, Scope* outer) {
+        for(; inner != NULL; inner = inner->parent) {
+            if(inner == outer) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * scope whose exit frees the array storage expr refers to: heap arrays are freed when the scope that made them
+     * exits and fixed arrays live in their scope's frame. NULL when this function does not free it, arguments
+     * belong to the caller and fields to their object.
+     */
+    Scope* getArrayOwner(NExpression* expr) {
+        if(matchNode<NNewArray>(expr) != nullptr) {
+            return scope;
+        }
+        if(NArraySlice* slice = matchNode<NArraySlice>(expr)) {
+            expr = slice->expr;
+        }
+        NIdentifier* identifier = getIdentifier(expr);
+        if(identifier == nullptr || identifier->declaration == nullptr) {
+            return NULL;
+        }
+        auto it = arrayOwners.find(identifier->declaration);
+        return it != arrayOwners.end() ? it->second : NULL;
+    }
+
+    /**
+     * lhs = rhs must not let a slice outlive the storage it refers to. Arrays are copied, so only slices are checked.
+     */
+    void checkArrayEscape(NExpression* lhs, NExpression* rhs, const YYLTYPE& location) {
+        Scope* owner = isa<StapleSlice>(sempass->ctx.typeTable[rhs]) ? getArrayOwner(rhs) : NULL;
+        if(owner == NULL) {
+            return;
+        }
+
+        NIdentifier* identifier = matchNode<NIdentifier>(lhs);
+        bool isLocal = identifier != nullptr && identifier->fieldIndex < 0
+                       && (matchNode<NVariableDeclaration>(identifier->declaration) != nullptr
+                           || matchNode<NArgument>(identifier->declaration) != nullptr);
+        if(!isLocal) {
+            sempass->logError(location, "cannot store an array that is freed when its scope exits");
+            return;
+        }
+
+        Scope* declaringScope = getDeclaringScope(identifier->name);
+        if(!isWithin(declaringScope, owner)) {
+            sempass->logError(location, "array does not live as long as '%s'", identifier->name.c_str());
+            return;
+        }
+
+        //every owner is the declaring scope or encloses it, keep the one exiting first
+        Scope*& current = arrayOwners[identifier->declaration];
+        if(current == NULL || isWithin(owner, current)) {
+            current = owner;
+        }
     }
 
     StapleType* getType(ASTNode* node) {
@@ -72,42 +256,102 @@ public:
         return sempass->ctx.typeTable[node];
     }
 
+    /**
+     * fixed size arrays convert implicitly to a slice over the whole array.
+     */
+    void coerce(NExpression*& expr, StapleType* destType) {
+        StapleArray* arrayType = dyn_cast_or_null<StapleArray>(sempass->ctx.typeTable[expr]);
+        if(StapleField* field = dyn_cast_or_null<StapleField>(destType)) {
+            destType = field->getElementType();
+        }
 
+        if(arrayType != nullptr && dyn_cast_or_null<StapleSlice>(destType) != nullptr) {
+            NExpression* address = expr;
+            if(NLoad* load = matchNode<NLoad>(expr)) {
+                address = load->expr;
+            }
 
-    virtual void visit(NCompileUnit* compileUnit) {
+            NArraySlice* slice = sempass->file.arena.make<NArraySlice>(address);
+            slice->location = expr->location;
+            sempass->ctx.typeTable[slice] = sempass->ctx.types.getSliceType(arrayType->getElementType());
+            expr = slice;
+        }
+    }
+
+    /**
+     * true if expr addresses a whole element of a soa array. Such elements
+     * are never materialized, so only their fields can be accessed.
+     */
+    bool isSoaElement(NExpression* expr) {
+        NArrayElementPtr* element = matchNode<NArrayElementPtr>(expr);
+        if(element == nullptr) {
+            return false;
+        }
+        StapleArray* arrayType = dyn_cast_or_null<StapleArray>(sempass->ctx.typeTable[element->base]);
+        return arrayType != nullptr && arrayType->isSoa();
+    }
 
-        currentClass = NULL;
-        push();
 
+
+    virtual void visit(NCompileUnit* compileUnit) {
+        declareClasses(compileUnit);
+        declareMembers(compileUnit);
+        checkBodies(compileUnit);
+    }
+
+    void declareClasses(NCompileUnit* compileUnit) {
         //first pass class declaration
         for(NClassDeclaration* classDeclaration : compileUnit->classes) {
             Pass1ClassVisitor visitor(&sempass->ctx);
             classDeclaration->accept(&visitor);
+
+            //each file would define the class's class_def and methods
+            if(StapleClass* previous = visitor.getPrevious()) {
+                NClassDeclaration* previousDeclaration = sempass->ctx.getClassDeclaration(previous);
+                if(previousDeclaration != nullptr) {
+                    sempass->logError(classDeclaration->location, "'%s' is already defined at %s:%d",
+                                      classDeclaration->name.c_str(), previousDeclaration->location.filename,
+                                      previousDeclaration->location.first_line);
+                } else {
+                    sempass->logError(classDeclaration->location, "'%s' is a runtime class",
+                                      classDeclaration->name.c_str());
+                }
+            }
         }
+    }
 
-        //first pass extern functions
-        for(NFunctionPrototype* functionPrototype : compileUnit->externFunctions) {
+    void declareMembers(NCompileUnit* compileUnit) {
+        //class fields and methods
+        for(NClassDeclaration* classDeclaration : compileUnit->classes){
 
-            std::vector<StapleType*> argsType;
-            for(NArgument* arg : functionPrototype->arguments){
-                StapleType* type = getType(&arg->type);
+            StapleClass* parentClass = sempass->ctx.lookupClassName(classDeclaration->mExtends);
 
-                CheckType(type, arg->location, arg->name,
-                          argsType.push_back(type);
-                                  sempass->ctx.typeTable[arg] = type;
-                )
+            currentClass = sempass->ctx.lookupClassName(classDeclaration->name);
+            currentClass->setParent(parentClass);
+            sempass->ctx.typeTable[classDeclaration] = currentClass;
+
+            for(NField* field : classDeclaration->fields) {
+                field->accept(this);
             }
 
-            StapleType* returnType = getType(&functionPrototype->returnType);
-            CheckType(returnType, functionPrototype->location, functionPrototype->returnType.name,
-                      sempass->ctx.typeTable[functionPrototype] = new StapleFunction(returnType, argsType, functionPrototype->isVarg);
-                              define(functionPrototype->name, sempass->ctx.typeTable[functionPrototype]);
-            )
+            for(NMethodFunction* method : classDeclaration->functions) {
 
+                std::vector<StapleType*> args;
+                for(NArgument* arg : method->arguments){
+                    StapleType* type = getType(&arg->type);
+                    CheckType(type, arg->location, arg->type.name, args.push_back(type); )
+                }
+
+                StapleType* returnType = getType(&method->returnType);
+                CheckType(returnType, method->returnType.location, method->returnType.name, )
+
+                sempass->ctx.typeTable[method] = currentClass->addMethod(method->name, returnType, args, method->isVarg);
+            }
         }
 
-        //first pass global functions
-        for(NFunction* function : compileUnit->functions){
+        //free functions are declared for every file with their types, so an extern prototype in another file can
+        //bind to them and be checked against them while the files' bodies are checked in parallel
+        for(NFunction* function : compileUnit->functions) {
             std::vector<StapleType*> argsType;
             for(NArgument* arg : function->arguments){
                 StapleType* type = getType(&arg->type);
@@ -120,41 +364,75 @@ public:
 
             StapleType* returnType = getType(&function->returnType);
             CheckType(returnType, function->location, function->returnType.name,
-                      sempass->ctx.typeTable[function] = new StapleFunction(returnType, argsType, function->isVarg);
-                              define(function->name, sempass->ctx.typeTable[function]);
+                      sempass->ctx.typeTable[function] = sempass->ctx.types.getFunctionType(returnType, argsType, function->isVarg);
             )
+
+            if(NFunction* previous = sempass->ctx.defineFunction(function)) {
+                sempass->logError(function->location, "'%s' is already defined at %s:%d", function->name.c_str(),
+                                  previous->location.filename, previous->location.first_line);
+            }
         }
 
-        //class fields and methods
-        for(NClassDeclaration* classDeclaration : compileUnit->classes){
+        //build the layouts now rather than on the first lookup in a body. With several files a parent declared in a
+        //later file changes them again, the driver rebuilds them once every file's members are declared
+        for(NClassDeclaration* classDeclaration : compileUnit->classes) {
+            sempass->ctx.lookupClassName(classDeclaration->name)->getLayout();
+        }
 
-            StapleClass* parentClass = sempass->ctx.lookupClassName(classDeclaration->mExtends);
+        currentClass = NULL;
+    }
 
-            currentClass = sempass->ctx.lookupClassName(classDeclaration->name);
-            currentClass->setParent(parentClass);
-            sempass->ctx.typeTable[classDeclaration] = currentClass;
+    void checkBodies(NCompileUnit* compileUnit) {
 
-            for(NField* field : classDeclaration->fields) {
-                field->accept(this);
+        currentClass = NULL;
+        push();
+
+        //first pass extern functions
+        for(NFunctionPrototype* functionPrototype : compileUnit->externFunctions) {
+
+            std::vector<StapleType*> argsType;
+            for(NArgument* arg : functionPrototype->arguments){
+                StapleType* type = getType(&arg->type);
+
+                CheckType(type, arg->location, arg->name,
+                          argsType.push_back(type);
+                                  sempass->ctx.typeTable[arg] = type;
+                )
             }
 
-            for(NMethodFunction* method : classDeclaration->functions) {
+            StapleType* returnType = getType(&functionPrototype->returnType);
+            CheckType(returnType, functionPrototype->location, functionPrototype->returnType.name,
+                      sempass->ctx.typeTable[functionPrototype] = sempass->ctx.types.getFunctionType(returnType, argsType, functionPrototype->isVarg);
+                              define(functionPrototype->name, sempass->ctx.typeTable[functionPrototype], functionPrototype);
+            )
 
-                std::vector<StapleType*> args;
-                for(NArgument* arg : method->arguments){
-                    StapleType* type = getType(&arg->type);
-                    CheckType(type, arg->location, arg->type.name, args.push_back(type); )
+            //a function of this compile links by its package symbol, any other name is a C function. Function types
+            //are unique per structure, so the same arguments, return type and varargs give the same type
+            NFunction* definition = sempass->ctx.lookupFunction(functionPrototype->name);
+            StapleType* prototypeType = sempass->ctx.typeTable[functionPrototype];
+            if(definition != nullptr && prototypeType != nullptr) {
+                if(sempass->ctx.typeTable[definition] != prototypeType) {
+                    sempass->logError(functionPrototype->location, "extern '%s' does not match its definition at %s:%d",
+                                      functionPrototype->name.c_str(), definition->location.filename,
+                                      definition->location.first_line);
+                } else {
+                    functionPrototype->definition = definition;
                 }
+            }
 
-                StapleType* returnType = getType(&method->returnType);
-                CheckType(returnType, method->returnType.location, method->returnType.name, )
+        }
 
-                sempass->ctx.typeTable[method] = currentClass->addMethod(method->name, returnType, args, method->isVarg);
+        //first pass global functions, typed by declareMembers
+        for(NFunction* function : compileUnit->functions){
+            if(StapleType* functionType = sempass->ctx.typeTable[function]) {
+                define(function->name, functionType, function);
             }
         }
 
         //second pass methods
         for(NClassDeclaration* classDeclaration : compileUnit->classes) {
+            currentClass = cast<StapleClass>(sempass->ctx.typeTable[classDeclaration]);
+            currentClassDeclaration = classDeclaration;
             for(NMethodFunction* method : classDeclaration->functions) {
                 method->accept(this);
             }
@@ -166,6 +444,7 @@ public:
         }
 
         currentClass = NULL;
+        currentClassDeclaration = NULL;
 
         pop();
     }
@@ -174,21 +453,12 @@ public:
 
         const string name = type->name;
 
-        StapleType* retval = NULL;
-        if(name.compare("void") == 0) {
-            retval = StapleType::getVoidType();
-        } else if(name.compare("uint") == 0 || name.compare("int") == 0 || name.compare("int32") == 0){
-            retval = StapleType::getInt32Type();
-        } else if(name.compare("uint8") == 0 || name.compare("int8") == 0) {
-            retval = StapleType::getInt8Type();
-        } else if(name.compare("uint16") == 0 || name.compare("int16") == 0) {
-            retval = StapleType::getInt16Type();
-        } else if(name.compare("float") == 0 || name.compare("float32") == 0) {
-            retval = StapleType::getFloat32Type();
-        } else if(name.compare("bool") == 0) {
-            retval = StapleType::getBoolType();
-        } else {
+        StapleType* retval = getScalarType(name);
+        if(retval == NULL) {
+            retval = getVectorType(name, sempass->ctx.types);
+        }
 
+        if(retval == NULL) {
             retval = sempass->ctx.lookupClassName(name);
             if(retval == nullptr || !isa<StapleClass>(retval)) {
                 sempass->logError(type->location, "unknown type: '%s'", type->name.c_str());
@@ -197,11 +467,18 @@ public:
             }
         }
 
-        if(type->isArray) {
-            retval = new StapleArray(retval, type->size);
+        if(type->isSlice) {
+            retval = sempass->ctx.types.getSliceType(retval);
+        } else if(type->isArray) {
+            if(type->isSoa && !isa<StapleClass>(retval)) {
+                sempass->logError(type->location, "soa layout requires a class element type: '%s'", type->name.c_str());
+                sempass->ctx.typeTable[type] = NULL;
+                return;
+            }
+            retval = sempass->ctx.types.getArrayType(retval, type->size, type->isSoa ? StapleArray::Layout::SoA : StapleArray::Layout::AoS);
         } else {
             for(int i=0;i<type->numPointers;i++) {
-                retval = new StaplePointer(retval);
+                retval = sempass->ctx.types.getPointerType(retval);
             }
         }
         sempass->ctx.typeTable[type] = retval;
@@ -221,18 +498,22 @@ public:
     virtual void visit(NMethodFunction* methodFunction) {
         push();
 
-        StapleType* thisType = new StaplePointer(currentClass);
-        define("this", thisType);
+        StapleType* thisType = sempass->ctx.types.getPointerType(currentClass);
+        define(SYM_THIS, thisType, methodFunction);
 
-        for(StapleField* field : currentClass->getFields()){
-            define(field->getName(), field);
+        //the class's own fields follow those of all its ancestors
+        int fieldIndex = currentClass->getParent() != NULL ? currentClass->getParent()->getLayout().fields.size() : 0;
+        for(NField* field : currentClassDeclaration->fields) {
+            if(StapleField* fieldType = dyn_cast_or_null<StapleField>(sempass->ctx.typeTable[field])) {
+                define(field->name, fieldType, field, fieldIndex++);
+            }
         }
 
         for(NArgument* arg : methodFunction->arguments){
             StapleType* type = getType(&arg->type);
 
             CheckType(type, arg->location, arg->type.name,
-                    define(arg->name, type);
+                    define(arg->name, type, arg);
                     sempass->ctx.typeTable[arg] = type;
             )
         }
@@ -252,6 +533,8 @@ public:
         StapleType* returnType = getType(returnexp->ret);
         if(!returnType->isAssignable(mCurrentFunctionType->getReturnType())) {
             sempass->logError(returnexp->location, "return type mismatch");
+        } else if(isa<StapleSlice>(mCurrentFunctionType->getReturnType()) && getArrayOwner(returnexp->ret) != NULL) {
+            sempass->logError(returnexp->location, "cannot return an array that is freed when its scope exits");
         }
 
         sempass->ctx.typeTable[returnexp] = StapleType::getVoidType();
@@ -263,7 +546,7 @@ public:
             StapleType* type = getType(&arg->type);
 
             CheckType(type, arg->location, arg->type.name,
-                    define(arg->name, type);
+                    define(arg->name, type, arg);
                     sempass->ctx.typeTable[arg] = type;
             )
         }
@@ -273,25 +556,68 @@ public:
 
         mCurrentFunctionType = cast<StapleFunction>(sempass->ctx.typeTable[function]);
 
+        if(!function->targetClones.empty()) {
+            checkTargetClones(function);
+        }
+
         for(NStatement* statement : function->block.statements){
             statement->accept(this);
         }
         pop();
     }
 
+    /**
+     * each clone is "default" or a comma separated list of cpu features
+     */
+    void checkTargetClones(NFunction* function) {
+        bool hasDefault = false;
+        for(const string& target : function->targetClones) {
+            if(target == "default") {
+                hasDefault = true;
+                continue;
+            }
+            stringstream features(target);
+            string feature;
+            while(getline(features, feature, ',')) {
+                if(!isCloneFeature(feature)) {
+                    sempass->logError(function->location, "unknown target_clones feature: '%s'", feature.c_str());
+                }
+            }
+        }
+
+        if(!hasDefault) {
+            sempass->logError(function->location, "target_clones needs a \"default\" version");
+        }
+        if(function->isVarg) {
+            sempass->logError(function->location, "target_clones functions cannot take variable arguments");
+        }
+    }
+
     virtual void visit(NVariableDeclaration* variableDeclaration) {
         StapleType* type = getType(variableDeclaration->type);
         CheckType(type, variableDeclaration->location, variableDeclaration->type->name,
-                define(variableDeclaration->name, type);
+                define(variableDeclaration->name, type, variableDeclaration);
                 sempass->ctx.typeTable[variableDeclaration] = type;
         )
 
+        if(dyn_cast_or_null<StapleArray>(type) != nullptr) {
+            arrayOwners[variableDeclaration] = scope;
+        }
+
         if(variableDeclaration->assignmentExpr != NULL) {
             variableDeclaration->assignmentExpr->accept(this);
             StapleType* rhs = sempass->ctx.typeTable[variableDeclaration->assignmentExpr];
 
             if(!rhs->isAssignable(type)) {
                 sempass->logError(variableDeclaration->location, "cannot convert rhs to lhs");
+            } else {
+                coerce(variableDeclaration->assignmentExpr, type);
+
+                //the storage is in this scope or an enclosing one, so it always outlives the variable
+                Scope* owner;
+                if(isa<StapleSlice>(type) && (owner = getArrayOwner(variableDeclaration->assignmentExpr)) != NULL) {
+                    arrayOwners[variableDeclaration] = owner;
+                }
             }
         }
     }
@@ -300,6 +626,10 @@ public:
         sempass->ctx.typeTable[intLiteral] = StapleType::getInt32Type();
     }
 
+    virtual void visit(NFloatLiteral* floatLiteral) {
+        sempass->ctx.typeTable[floatLiteral] = StapleType::getFloat32Type();
+    }
+
     virtual void visit(NStringLiteral* literal) {
         sempass->ctx.typeTable[literal] = StapleType::getInt8PtrType();
     }
@@ -311,8 +641,24 @@ public:
         StapleType* lhsType = sempass->ctx.typeTable[assignment->lhs];
         StapleType* rhsType = sempass->ctx.typeTable[assignment->rhs];
 
-        if(!rhsType->isAssignable(lhsType)){
+        NIdentifier* identifier = matchNode<NIdentifier>(assignment->lhs);
+        if(identifier != nullptr && identifier->declaration != nullptr) {
+            for(ForeachRange& range : foreachRanges) {
+                if(identifier->declaration == range.foreach) {
+                    sempass->logError(assignment->location, "foreach index '%s' cannot be assigned", identifier->name.c_str());
+                } else if(identifier->declaration == range.array) {
+                    range.arrayAssigned = true;
+                }
+            }
+        }
+
+        if(isSoaElement(assignment->lhs)) {
+            sempass->logError(assignment->location, "elements of a soa array can only be assigned by field");
+        } else if(!rhsType->isAssignable(lhsType)){
             sempass->logError(assignment->location, "cannot convert rhs to lhs");
+        } else {
+            coerce(assignment->rhs, lhsType);
+            checkArrayEscape(assignment->lhs, assignment->rhs, assignment->location);
         }
     }
 
@@ -324,48 +670,192 @@ public:
         }
     }
 
+    virtual void visit(NNewArray* newArray) {
+        StapleType* elementType = getType(newArray->type);
+        StapleType* sizeType = getType(newArray->size);
+
+        if(dyn_cast_or_null<StapleInt>(sizeType) == nullptr) {
+            sempass->logError(newArray->size->location, "array size is not an integer");
+        } else if(NIntLiteral* literal = matchNode<NIntLiteral>(newArray->size)) {
+            //others are checked at runtime
+            if(strtoull(literal->str.c_str(), nullptr, 10) == 0) {
+                sempass->logError(newArray->size->location, "array size must be greater than 0");
+            }
+        }
+
+        CheckType(elementType, newArray->type->location, newArray->type->name,
+                  sempass->ctx.typeTable[newArray] = sempass->ctx.types.getSliceType(elementType);
+        )
+    }
+
     virtual void visit(NNew* newNode) {
         StapleType* type = sempass->ctx.lookupClassName(newNode->id);
 
         if(StapleClass* classType = dyn_cast<StapleClass>(type)) {
-            sempass->ctx.typeTable[newNode] = new StaplePointer(classType);
+            sempass->ctx.typeTable[newNode] = sempass->ctx.types.getPointerType(classType);
         } else {
             sempass->logError(newNode->location, "undefined class: '%s'", newNode->id.c_str());
         }
     }
 
     virtual void visit(NIdentifier* identifier) {
-        StapleType* type = scope->get(identifier->name);
-        sempass->ctx.typeTable[identifier] = type;
+        if(Binding* binding = scope->get(identifier->name)) {
+            sempass->ctx.typeTable[identifier] = binding->type;
+            identifier->declaration = binding->declaration;
+            identifier->fieldIndex = binding->fieldIndex;
+        }
     }
 
     virtual void visit(NArrayElementPtr* arrayElementPtr) {
 
         StapleType* baseType = getType(arrayElementPtr->base);
+        if(StapleField* field = dyn_cast_or_null<StapleField>(baseType)) {
+            baseType = field->getElementType();
+        }
 
-        if(StapleArray* arrayType = dyn_cast<StapleArray>(baseType)) {
-            StapleType* exprType = getType(arrayElementPtr->expr);
+        //arrays are indexed in place, so drop the load the parser adds to rvalue bases.
+        //slices and pointers are indexed through their value so lvalue bases need one.
+        NLoad* load = matchNode<NLoad>(arrayElementPtr->base);
+        bool isValueBase = dyn_cast_or_null<StapleSlice>(baseType) != nullptr
+                           || dyn_cast_or_null<StaplePointer>(baseType) != nullptr;
+        if(load != nullptr && dyn_cast_or_null<StapleArray>(baseType) != nullptr) {
+            arrayElementPtr->base = load->expr;
+        } else if(load == nullptr && isValueBase) {
+            arrayElementPtr->base = sempass->file.arena.make<NLoad>(arrayElementPtr->base);
+            arrayElementPtr->base->location = arrayElementPtr->location;
+            arrayElementPtr->base->accept(this);
+        }
 
-            if(isa<StapleInt>(exprType)) {
-                sempass->ctx.typeTable[arrayElementPtr] = new StaplePointer(baseType);
-            } else {
-                sempass->logError(arrayElementPtr->expr->location, "array index is not an integer");
+        StapleType* elementType = nullptr;
+        if(StapleArray* arrayType = dyn_cast_or_null<StapleArray>(baseType)) {
+            elementType = arrayType->getElementType();
+
+            //constant indexes into fixed arrays are checked now instead of at runtime
+            if(NIntLiteral* literal = matchNode<NIntLiteral>(arrayElementPtr->expr)) {
+                uint64_t index = strtoull(literal->str.c_str(), nullptr, 10);
+                if(index >= arrayType->getSize()) {
+                    sempass->logError(arrayElementPtr->expr->location, "array index %llu is out of bounds [0, %llu)",
+                                      (unsigned long long)index, (unsigned long long)arrayType->getSize());
+                }
+                arrayElementPtr->checkBounds = false;
             }
+        } else if(StapleSlice* sliceType = dyn_cast_or_null<StapleSlice>(baseType)) {
+            elementType = sliceType->getElementType();
+        } else if(StaplePointer* ptrType = dyn_cast_or_null<StaplePointer>(baseType)) {
+            elementType = ptrType->getElementType();
+            arrayElementPtr->checkBounds = false; // raw pointers carry no length
+        } else {
+            sempass->logError(arrayElementPtr->base->location, "not an array type");
+            return;
+        }
+
+        if(arrayElementPtr->checkBounds) {
+            checkForeachIndex(arrayElementPtr, baseType);
         }
 
+        StapleType* exprType = getType(arrayElementPtr->expr);
+        if(dyn_cast_or_null<StapleInt>(exprType) != nullptr) {
+            sempass->ctx.typeTable[arrayElementPtr] = elementType;
+        } else {
+            sempass->logError(arrayElementPtr->expr->location, "array index is not an integer");
+        }
+
+    }
+
+    /**
+     * array indexed by the index of an enclosing foreach whose range stays within it
+     */
+    void checkForeachIndex(NArrayElementPtr* arrayElementPtr, StapleType* baseType) {
+        NIdentifier* index = getIdentifier(arrayElementPtr->expr);
+        NIdentifier* base = getIdentifier(arrayElementPtr->base);
+        if(index == nullptr || base == nullptr) {
+            return;
+        }
+
+        StapleArray* arrayType = dyn_cast_or_null<StapleArray>(baseType);
+        for(ForeachRange& range : foreachRanges) {
+            if(index->declaration != range.foreach) {
+                continue;
+            }
+            if(range.array != nullptr && base->declaration == range.array) {
+                range.accesses.push_back(arrayElementPtr);
+            } else if(arrayType != nullptr && range.constEnd >= 0 && range.constEnd <= arrayType->getSize()) {
+                //fixed arrays never shrink
+                arrayElementPtr->checkBounds = false;
+            }
+        }
+    }
+
+    virtual void visit(NForeach* foreach) {
+        StapleType* startType = getType(foreach->start);
+        StapleType* endType = getType(foreach->end);
+        if(dyn_cast_or_null<StapleInt>(startType) == nullptr || dyn_cast_or_null<StapleInt>(endType) == nullptr) {
+            sempass->logError(foreach->location, "foreach range must be integers");
+        }
+
+        push();
+        define(foreach->var, StapleType::getInt32Type(), foreach);
+
+        ForeachRange range;
+        range.foreach = foreach;
+        range.array = nullptr;
+        range.constEnd = -1;
+        range.arrayAssigned = false;
+
+        //int literals are never negative
+        if(matchNode<NIntLiteral>(foreach->start) != nullptr) {
+            NFunctionCall* call = matchNode<NFunctionCall>(foreach->end);
+            NIdentifier* array;
+            if(call != nullptr && call->builtin == BI_Len && (array = getIdentifier(call->arguments[0])) != nullptr) {
+                range.array = array->declaration;
+            } else if(NIntLiteral* literal = matchNode<NIntLiteral>(foreach->end)) {
+                range.constEnd = atol(literal->str.c_str());
+            }
+        }
+
+        foreachRanges.push_back(range);
+        foreach->body->accept(this);
+
+        if(!foreachRanges.back().arrayAssigned) {
+            for(NArrayElementPtr* access : foreachRanges.back().accesses) {
+                access->checkBounds = false;
+            }
+        }
+        foreachRanges.pop_back();
+
+        pop();
     }
 
     virtual void visit(NMemberAccess* memberAccess) {
 
-        StapleType* baseType = getType(memberAccess->base);
+        StapleType* baseType = nullptr;
 
         StaplePointer* ptr = nullptr;
         StapleClass* classPtr = nullptr;
 
-        if((ptr = dyn_cast<StaplePointer>(baseType)) && (classPtr = dyn_cast<StapleClass>(ptr->getElementType()))) {
-            memberAccess->base = new NLoad(memberAccess->base);
-            memberAccess->base->accept(this);
-        } else if(!(classPtr = dyn_cast<StapleClass>(baseType))) {
+        if(NLoad* load = matchNode<NLoad>(memberAccess->base)) {
+            baseType = getType(load->expr);
+            if(isa<StapleClass>(baseType)) {
+                //class values (i.e. array elements) are accessed in place
+                memberAccess->base = load->expr;
+            } else {
+                sempass->ctx.typeTable[load] = baseType;
+            }
+        } else {
+            baseType = getType(memberAccess->base);
+            if((ptr = dyn_cast<StaplePointer>(baseType)) && isa<StapleClass>(ptr->getElementType())) {
+                memberAccess->base = sempass->file.arena.make<NLoad>(memberAccess->base);
+                memberAccess->base->accept(this);
+            }
+        }
+
+        if((ptr = dyn_cast_or_null<StaplePointer>(baseType))) {
+            classPtr = dyn_cast<StapleClass>(ptr->getElementType());
+        } else {
+            classPtr = dyn_cast_or_null<StapleClass>(baseType);
+        }
+
+        if(classPtr == nullptr) {
             sempass->logError(memberAccess->base->location, "not a class type");
             return;
         }
@@ -402,6 +892,26 @@ public:
 
         StapleType* returnType = StapleType::getVoidType();
 
+        //vector operators work lane by lane on operands of the same type, a scalar operand is repeated in every lane.
+        //The lanes are unsigned if either vector is.
+        StapleType* lhsType = getValueType(binaryOperator->lhs);
+        StapleType* rhsType = getValueType(binaryOperator->rhs);
+        StapleVector* lhsVector = dyn_cast_or_null<StapleVector>(lhsType);
+        StapleVector* rhsVector = dyn_cast_or_null<StapleVector>(rhsType);
+        StapleVector* vectorType = lhsVector != nullptr ? lhsVector : rhsVector;
+        if(lhsVector != nullptr && rhsVector != nullptr) {
+            if(!lhsVector->isAssignable(rhsVector)) {
+                sempass->logError(binaryOperator->location, "vector operands must have the same type");
+            } else if(rhsVector->isUnsigned()) {
+                vectorType = rhsVector;
+            }
+        } else if(vectorType != nullptr) {
+            StapleType* scalarType = lhsVector != nullptr ? rhsType : lhsType;
+            if(scalarType == nullptr || !scalarType->isAssignable(vectorType->getElementType())) {
+                sempass->logError(binaryOperator->location, "cannot convert scalar operand to lane type");
+            }
+        }
+
         switch(binaryOperator->op) {
             case TCEQ:
             case TCNE:
@@ -409,14 +919,16 @@ public:
             case TCLT:
             case TCGE:
             case TCLE:
-                returnType = StapleType::getBoolType();
+                returnType = vectorType != nullptr
+                             ? sempass->ctx.types.getVectorType(StapleType::getBoolType(), vectorType->getNumLanes())
+                             : StapleType::getBoolType();
                 break;
 
             case TPLUS:
             case TMINUS:
             case TMUL:
             case TDIV:
-                returnType = sempass->ctx.typeTable[binaryOperator->lhs];
+                returnType = vectorType != nullptr ? vectorType : sempass->ctx.typeTable[binaryOperator->lhs];
                 break;
         }
 
@@ -441,19 +953,20 @@ public:
         int index = 0;
         StapleMethodFunction* method = classPtr->getMethod(methodCall->name, index);
         if(method != nullptr) {
-            methodCall->methodIndex = index;
+            methodCall->method = method;
 
-            int i = 0;
-            for(auto arg : methodCall->arguments) {
+            for(int i=0;i<methodCall->arguments.size();i++) {
+                NExpression*& arg = methodCall->arguments[i];
                 StapleType* argType = getType(arg);
 
                 if(i < method->getArguments().size()) {
                     StapleType* definedArgType = method->getArguments()[i];
                     if(!argType->isAssignable(definedArgType)) {
                         sempass->logError(arg->location, "argument mismatch");
+                    } else {
+                        coerce(arg, definedArgType);
                     }
                 }
-                i++;
             }
 
             sempass->ctx.typeTable[methodCall] = method->getReturnType();
@@ -463,24 +976,279 @@ public:
         }
     }
 
+    /**
+     * type of an already visited expression, fields are unwrapped to their declared type
+     */
+    StapleType* getValueType(NExpression* expr) {
+        StapleType* retval = sempass->ctx.typeTable[expr];
+        if(StapleField* field = dyn_cast_or_null<StapleField>(retval)) {
+            retval = field->getElementType();
+        }
+        return retval;
+    }
+
+    /**
+     * value of an integer literal, -1 if expr is not one
+     */
+    long getLiteralValue(NExpression* expr) {
+        NIntLiteral* literal = matchNode<NIntLiteral>(expr);
+        return literal != nullptr ? atol(literal->str.c_str()) : -1;
+    }
+
+    bool checkNumArgs(NFunctionCall* functionCall, size_t numArgs) {
+        if(functionCall->arguments.size() != numArgs) {
+            sempass->logError(functionCall->location, "%s() takes %d arguments",
+                              functionCall->name.c_str(), (int)numArgs);
+            return false;
+        }
+        return true;
+    }
+
+    bool checkIntArg(NExpression* arg) {
+        arg->accept(this);
+        if(dyn_cast_or_null<StapleInt>(getValueType(arg)) == nullptr) {
+            sempass->logError(arg->location, "not an integer");
+            return false;
+        }
+        return true;
+    }
+
+    StapleVector* getVectorArg(NExpression* arg) {
+        arg->accept(this);
+        StapleVector* retval = dyn_cast_or_null<StapleVector>(getValueType(arg));
+        if(retval == nullptr) {
+            sempass->logError(arg->location, "not a vector type");
+        }
+        return retval;
+    }
+
+    /**
+     * array or slice argument to a builtin, nullptr if arg is neither. Fixed arrays are
+     * used in place and never loaded.
+     */
+    StapleType* getArrayArg(NExpression*& arg) {
+        arg->accept(this);
+        StapleType* argType = getValueType(arg);
+        if(dyn_cast_or_null<StapleArray>(argType) != nullptr) {
+            if(NLoad* load = matchNode<NLoad>(arg)) {
+                arg = load->expr;
+            }
+        } else if(dyn_cast_or_null<StapleSlice>(argType) == nullptr) {
+            sempass->logError(arg->location, "not an array");
+            argType = nullptr;
+        }
+        return argType;
+    }
+
+    /**
+     * element type of the array or slice argument for vector loads and stores
+     */
+    StapleType* getVectorMemoryArg(NExpression*& arg) {
+        StapleType* retval = nullptr;
+        StapleType* argType = getArrayArg(arg);
+        if(StapleArray* arrayType = dyn_cast_or_null<StapleArray>(argType)) {
+            retval = !arrayType->isSoa() ? arrayType->getElementType() : nullptr;
+        } else if(StapleSlice* sliceType = dyn_cast_or_null<StapleSlice>(argType)) {
+            retval = sliceType->getElementType();
+        }
+
+        if(argType != nullptr && (retval == nullptr || makeVectorType(retval) == nullptr)) {
+            sempass->logError(arg->location, "elements cannot be loaded as vector lanes");
+            retval = nullptr;
+        }
+        return retval;
+    }
+
+    /**
+     * vector of numLanes elementType, nullptr if it cannot be a vector
+     */
+    StapleVector* makeVectorType(StapleType* elementType, long numLanes = 2, bool isUnsigned = false) {
+        bool isScalar = (dyn_cast_or_null<StapleInt>(elementType) != nullptr && elementType != StapleType::getBoolType())
+                        || dyn_cast_or_null<StapleFloat>(elementType) != nullptr;
+        return isScalar && isValidNumLanes(numLanes)
+               ? sempass->ctx.types.getVectorType(elementType, numLanes, isUnsigned)
+               : nullptr;
+    }
+
+    /**
+     * an integer lane index of vectorType, literals must name one of its lanes. Others are checked at runtime.
+     */
+    bool checkLaneArg(NExpression* arg, StapleVector* vectorType) {
+        if(!checkIntArg(arg)) {
+            return false;
+        }
+        if(getLiteralValue(arg) >= vectorType->getNumLanes()) {
+            sempass->logError(arg->location, "lane index must be less than %d", vectorType->getNumLanes());
+            return false;
+        }
+        return true;
+    }
+
+    void visitBuiltin(NFunctionCall* functionCall) {
+        ExpressionList& args = functionCall->arguments;
+        StapleType* returnType = nullptr;
+
+        switch(functionCall->builtin) {
+            case BI_Len: {
+                if(checkNumArgs(functionCall, 1) && getArrayArg(args[0]) != nullptr) {
+                    returnType = StapleType::getInt32Type();
+                }
+                break;
+            }
+
+            case BI_Splat: {
+                if(!checkNumArgs(functionCall, 2)) {
+                    break;
+                }
+                args[0]->accept(this);
+                returnType = makeVectorType(getValueType(args[0]), getLiteralValue(args[1]));
+                if(returnType == nullptr) {
+                    sempass->logError(functionCall->location, "splat() takes a scalar and a constant power of 2 lane count");
+                }
+                break;
+            }
+
+            case BI_Extract: {
+                StapleVector* vectorType;
+                if(checkNumArgs(functionCall, 2) && (vectorType = getVectorArg(args[0])) && checkLaneArg(args[1], vectorType)) {
+                    returnType = vectorType->getElementType();
+                }
+                break;
+            }
+
+            case BI_Insert: {
+                StapleVector* vectorType;
+                if(checkNumArgs(functionCall, 3) && (vectorType = getVectorArg(args[0])) && checkLaneArg(args[1], vectorType)) {
+                    if(getType(args[2])->isAssignable(vectorType->getElementType())) {
+                        returnType = vectorType;
+                    } else {
+                        sempass->logError(args[2]->location, "cannot convert to lane type");
+                    }
+                }
+                break;
+            }
+
+            case BI_Shuffle: {
+                if(args.size() < 4) {
+                    sempass->logError(functionCall->location, "shuffle() takes two vectors and at least two lane indexes");
+                    break;
+                }
+                StapleVector* vectorType = getVectorArg(args[0]);
+                StapleVector* otherType = getVectorArg(args[1]);
+                if(vectorType == nullptr || otherType == nullptr) {
+                    break;
+                }
+                if(!vectorType->isAssignable(otherType)) {
+                    sempass->logError(functionCall->location, "vector operands must have the same type");
+                    break;
+                }
+
+                bool valid = true;
+                for(int i=2;i<args.size();i++) {
+                    long lane = getLiteralValue(args[i]);
+                    if(lane < 0 || lane >= 2 * vectorType->getNumLanes()) {
+                        sempass->logError(args[i]->location, "lane index must be a constant less than %d",
+                                          2 * vectorType->getNumLanes());
+                        valid = false;
+                    }
+                }
+                if(valid) {
+                    returnType = makeVectorType(vectorType->getElementType(), args.size() - 2, vectorType->isUnsigned());
+                    if(returnType == nullptr) {
+                        sempass->logError(functionCall->location, "shuffle() must produce a power of 2 lanes");
+                    }
+                }
+                break;
+            }
+
+            case BI_Select: {
+                if(!checkNumArgs(functionCall, 3)) {
+                    break;
+                }
+                StapleVector* maskType = getVectorArg(args[0]);
+                StapleVector* vectorType = getVectorArg(args[1]);
+                StapleVector* otherType = getVectorArg(args[2]);
+                if(maskType == nullptr || vectorType == nullptr || otherType == nullptr) {
+                    break;
+                }
+                if(maskType->getElementType() != StapleType::getBoolType() || maskType->getNumLanes() != vectorType->getNumLanes()) {
+                    sempass->logError(args[0]->location, "select() mask must be a comparison result with one lane per element");
+                } else if(!vectorType->isAssignable(otherType)) {
+                    sempass->logError(functionCall->location, "vector operands must have the same type");
+                } else {
+                    returnType = vectorType;
+                }
+                break;
+            }
+
+            case BI_ReduceAdd:
+            case BI_ReduceMul:
+            case BI_ReduceMin:
+            case BI_ReduceMax: {
+                StapleVector* vectorType;
+                if(checkNumArgs(functionCall, 1) && (vectorType = getVectorArg(args[0]))) {
+                    returnType = vectorType->getElementType();
+                }
+                break;
+            }
+
+            case BI_VLoad: {
+                StapleType* elementType;
+                if(checkNumArgs(functionCall, 3) && (elementType = getVectorMemoryArg(args[0])) && checkIntArg(args[1])) {
+                    returnType = makeVectorType(elementType, getLiteralValue(args[2]));
+                    if(returnType == nullptr) {
+                        sempass->logError(args[2]->location, "lane count must be a constant power of 2");
+                    }
+                }
+                break;
+            }
+
+            case BI_VStore: {
+                StapleType* elementType;
+                StapleVector* vectorType;
+                if(checkNumArgs(functionCall, 3) && (elementType = getVectorMemoryArg(args[0])) && checkIntArg(args[1])
+                   && (vectorType = getVectorArg(args[2]))) {
+                    if(vectorType->getElementType() == elementType) {
+                        returnType = StapleType::getVoidType();
+                    } else {
+                        sempass->logError(args[2]->location, "vector lanes do not match the array elements");
+                    }
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        if(returnType != nullptr) {
+            sempass->ctx.typeTable[functionCall] = returnType;
+        }
+    }
+
     virtual void visit(NFunctionCall* functionCall) {
-        StapleType* type = scope->get(functionCall->name);
+        Binding* binding = scope->get(functionCall->name);
+        StapleType* type = binding != NULL ? binding->type : NULL;
 
-        if(StapleFunction* function = dyn_cast<StapleFunction>(type)) {
-            int i = 0;
-            for(auto arg : functionCall->arguments) {
+        if(StapleFunction* function = dyn_cast_or_null<StapleFunction>(type)) {
+            functionCall->declaration = binding->declaration;
+            for(int i=0;i<functionCall->arguments.size();i++) {
+                NExpression*& arg = functionCall->arguments[i];
                 StapleType* argType = getType(arg);
 
                 if(i < function->getArguments().size()) {
                     StapleType* definedArgType = function->getArguments()[i];
                     if(!argType->isAssignable(definedArgType)) {
                         sempass->logError(arg->location, "argument mismatch");
+                    } else {
+                        coerce(arg, definedArgType);
                     }
                 }
-                i++;
             }
 
             sempass->ctx.typeTable[functionCall] = function->getReturnType();
+        } else if((functionCall->builtin = lookupBuiltin(functionCall->name)) != BI_None) {
+            visitBuiltin(functionCall);
         } else {
             sempass->logError(functionCall->location, "undefined function: '%s'", functionCall->name.c_str());
         }
@@ -488,6 +1256,9 @@ public:
 
     virtual void visit(NLoad* load) {
         StapleType* type = getType(load->expr);
+        if(isSoaElement(load->expr)) {
+            sempass->logError(load->location, "elements of a soa array can only be read by field");
+        }
         if(StaplePointer* ptrType = dyn_cast<StaplePointer>(type)) {
             sempass->ctx.typeTable[load] = ptrType->getElementType();
         }
@@ -503,8 +1274,9 @@ public:
     }
 };
 
-SemPass::SemPass(CompilerContext& ctx)
+SemPass::SemPass(CompilerContext& ctx, SourceFile& file)
 : ctx(ctx)
+, file(file)
 , numErrors(0) {
 
 }
@@ -513,10 +1285,38 @@ bool SemPass::hasErrors() {
     return numErrors > 0;
 }
 
-void SemPass::doSemPass(NCompileUnit& root)
+void SemPass::doSemPass()
+{
+    TypeVisitor typeVisitor(this);
+    file.compileUnit->accept(&typeVisitor);
+}
+
+void SemPass::declareClasses()
+{
+    TypeVisitor typeVisitor(this);
+    typeVisitor.declareClasses(file.compileUnit);
+}
+
+void SemPass::declareMembers()
+{
+    TypeVisitor typeVisitor(this);
+    typeVisitor.declareMembers(file.compileUnit);
+}
+
+void SemPass::checkBodies()
 {
     TypeVisitor typeVisitor(this);
-    root.accept(&typeVisitor);
+    typeVisitor.checkBodies(file.compileUnit);
+}
+
+/**
+ * prints the message with one write, so the messages of files checked in parallel do not mix
+ */
+static void printMessage(YYLTYPE location, const char* kind, const char* format, va_list argptr)
+{
+    char message[1024];
+    vsnprintf(message, sizeof(message), format, argptr);
+    fprintf(stderr, "%s:%d:%d: %s: %s", location.filename, location.first_line, location.first_column, kind, message);
 }
 
 void SemPass::logError(YYLTYPE location, const char *format, ...)
@@ -524,10 +1324,7 @@ void SemPass::logError(YYLTYPE location, const char *format, ...)
     numErrors++;
     va_list argptr;
     va_start(argptr, format);
-
-    fprintf(stderr, "%s:%d:%d: ", location.filename, location.first_line, location.first_column);
-    fprintf(stderr, "error: ");
-    vfprintf(stderr, format, argptr);
+    printMessage(location, "error", format, argptr);
     va_end(argptr);
 }
 
@@ -535,10 +1332,7 @@ void SemPass::logWarning(YYLTYPE location, const char *format, ...)
 {
     va_list argptr;
     va_start(argptr, format);
-
-    fprintf(stderr, "%s:%d:%d: ", location.filename, location.first_line, location.first_column);
-    fprintf(stderr, "warning: ");
-    vfprintf(stderr, format, argptr);
+    printMessage(location, "warning", format, argptr);
     va_end(argptr);
 }
 
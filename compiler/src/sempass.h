@@ -14,11 +14,27 @@ private:
 
 protected:
     CompilerContext& ctx;
+    //the checked file, nodes made while checking go into its arena
+    SourceFile& file;
 
 public:
-    SemPass(CompilerContext& ctx);
+    SemPass(CompilerContext& ctx, SourceFile& file);
+
+    void doSemPass();
+
+    /**
+     * doSemPass in steps, for a compile of several files. Each step runs for every file before the next one starts,
+     * so a class of any file can be used in all of them. This one defines the file's classes in the context.
+     */
+    void declareClasses();
+    //parents, fields and methods of the file's classes
+    void declareMembers();
+    /**
+     * global functions and method bodies. Only reads the classes, the files may be checked in parallel once the
+     * class layouts are computed
+     */
+    void checkBodies();
 
-    void doSemPass(NCompileUnit& root);
     bool hasErrors();
     void logError(YYLTYPE location, const char* format, ...);
     void logWarning(YYLTYPE location, const char* format, ...);
@@ -13,19 +13,23 @@ namespace staple {
 
     private:
         CompilerContext* mContext;
+        //the class of the same name declared before the visited one, NULL if there is none
+        StapleClass* mPrevious;
 
     public:
         Pass1ClassVisitor(CompilerContext* ctx)
-        : mContext(ctx) {}
+        : mContext(ctx), mPrevious(nullptr) {}
+
+        StapleClass* getPrevious() const { return mPrevious; }
 
         using ASTVisitor::visit;
 
         void visit(NClassDeclaration* classDeclaration) {
 
             string fqClassName = !mContext->package.empty() ? (mContext->package + "." + classDeclaration->name) : classDeclaration->name;
-            StapleClass* stpClass = new StapleClass(fqClassName);
+            StapleClass* stpClass = mContext->arena.make<StapleClass>(fqClassName);
             mContext->typeTable[classDeclaration] = stpClass;
-            mContext->defineClass(stpClass);
+            mPrevious = mContext->defineClass(stpClass, classDeclaration);
 
         }
 
@@ -0,0 +1,99 @@
+#include "symbol.h"
+#include "arena.h"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#include <llvm/ADT/Hashing.h>
+#include <llvm/ADT/StringRef.h>
+
+namespace staple {
+
+    using llvm::StringRef;
+
+    const SymbolEntry Symbol::sEmpty{"", 0};
+
+    namespace {
+
+        const size_t NUM_SHARDS = 64;
+
+        struct StringRefHash {
+            size_t operator()(StringRef str) const {
+                return llvm::hash_value(str);
+            }
+        };
+
+        /**
+         * one shard of the table, the spellings whose hash picks it. Keys point into the entries' strings, which
+         * the arena never moves
+         */
+        class SymbolShard {
+        public:
+            mutex lock;
+            Arena arena;
+            unordered_map<StringRef, const SymbolEntry*, StringRefHash> entries;
+
+            SymbolShard() {
+                entries.reserve(4096 / NUM_SHARDS);
+            }
+        };
+
+        /**
+         * files are lexed in parallel and intern every identifier, so the table is split in shards with a lock
+         * each. Ids come from one counter and stay dense
+         */
+        class SymbolTable {
+        public:
+            SymbolShard shards[NUM_SHARDS];
+            atomic<unsigned> numSymbols;
+
+            SymbolTable() : numSymbols(0) {}
+
+            SymbolShard& getShard(size_t hash) {
+                //the low bits pick the bucket inside the shard's map
+                return shards[(hash >> 16) % NUM_SHARDS];
+            }
+        };
+
+        SymbolTable& getSymbolTable() {
+            static SymbolTable table;
+            return table;
+        }
+
+    }
+
+    const SymbolEntry* Symbol::intern(const char* str, size_t length) {
+        if(length == 0) {
+            return &sEmpty;
+        }
+
+        StringRef key(str, length);
+        size_t hash = StringRefHash()(key);
+        SymbolTable& table = getSymbolTable();
+        SymbolShard& shard = table.getShard(hash);
+        lock_guard<mutex> guard(shard.lock);
+
+        auto it = shard.entries.find(key);
+        if(it != shard.entries.end()) {
+            return it->second;
+        }
+
+        //keyed on the entry's own copy, the caller's buffer goes away
+        const SymbolEntry* entry = shard.arena.make<SymbolEntry>(SymbolEntry{string(str, length), ++table.numSymbols});
+        shard.entries[StringRef(entry->str)] = entry;
+        return entry;
+    }
+
+    const Symbol SYM_THIS("this");
+    const Symbol SYM_CLASS("class");
+    const Symbol SYM_INIT("init");
+    const Symbol SYM_KILL("kill");
+    const Symbol SYM_MAIN("main");
+    const Symbol SYM_IN("in");
+
+    size_t Symbol::getNumSymbols() {
+        return getSymbolTable().numSymbols;
+    }
+
+}
@@ -0,0 +1,86 @@
+#ifndef STAPLE_SYMBOL_H
+#define STAPLE_SYMBOL_H
+
+#include <cstring>
+#include <functional>
+#include <string>
+
+namespace staple {
+
+    using namespace std;
+
+    /**
+     * interned name. Every distinct spelling exists once for the whole process, numbered densely from 1, so two
+     * names are equal exactly when their entries are.
+     */
+    struct SymbolEntry {
+        const string str;
+        const unsigned id;
+    };
+
+    /**
+     * handle to an interned name, the size of a pointer. The lexer interns every identifier, later tables key on
+     * getId() so lookups and comparisons never touch the characters. Converts to const string& where text is needed.
+     */
+    class Symbol {
+    private:
+        const SymbolEntry* mEntry;
+
+        static const SymbolEntry sEmpty;
+
+    public:
+        Symbol() : mEntry(&sEmpty) {}
+        Symbol(const SymbolEntry* entry) : mEntry(entry) {}
+        Symbol(const string& str) : mEntry(intern(str.data(), str.size())) {}
+        Symbol(const char* str) : mEntry(intern(str, strlen(str))) {}
+
+        /**
+         * entry for the spelling, created on first use. Safe to call from several threads.
+         */
+        static const SymbolEntry* intern(const char* str, size_t length);
+
+        /**
+         * number of distinct symbols interned so far, not counting the empty one
+         */
+        static size_t getNumSymbols();
+
+        unsigned getId() const { return mEntry->id; }
+        const string& str() const { return mEntry->str; }
+        const char* c_str() const { return mEntry->str.c_str(); }
+        size_t size() const { return mEntry->str.size(); }
+        bool empty() const { return mEntry == &sEmpty; }
+
+        operator const string&() const { return mEntry->str; }
+    };
+
+    /**
+     * names the compiler itself looks for, interned once at startup so comparing against them is a plain id compare
+     * instead of interning a literal under the table lock
+     */
+    extern const Symbol SYM_THIS;
+    extern const Symbol SYM_CLASS;
+    extern const Symbol SYM_INIT;
+    extern const Symbol SYM_KILL;
+    extern const Symbol SYM_MAIN;
+    extern const Symbol SYM_IN;
+
+    inline bool operator==(Symbol a, Symbol b) { return a.getId() == b.getId(); }
+    inline bool operator!=(Symbol a, Symbol b) { return a.getId() != b.getId(); }
+    //by id, the order symbols were first seen rather than alphabetical
+    inline bool operator<(Symbol a, Symbol b) { return a.getId() < b.getId(); }
+
+    inline string operator+(const string& a, Symbol b) { return a + b.str(); }
+    inline string operator+(Symbol a, const string& b) { return a.str() + b; }
+    inline string operator+(const char* a, Symbol b) { return a + b.str(); }
+    inline string operator+(Symbol a, const char* b) { return a.str() + b; }
+
+}
+
+namespace std {
+    template<>
+    struct hash<staple::Symbol> {
+        size_t operator()(staple::Symbol symbol) const { return symbol.getId(); }
+    };
+}
+
+#endif //STAPLE_SYMBOL_H
@@ -78,79 +78,121 @@ namespace staple {
     //////// Staple Class ///////
 
     StapleClass::StapleClass(const string &name, StapleClass* parent)
-    : StapleType(SK_Class), mName(name), mParent(parent) {
+    : StapleType(SK_Class), mName(name), mParent(parent), mLayoutDirty(true), mLayoutVersion(0),
+      mParentLayoutVersion(0) {
         //addField("class", new StaplePointer(new StapleClassDef(this)));
     }
 
+    StapleClass::~StapleClass() {
+        for(StapleField* field : mFields) {
+            delete field;
+        }
+        for(StapleMethodFunction* method : mMethods) {
+            delete method;
+        }
+    }
+
     void StapleClass::setParent(StapleClass* parent) {
         mParent = parent;
+        mLayoutDirty = true;
     }
 
-    StapleMethodFunction* StapleClass::addMethod(const string& name, StapleType* returnType,
+    StapleMethodFunction* StapleClass::addMethod(Symbol name, StapleType* returnType,
                                                  vector<StapleType*> argsType, bool isVarg,
                                                 StapleMethodFunction::Type type) {
         StapleMethodFunction* retval = new StapleMethodFunction(this, name, returnType, argsType, isVarg, type);
         mMethods.push_back(retval);
+        mLayoutDirty = true;
         return retval;
     }
 
-    StapleMethodFunction* StapleClass::getMethod(const string &name, int &index) const {
-        StapleMethodFunction* retval = nullptr;
-
-        if(mParent != nullptr) {
-            retval = mParent->getMethod(name, index);
+    StapleMethodFunction* StapleClass::getMethod(Symbol name, int &index) const {
+        const StapleClassLayout& layout = getLayout();
+        auto it = layout.methodSlots.find(name.getId());
+        if(it == layout.methodSlots.end()) {
+            return nullptr;
         }
-
-        if(retval == nullptr) {
-            for(StapleMethodFunction* method : mMethods) {
-                if(method->getName().compare(name) == 0) {
-                    retval = method;
-                }
-                index++;
-            }
-        }
-
-        return retval;
+        index += it->second;
+        return layout.methods[it->second];
     }
 
-    StapleField* StapleClass::addField(const string &name, StapleType *type) {
+    StapleField* StapleClass::addField(Symbol name, StapleType *type) {
         StapleField* retval = new StapleField(this, name, type);
         mFields.push_back(retval);
+        mLayoutDirty = true;
         return retval;
     }
 
-    StapleField* StapleClass::getField(const string &name, uint &index) const {
-        StapleField* retval = nullptr;
+    StapleField* StapleClass::getField(Symbol name, uint &index) const {
+        const StapleClassLayout& layout = getLayout();
+        auto it = layout.fieldSlots.find(name.getId());
+        if(it == layout.fieldSlots.end()) {
+            return nullptr;
+        }
+        index += it->second;
+        return layout.fields[it->second];
+    }
 
+    const StapleClassLayout& StapleClass::getLayout() const {
         if(mParent != nullptr) {
-            retval = mParent->getField(name, index);
+            mParent->getLayout();
+            if(mParent->mLayoutVersion != mParentLayoutVersion) {
+                mLayoutDirty = true;
+            }
         }
 
-        if(retval == nullptr) {
-            for (StapleField *field : mFields) {
-                if (field->getName().compare(name) == 0) {
-                    retval = field;
-                    break;
+        if(mLayoutDirty) {
+            if(mParent != nullptr) {
+                mLayout = mParent->mLayout;
+                mParentLayoutVersion = mParent->mLayoutVersion;
+            } else {
+                mLayout = StapleClassLayout();
+            }
+
+            for(StapleField* field : mFields) {
+                mLayout.fieldSlots[field->getName().getId()] = mLayout.fields.size();
+                mLayout.fields.push_back(field);
+            }
+
+            for(StapleMethodFunction* method : mMethods) {
+                auto it = mLayout.methodSlots.find(method->getName().getId());
+                if(it != mLayout.methodSlots.end()) {
+                    mLayout.methods[it->second] = method;
+                } else {
+                    mLayout.methodSlots[method->getName().getId()] = mLayout.methods.size();
+                    mLayout.methods.push_back(method);
+                }
+
+                if(method->getType() == StapleMethodFunction::Type::Virtual) {
+                    auto vtableIt = mLayout.vtableSlots.find(method->getName().getId());
+                    if(vtableIt != mLayout.vtableSlots.end()) {
+                        mLayout.vtable[vtableIt->second] = method;
+                    } else {
+                        mLayout.vtableSlots[method->getName().getId()] = mLayout.vtable.size();
+                        mLayout.vtable.push_back(method);
+                    }
                 }
-                index++;
             }
+
+            mLayoutDirty = false;
+            mLayoutVersion++;
         }
 
-        return retval;
+        return mLayout;
     }
 
     bool StapleClass::isAssignable(StapleType *type) {
-        bool retval = false;
-        if(StapleClass* stpClass = dyn_cast<StapleClass>(type)) {
-            retval = mName.compare(stpClass->mName) == 0;
-        }
-
-        return retval;
+        //one StapleClass per class name
+        return type == this;
     }
 
     //// Staple Function ////
 
     bool StapleFunction::isAssignable(StapleType *type) {
+        //composite types are unique, so the same pointer is the same type
+        if(type == this) {
+            return true;
+        }
         bool retval = false;
         if(StapleFunction* function = dyn_cast<StapleFunction>(type)) {
             retval = mReturnType->isAssignable(function->mReturnType);
@@ -169,18 +211,59 @@ namespace staple {
     ///// Staple Array ////
 
     bool StapleArray::isAssignable(StapleType *type) {
+        if(type == this) {
+            return true;
+        }
         bool retval = false;
+        if(StapleField* field = dyn_cast<StapleField>(type)) {
+            type = field->getElementType();
+        }
         if(StapleArray* array = dyn_cast<StapleArray>(type)) {
             retval = mElementType->isAssignable(array->mElementType);
             retval &= mSize == array->mSize;
+            retval &= mLayout == array->mLayout;
+        } else if(StapleSlice* slice = dyn_cast<StapleSlice>(type)) {
+            //fixed arrays convert to a slice view of themselves
+            retval = !isSoa() && mElementType->isAssignable(slice->getElementType());
         }
 
         return retval;
     }
 
+    ///// Staple Slice ////
+
+    bool StapleSlice::isAssignable(StapleType *type) {
+        if(type == this) {
+            return true;
+        }
+        if(StapleField* field = dyn_cast<StapleField>(type)) {
+            type = field->getElementType();
+        }
+        if(StapleSlice* slice = dyn_cast<StapleSlice>(type)) {
+            return mElementType->isAssignable(slice->mElementType);
+        } else {
+            return false;
+        }
+    }
+
+    ///// Staple Vector ////
+
+    bool StapleVector::isAssignable(StapleType *type) {
+        if(StapleField* field = dyn_cast<StapleField>(type)) {
+            type = field->getElementType();
+        }
+        //lanes are never converted implicitly, signedness only changes how they are compared
+        StapleVector* vectorType = dyn_cast<StapleVector>(type);
+        return vectorType != nullptr && vectorType->getElementType() == mElementType
+               && vectorType->getNumLanes() == mNumLanes;
+    }
+
     //// Staple Pointer ////
 
     bool StaplePointer::isAssignable(StapleType *type) {
+        if(type == this) {
+            return true;
+        }
         if(StaplePointer* ptr = dyn_cast<StaplePointer>(type)) {
             return mElementType->isAssignable(ptr->mElementType);
         } else {
@@ -5,8 +5,11 @@
 #include <string>
 #include <vector>
 
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/Support/Casting.h>
 
+#include "../symbol.h"
+
 namespace staple {
 
     using namespace std;
@@ -22,6 +25,8 @@ namespace staple {
         SK_Method,
         SK_Field,
         SK_Array,
+        SK_Slice,
+        SK_Vector,
         SK_Pointer,
         SK_Integer,
         SK_Float,
@@ -84,17 +89,17 @@ namespace staple {
 
     protected:
         StapleClass* mClass;
-        string mName;
+        Symbol mName;
         Type mType;
 
     public:
-        StapleMethodFunction(StapleClass* classType, const string& name,
+        StapleMethodFunction(StapleClass* classType, Symbol name,
                              StapleType* returnType, vector<StapleType*> argsType, bool isVarg,
                              Type type = Type::Virtual)
                 : StapleFunction(SK_Method, returnType, argsType, isVarg), mClass(classType), mName(name), mType(type) {}
 
         StapleClass* getClass() const { return mClass; }
-        const string& getName() const { return mName; }
+        Symbol getName() const { return mName; }
         const Type getType() const { return mType; }
 
         static bool classof(const StapleType *T) {
@@ -123,6 +128,20 @@ namespace staple {
     };
 
 
+    /**
+     * a class flattened with its ancestors. Fields and methods are numbered ancestors first, a method that overrides
+     * one of an ancestor keeps its slot. Names map to slots by symbol id. vtable holds just the virtual methods in the
+     * same order, so obj's kill is entry 0 as the runtime expects, and is what the emitted vtable is built from.
+     */
+    struct StapleClassLayout {
+        vector<StapleField*> fields;
+        vector<StapleMethodFunction*> methods;
+        vector<StapleMethodFunction*> vtable;
+        llvm::DenseMap<unsigned, unsigned> fieldSlots;
+        llvm::DenseMap<unsigned, unsigned> methodSlots;
+        llvm::DenseMap<unsigned, unsigned> vtableSlots;
+    };
+
     class StapleClass : public StapleType {
     private:
 
@@ -131,6 +150,13 @@ namespace staple {
         vector<StapleField*> mFields;
         vector<StapleMethodFunction*> mMethods;
 
+        //rebuilt on lookup after this class or an ancestor changed. The semantic pass builds every layout once all
+        //members are declared, after that they are only read and safe to share between threads
+        mutable StapleClassLayout mLayout;
+        mutable bool mLayoutDirty;
+        mutable unsigned mLayoutVersion;
+        mutable unsigned mParentLayoutVersion;
+
 
     public:
 
@@ -138,6 +164,7 @@ namespace staple {
          * name - FQ class name (i.e. org.staple.MyClass)
          */
         StapleClass(const string& name, StapleClass* parent = nullptr);
+        ~StapleClass();
 
 
         /**
@@ -160,14 +187,22 @@ namespace staple {
         StapleClass* getParent() const { return mParent; }
         void setParent(StapleClass* parent);
 
-        StapleMethodFunction* addMethod(const string& name, StapleType* returnType, vector<StapleType*> argsType,
+        StapleMethodFunction* addMethod(Symbol name, StapleType* returnType, vector<StapleType*> argsType,
                                         bool isVarg, StapleMethodFunction::Type type = StapleMethodFunction::Type::Virtual);
         const vector<StapleMethodFunction*> getMethods() const { return mMethods; }
-        StapleMethodFunction* getMethod(const string& name, int& index) const;
+        /**
+         * most derived method called name, NULL if there is none. Its slot is added to index.
+         */
+        StapleMethodFunction* getMethod(Symbol name, int& index) const;
 
-        StapleField* addField(const string& name, StapleType* type);
+        StapleField* addField(Symbol name, StapleType* type);
         const vector<StapleField*> getFields() const { return mFields; }
-        StapleField* getField(const string& name, uint& index) const;
+        /**
+         * field called name in this class or an ancestor, NULL if there is none. Its slot is added to index.
+         */
+        StapleField* getField(Symbol name, uint& index) const;
+
+        const StapleClassLayout& getLayout() const;
 
 
         static bool classof(const StapleType *T) {
@@ -180,14 +215,14 @@ namespace staple {
     class StapleField : public StapleType {
     protected:
         StapleClass* mClass;
-        string mName;
+        Symbol mName;
         StapleType* mType;
 
     public:
-        StapleField(StapleClass* classType, const string& name, StapleType* type)
+        StapleField(StapleClass* classType, Symbol name, StapleType* type)
         : StapleType(SK_Field), mClass(classType), mName(name), mType(type) {}
 
-        const string& getName() const { return mName; }
+        Symbol getName() const { return mName; }
         StapleType* getElementType() const { return mType; }
 
         static bool classof(const StapleType *T) {
@@ -198,15 +233,22 @@ namespace staple {
     };
 
     class StapleArray : public StapleType {
+    public:
+        enum Layout {
+            AoS,
+            SoA // one column per field of the element class
+        };
+
     private:
         StapleType* mElementType;
         uint64_t mSize;
+        Layout mLayout;
 
     public:
-        StapleArray(StapleType* elementType, uint64_t size)
-        : StapleType(SK_Array), mElementType(elementType), mSize(size) {}
+        StapleArray(StapleType* elementType, uint64_t size, Layout layout = Layout::AoS)
+        : StapleType(SK_Array), mElementType(elementType), mSize(size), mLayout(layout) {}
 
-        const StapleType* getElementType() const {
+        StapleType* getElementType() const {
             return mElementType;
         }
 
@@ -214,6 +256,9 @@ namespace staple {
             return mSize;
         }
 
+        Layout getLayout() const { return mLayout; }
+        bool isSoa() const { return mLayout == Layout::SoA; }
+
         static bool classof(const StapleType *T) {
             return T->getKind() == SK_Array;
         }
@@ -221,6 +266,51 @@ namespace staple {
         bool isAssignable(StapleType* type);
     };
 
+    /**
+     * A view of a runtime sized array: element pointer plus length.
+     */
+    class StapleSlice : public StapleType {
+    private:
+        StapleType* mElementType;
+
+    public:
+        StapleSlice(StapleType* elementType)
+        : StapleType(SK_Slice), mElementType(elementType) {}
+
+        StapleType* getElementType() const { return mElementType; }
+
+        static bool classof(const StapleType *T) {
+            return T->getKind() == SK_Slice;
+        }
+
+        bool isAssignable(StapleType* type);
+    };
+
+    /**
+     * SIMD vector of int or float lanes, i.e. float32x4
+     */
+    class StapleVector : public StapleType {
+    private:
+        StapleType* mElementType;
+        uint32_t mNumLanes;
+        //scalar ints carry no signedness, uintNxM vectors compare, divide and reduce their lanes as unsigned
+        bool mIsUnsigned;
+
+    public:
+        StapleVector(StapleType* elementType, uint32_t numLanes, bool isUnsigned)
+        : StapleType(SK_Vector), mElementType(elementType), mNumLanes(numLanes), mIsUnsigned(isUnsigned) {}
+
+        StapleType* getElementType() const { return mElementType; }
+        uint32_t getNumLanes() const { return mNumLanes; }
+        bool isUnsigned() const { return mIsUnsigned; }
+
+        static bool classof(const StapleType *T) {
+            return T->getKind() == SK_Vector;
+        }
+
+        bool isAssignable(StapleType* type);
+    };
+
     class StaplePointer : public StapleType {
     private:
         StapleType* mElementType;
@@ -267,6 +357,14 @@ namespace staple {
         StapleFloat(Type type)
         : StapleType(SK_Float), mType(type) {}
 
+        uint8_t getWidth() const {
+            switch(mType) {
+                case Type::f16: return 16;
+                case Type::f32: return 32;
+                default: return 64;
+            }
+        }
+
         static bool classof(const StapleType *T) {
             return T->getKind() == SK_Float;
         }
@@ -0,0 +1,35 @@
+#include "typecontext.h"
+
+#include <llvm/ADT/Hashing.h>
+
+namespace staple {
+
+    size_t TypeContext::KeyHash::operator()(const Key& key) const {
+        return llvm::hash_combine(key.kind, key.element, key.size, key.flags,
+                                  llvm::hash_combine_range(key.arguments.begin(), key.arguments.end()));
+    }
+
+    StaplePointer* TypeContext::getPointerType(StapleType* elementType) {
+        return get<StaplePointer>(Key{SK_Pointer, elementType, 0, 0, {}}, elementType);
+    }
+
+    StapleArray* TypeContext::getArrayType(StapleType* elementType, uint64_t size, StapleArray::Layout layout) {
+        return get<StapleArray>(Key{SK_Array, elementType, size, (uint32_t)layout, {}}, elementType, size, layout);
+    }
+
+    StapleSlice* TypeContext::getSliceType(StapleType* elementType) {
+        return get<StapleSlice>(Key{SK_Slice, elementType, 0, 0, {}}, elementType);
+    }
+
+    StapleVector* TypeContext::getVectorType(StapleType* elementType, uint32_t numLanes, bool isUnsigned) {
+        return get<StapleVector>(Key{SK_Vector, elementType, numLanes, isUnsigned ? 1u : 0u, {}},
+                                 elementType, numLanes, isUnsigned);
+    }
+
+    StapleFunction* TypeContext::getFunctionType(StapleType* returnType, const vector<StapleType*>& argsType,
+                                                 bool isVarg) {
+        return get<StapleFunction>(Key{SK_Function, returnType, 0, isVarg ? 1u : 0u, argsType},
+                                   returnType, argsType, isVarg);
+    }
+
+}
@@ -0,0 +1,69 @@
+#ifndef STAPLE_TYPECONTEXT_H
+#define STAPLE_TYPECONTEXT_H
+
+#include "stapletype.h"
+#include "../arena.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace staple {
+
+    using namespace std;
+
+    /**
+     * owner of the composite types of a compile. Every pointer, array, slice, vector and function type exists once
+     * per structure, so two types are the same exactly when their pointers are equal. Scalars are singletons already
+     * and classes are unique by name.
+     */
+    class TypeContext {
+    private:
+        struct Key {
+            StapleKind kind;
+            StapleType* element;
+            uint64_t size;
+            uint32_t flags;
+            vector<StapleType*> arguments;
+
+            bool operator==(const Key& other) const {
+                return kind == other.kind && element == other.element && size == other.size
+                       && flags == other.flags && arguments == other.arguments;
+            }
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& key) const;
+        };
+
+        Arena& mArena;
+        unordered_map<Key, StapleType*, KeyHash> mTypes;
+        //files are type checked in parallel
+        mutex mLock;
+
+        template<typename T, typename... Args>
+        T* get(const Key& key, Args&&... args) {
+            lock_guard<mutex> guard(mLock);
+            StapleType*& type = mTypes[key];
+            if(type == nullptr) {
+                type = mArena.make<T>(std::forward<Args>(args)...);
+            }
+            return static_cast<T*>(type);
+        }
+
+    public:
+        TypeContext(Arena& arena) : mArena(arena) {}
+
+        StaplePointer* getPointerType(StapleType* elementType);
+        StapleArray* getArrayType(StapleType* elementType, uint64_t size,
+                                  StapleArray::Layout layout = StapleArray::Layout::AoS);
+        StapleSlice* getSliceType(StapleType* elementType);
+        StapleVector* getVectorType(StapleType* elementType, uint32_t numLanes, bool isUnsigned = false);
+        StapleFunction* getFunctionType(StapleType* returnType, const vector<StapleType*>& argsType, bool isVarg);
+
+        size_t getNumTypes() const { return mTypes.size(); }
+    };
+
+}
+
+#endif //STAPLE_TYPECONTEXT_H
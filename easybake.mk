@@ -1,3 +1,4 @@
 
 include compiler/easybake.mk
-include runtime/easybake.mk
\ No newline at end of file
+include runtime/easybake.mk
+include bench/easybake.mk
\ No newline at end of file
@@ -4,6 +4,11 @@ include $(DEFINE_MODULE)
 MODULE := stp_runtime
 LLC := llc
 LOCAL_SRCS := \
-    src/runtime.ll
+    src/runtime.ll \
+    src/cpu.c \
+    src/profile.c \
+    src/heap.c \
+    src/refcount.c \
+    src/trace.c
 
 include $(BUILD_LIBRARY)
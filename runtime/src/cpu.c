@@ -0,0 +1,104 @@
+#include <string.h>
+
+/**
+ * cpu feature detection for target_clones dispatch. Feature names follow LLVM's x86 features.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <cpuid.h>
+
+enum { EAX, EBX, ECX, EDX };
+
+//register state the os has to save for the feature to be usable (XCR0 bits)
+#define OS_NONE 0
+#define OS_AVX 0x6
+#define OS_AVX512 0xe6
+
+struct cpu_feature {
+    const char* name;
+    unsigned leaf;
+    int reg;
+    unsigned bit;
+    unsigned osState;
+};
+
+static const struct cpu_feature features[] = {
+    { "sse3",     1, ECX, 0,  OS_NONE },
+    { "ssse3",    1, ECX, 9,  OS_NONE },
+    { "fma",      1, ECX, 12, OS_AVX },
+    { "sse4.1",   1, ECX, 19, OS_NONE },
+    { "sse4.2",   1, ECX, 20, OS_NONE },
+    { "popcnt",   1, ECX, 23, OS_NONE },
+    { "avx",      1, ECX, 28, OS_AVX },
+    { "f16c",     1, ECX, 29, OS_AVX },
+    { "bmi",      7, EBX, 3,  OS_NONE },
+    { "avx2",     7, EBX, 5,  OS_AVX },
+    { "bmi2",     7, EBX, 8,  OS_NONE },
+    { "avx512f",  7, EBX, 16, OS_AVX512 },
+    { "avx512dq", 7, EBX, 17, OS_AVX512 },
+    { "avx512cd", 7, EBX, 28, OS_AVX512 },
+    { "avx512bw", 7, EBX, 30, OS_AVX512 },
+    { "avx512vl", 7, EBX, 31, OS_AVX512 },
+};
+
+static unsigned osState() {
+    unsigned regs[4];
+    __cpuid(1, regs[EAX], regs[EBX], regs[ECX], regs[EDX]);
+
+    //OSXSAVE
+    if(!(regs[ECX] & (1u << 27))) {
+        return 0;
+    }
+
+    unsigned eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return eax;
+}
+
+static int hasFeature(const char* name, size_t length) {
+    unsigned i;
+    for(i=0;i<sizeof(features)/sizeof(features[0]);i++) {
+        const struct cpu_feature* feature = &features[i];
+        if(strlen(feature->name) != length || strncmp(feature->name, name, length) != 0) {
+            continue;
+        }
+
+        if(__get_cpuid_max(0, 0) < feature->leaf) {
+            return 0;
+        }
+
+        unsigned regs[4];
+        __cpuid_count(feature->leaf, 0, regs[EAX], regs[EBX], regs[ECX], regs[EDX]);
+        if(!(regs[feature->reg] & (1u << feature->bit))) {
+            return 0;
+        }
+        return (osState() & feature->osState) == feature->osState;
+    }
+    return 0;
+}
+
+/**
+ * 1 if the cpu supports every feature of the comma separated list
+ */
+int stp_cpu_supports(const char* list) {
+    while(*list != '\0') {
+        size_t length = strcspn(list, ",");
+        if(!hasFeature(list, length)) {
+            return 0;
+        }
+        list += length;
+        if(*list == ',') {
+            list++;
+        }
+    }
+    return 1;
+}
+
+#else
+
+int stp_cpu_supports(const char* list) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,323 @@
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Heap allocation for generated code, with an optional heap profiler.
+ *
+ * The profiler is off unless STP_HEAP_PROFILE names a report file or the program was compiled with --heap-profile.
+ * When on, every allocation carries a small header and allocations are sampled on average once every
+ * STP_HEAP_PROFILE_RATE bytes (default 512KiB, 1 samples everything). Each sample is weighted so the statistics
+ * estimate the whole heap. The report is written at exit and, after SIGUSR2, at the next allocation. Statistics
+ * updates hold statsLock shared and the report holds it exclusively, so it never sees half of an update.
+ * STP_HEAP_PROFILE_FORMAT=pprof writes the legacy pprof heap format instead of the text report.
+ */
+
+//statistics of one allocation site, stored inside the site record the compiler emits
+struct stp_heap_stats {
+    struct stp_alloc_site* next;
+    int64_t registered;
+    int64_t allocs;
+    int64_t frees;
+    int64_t allocBytes;
+    int64_t freeBytes;
+    int64_t peakBytes;
+    int64_t callerPC;
+};
+
+struct stp_alloc_site {
+    const char* typeName;
+    const char* function;
+    int32_t line;
+    int32_t column;
+    struct stp_heap_stats stats;
+};
+
+//in front of every allocation while profiling, 16 byte multiple to keep malloc's alignment
+struct stp_heap_header {
+    struct stp_alloc_site* site; // NULL when not sampled
+    int64_t chargedCount;
+    int64_t chargedBytes;
+    int64_t reserved;
+};
+
+enum { UNDECIDED, OFF, ON };
+
+static int state = UNDECIDED;
+static pthread_once_t initOnce = PTHREAD_ONCE_INIT;
+static const char* reportFile = NULL;
+static int pprofFormat = 0;
+static int64_t sampleRate = 512 * 1024;
+
+static struct stp_alloc_site* sites = NULL;
+static int64_t liveBytes = 0;
+static int64_t peakBytes = 0;
+static pthread_rwlock_t statsLock = PTHREAD_RWLOCK_INITIALIZER;
+static volatile sig_atomic_t dumpRequested = 0;
+
+static __thread int64_t bytesUntilSample = -1;
+//own generator, profiling must not change the sequence the program gets from rand()
+static __thread uint64_t randomState = 0;
+
+static void writeReport(void);
+
+//only sets the flag, the allocator may be in the middle of an update when the signal arrives
+static void onDumpSignal(int sig) {
+    (void)sig;
+    dumpRequested = 1;
+}
+
+static void init(void) {
+    const char* env = getenv("STP_HEAP_PROFILE");
+    if(env != NULL && *env != '\0') {
+        reportFile = env;
+    }
+    if(reportFile == NULL) {
+        state = OFF;
+        return;
+    }
+
+    const char* rate = getenv("STP_HEAP_PROFILE_RATE");
+    if(rate != NULL) {
+        sampleRate = atoll(rate);
+    }
+    const char* format = getenv("STP_HEAP_PROFILE_FORMAT");
+    pprofFormat = format != NULL && strcmp(format, "pprof") == 0;
+
+    signal(SIGUSR2, onDumpSignal);
+    atexit(writeReport);
+    state = ON;
+}
+
+/**
+ * called from a constructor of programs compiled with --heap-profile. The environment still wins.
+ */
+void stp_heap_profile_enable(const char* filename) {
+    if(state != UNDECIDED) {
+        return;
+    }
+    reportFile = filename;
+    pthread_once(&initOnce, init);
+}
+
+static void atomicMax(int64_t* value, int64_t candidate) {
+    int64_t current = *value;
+    while(candidate > current) {
+        int64_t seen = __sync_val_compare_and_swap(value, current, candidate);
+        if(seen == current) {
+            break;
+        }
+        current = seen;
+    }
+}
+
+//xorshift64*, uniform in (0, 1)
+static double nextUniform(void) {
+    if(randomState == 0) {
+        //thread locals have a different address in every thread
+        randomState = ((uint64_t)(uintptr_t)&randomState * 0x9E3779B97F4A7C15ull) | 1;
+    }
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    uint64_t bits = (randomState * 0x2545F4914F6CDD1Dull) >> 11;
+    return (bits + 1.0) / 9007199254740994.0;
+}
+
+//exponentially distributed gap between samples, so every byte is equally likely to be sampled
+static int64_t nextSampleGap(void) {
+    return (int64_t)(-log(nextUniform()) * sampleRate) + 1;
+}
+
+static void record(struct stp_heap_header* header, struct stp_alloc_site* site, int64_t size, void* caller) {
+    header->site = NULL;
+    if(sampleRate > 1) {
+        if(bytesUntilSample < 0) {
+            bytesUntilSample = nextSampleGap();
+        }
+        bytesUntilSample -= size;
+        if(bytesUntilSample > 0) {
+            return;
+        }
+        bytesUntilSample = nextSampleGap();
+    }
+
+    //a sampled allocation stands for 1 / P(sampled) allocations like it
+    double weight = sampleRate > 1 ? 1.0 / (1.0 - exp(-(double)size / sampleRate)) : 1.0;
+    header->site = site;
+    header->chargedCount = (int64_t)(weight + 0.5);
+    header->chargedBytes = (int64_t)(weight * size + 0.5);
+
+    pthread_rwlock_rdlock(&statsLock);
+    struct stp_heap_stats* stats = &site->stats;
+    if(__sync_bool_compare_and_swap(&stats->registered, 0, 1)) {
+        stats->callerPC = (int64_t)(intptr_t)caller;
+        do {
+            stats->next = sites;
+        } while(!__sync_bool_compare_and_swap(&sites, stats->next, site));
+    }
+
+    __sync_fetch_and_add(&stats->allocs, header->chargedCount);
+    int64_t siteLive = __sync_add_and_fetch(&stats->allocBytes, header->chargedBytes) - stats->freeBytes;
+    atomicMax(&stats->peakBytes, siteLive);
+    atomicMax(&peakBytes, __sync_add_and_fetch(&liveBytes, header->chargedBytes));
+    pthread_rwlock_unlock(&statsLock);
+}
+
+void* stp_alloc(int32_t size, struct stp_alloc_site* site) {
+    pthread_once(&initOnce, init);
+    if(state == OFF) {
+        return malloc(size);
+    }
+
+    //the first thread to get here writes it
+    if(dumpRequested && __sync_bool_compare_and_swap(&dumpRequested, 1, 0)) {
+        writeReport();
+    }
+
+    struct stp_heap_header* header = malloc(sizeof(struct stp_heap_header) + size);
+    if(header == NULL) {
+        return NULL;
+    }
+    record(header, site, size, __builtin_return_address(0));
+    return header + 1;
+}
+
+void stp_free(void* ptr) {
+    if(state != ON || ptr == NULL) {
+        free(ptr);
+        return;
+    }
+
+    struct stp_heap_header* header = (struct stp_heap_header*)ptr - 1;
+    if(header->site != NULL) {
+        struct stp_heap_stats* stats = &header->site->stats;
+        pthread_rwlock_rdlock(&statsLock);
+        __sync_fetch_and_add(&stats->frees, header->chargedCount);
+        __sync_fetch_and_add(&stats->freeBytes, header->chargedBytes);
+        __sync_fetch_and_sub(&liveBytes, header->chargedBytes);
+        pthread_rwlock_unlock(&statsLock);
+    }
+    free(header);
+}
+
+static int compareLiveBytes(const void* a, const void* b) {
+    const struct stp_alloc_site* siteA = *(struct stp_alloc_site* const*)a;
+    const struct stp_alloc_site* siteB = *(struct stp_alloc_site* const*)b;
+    int64_t liveA = siteA->stats.allocBytes - siteA->stats.freeBytes;
+    int64_t liveB = siteB->stats.allocBytes - siteB->stats.freeBytes;
+    return liveA < liveB ? 1 : liveA > liveB ? -1 : 0;
+}
+
+static void writeText(FILE* file, struct stp_alloc_site** sorted, int numSites) {
+    int i, j;
+
+    fprintf(file, "stp heap profile, %s\n", sampleRate > 1 ? "sampled estimate" : "every allocation");
+    fprintf(file, "live bytes %lld, peak live bytes %lld\n\n", (long long)liveBytes, (long long)peakBytes);
+
+    //classes are reported in the order of their largest site
+    fprintf(file, "%12s %14s %12s  %s\n", "live objs", "live bytes", "allocs", "type");
+    for(i=0;i<numSites;i++) {
+        int seen = 0;
+        for(j=0;j<i && !seen;j++) {
+            seen = strcmp(sorted[j]->typeName, sorted[i]->typeName) == 0;
+        }
+        if(seen) {
+            continue;
+        }
+
+        int64_t objects = 0, bytes = 0, allocs = 0;
+        for(j=i;j<numSites;j++) {
+            const struct stp_heap_stats* stats = &sorted[j]->stats;
+            if(strcmp(sorted[j]->typeName, sorted[i]->typeName) == 0) {
+                objects += stats->allocs - stats->frees;
+                bytes += stats->allocBytes - stats->freeBytes;
+                allocs += stats->allocs;
+            }
+        }
+        fprintf(file, "%12lld %14lld %12lld  %s\n", (long long)objects, (long long)bytes, (long long)allocs,
+                sorted[i]->typeName);
+    }
+
+    fprintf(file, "\n%12s %14s %14s %12s  %s\n", "live objs", "live bytes", "peak bytes", "allocs", "site");
+    for(i=0;i<numSites;i++) {
+        const struct stp_alloc_site* site = sorted[i];
+        const struct stp_heap_stats* stats = &site->stats;
+        fprintf(file, "%12lld %14lld %14lld %12lld  %s in %s:%d:%d\n",
+                (long long)(stats->allocs - stats->frees), (long long)(stats->allocBytes - stats->freeBytes),
+                (long long)stats->peakBytes, (long long)stats->allocs,
+                site->typeName, site->function, site->line, site->column);
+    }
+}
+
+/**
+ * gperftools' legacy heap profile, one single frame "stack" per allocation site. pprof symbolizes the call
+ * address with the binary and the mappings at the end.
+ */
+static void writePprof(FILE* file, struct stp_alloc_site** sorted, int numSites) {
+    int64_t liveObjects = 0, live = 0, allocs = 0, allocBytes = 0;
+    int i;
+    for(i=0;i<numSites;i++) {
+        const struct stp_heap_stats* stats = &sorted[i]->stats;
+        liveObjects += stats->allocs - stats->frees;
+        live += stats->allocBytes - stats->freeBytes;
+        allocs += stats->allocs;
+        allocBytes += stats->allocBytes;
+    }
+
+    fprintf(file, "heap profile: %lld: %lld [%lld: %lld] @ heapprofile\n",
+            (long long)liveObjects, (long long)live, (long long)allocs, (long long)allocBytes);
+    for(i=0;i<numSites;i++) {
+        const struct stp_heap_stats* stats = &sorted[i]->stats;
+        fprintf(file, "%lld: %lld [%lld: %lld] @ 0x%llx\n",
+                (long long)(stats->allocs - stats->frees), (long long)(stats->allocBytes - stats->freeBytes),
+                (long long)stats->allocs, (long long)stats->allocBytes, (unsigned long long)stats->callerPC);
+    }
+
+    fprintf(file, "\nMAPPED_LIBRARIES:\n");
+    FILE* maps = fopen("/proc/self/maps", "r");
+    if(maps != NULL) {
+        char buffer[4096];
+        size_t read;
+        while((read = fread(buffer, 1, sizeof(buffer), maps)) > 0) {
+            fwrite(buffer, 1, read, file);
+        }
+        fclose(maps);
+    }
+}
+
+static void writeReport(void) {
+    pthread_rwlock_wrlock(&statsLock);
+
+    int numSites = 0;
+    struct stp_alloc_site* site;
+    for(site = sites; site != NULL; site = site->stats.next) {
+        numSites++;
+    }
+
+    struct stp_alloc_site** sorted = malloc(sizeof(struct stp_alloc_site*) * (numSites + 1));
+    int i = 0;
+    for(site = sites; site != NULL && i < numSites; site = site->stats.next) {
+        sorted[i++] = site;
+    }
+    qsort(sorted, numSites, sizeof(struct stp_alloc_site*), compareLiveBytes);
+
+    FILE* file = fopen(reportFile, "w");
+    if(file == NULL) {
+        fprintf(stderr, "stp: cannot write heap profile %s\n", reportFile);
+    } else {
+        if(pprofFormat) {
+            writePprof(file, sorted, numSites);
+        } else {
+            writeText(file, sorted, numSites);
+        }
+        fclose(file);
+    }
+    free(sorted);
+
+    pthread_rwlock_unlock(&statsLock);
+}
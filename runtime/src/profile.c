@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * counters of programs compiled with --profile-generate. Every module registers its table from a constructor and
+ * all of them are appended to the profile file at exit. The compiler adds up repeated sites, so several runs
+ * accumulate in one file; delete it to start over. STP_PROFILE_FILE overrides the file name.
+ */
+
+struct stp_prof_site {
+    const char* function;
+    int32_t line;
+    int32_t column;
+    int32_t kind;
+    uint64_t* counter;
+};
+
+struct stp_prof_module {
+    const char* filename;
+    const struct stp_prof_site* sites;
+    int32_t numSites;
+    struct stp_prof_module* next;
+};
+
+static struct stp_prof_module* modules = NULL;
+
+static void writeProfiles(void) {
+    const char* override = getenv("STP_PROFILE_FILE");
+
+    struct stp_prof_module* module;
+    for(module = modules; module != NULL; module = module->next) {
+        const char* filename = override != NULL ? override : module->filename;
+        FILE* file = fopen(filename, "a");
+        if(file == NULL) {
+            fprintf(stderr, "stp: cannot write profile %s\n", filename);
+            continue;
+        }
+
+        int32_t i;
+        for(i=0;i<module->numSites;i++) {
+            const struct stp_prof_site* site = &module->sites[i];
+            fprintf(file, "%s %d %d %d %llu\n", site->function, site->line, site->column, site->kind,
+                    (unsigned long long)*site->counter);
+        }
+        fclose(file);
+    }
+}
+
+void stp_prof_register(const char* filename, const struct stp_prof_site* sites, int32_t numSites) {
+    struct stp_prof_module* module = malloc(sizeof(struct stp_prof_module));
+    module->filename = filename;
+    module->sites = sites;
+    module->numSites = numSites;
+    module->next = modules;
+
+    if(modules == NULL) {
+        atexit(writeProfiles);
+    }
+    modules = module;
+}
@@ -0,0 +1,107 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * refcount call counters of programs compiled with --refcount-profile. Every module registers its table from a
+ * constructor. At exit all sites that ran are written to the report file, busiest first. STP_RC_PROFILE_FILE
+ * overrides the file name, "-" writes to stderr.
+ */
+
+struct stp_rc_site {
+    const char* function;
+    int32_t line;
+    int32_t column;
+    int32_t op;
+    uint64_t* counter;
+};
+
+struct stp_rc_module {
+    const char* filename;
+    const struct stp_rc_site* sites;
+    int32_t numSites;
+    struct stp_rc_module* next;
+};
+
+static struct stp_rc_module* modules = NULL;
+
+//indexed by the compiler's RefcountOp
+static const char* opNames[] = { "storeStrong", "release scope var", "release temporary" };
+
+static int compareCounts(const void* a, const void* b) {
+    uint64_t countA = *(*(const struct stp_rc_site* const*)a)->counter;
+    uint64_t countB = *(*(const struct stp_rc_site* const*)b)->counter;
+    return countA < countB ? 1 : countA > countB ? -1 : 0;
+}
+
+static void writeTable(FILE* file, const struct stp_rc_site** sites, int32_t numSites) {
+    uint64_t opTotals[3] = { 0, 0, 0 };
+    uint64_t total = 0;
+    int32_t i;
+    for(i=0;i<numSites;i++) {
+        opTotals[sites[i]->op] += *sites[i]->counter;
+        total += *sites[i]->counter;
+    }
+
+    fprintf(file, "stp refcount profile, %llu calls\n", (unsigned long long)total);
+    for(i=0;i<3;i++) {
+        fprintf(file, "%14llu  %s\n", (unsigned long long)opTotals[i], opNames[i]);
+    }
+
+    fprintf(file, "\n%14s %7s  %-18s %s\n", "calls", "%", "operation", "site");
+    for(i=0;i<numSites;i++) {
+        const struct stp_rc_site* site = sites[i];
+        fprintf(file, "%14llu %6.2f%%  %-18s %s:%d:%d\n", (unsigned long long)*site->counter,
+                100.0 * *site->counter / total, opNames[site->op], site->function, site->line, site->column);
+    }
+}
+
+static void writeReport(void) {
+    int32_t numSites = 0;
+    struct stp_rc_module* module;
+    for(module = modules; module != NULL; module = module->next) {
+        numSites += module->numSites;
+    }
+
+    //sites that never ran are left out
+    const struct stp_rc_site** sites = malloc(sizeof(struct stp_rc_site*) * (numSites + 1));
+    int32_t count = 0;
+    for(module = modules; module != NULL; module = module->next) {
+        int32_t i;
+        for(i=0;i<module->numSites;i++) {
+            if(*module->sites[i].counter != 0) {
+                sites[count++] = &module->sites[i];
+            }
+        }
+    }
+    qsort(sites, count, sizeof(struct stp_rc_site*), compareCounts);
+
+    const char* filename = getenv("STP_RC_PROFILE_FILE");
+    if(filename == NULL) {
+        filename = modules->filename;
+    }
+
+    FILE* file = filename[0] == '-' && filename[1] == '\0' ? stderr : fopen(filename, "w");
+    if(file == NULL) {
+        fprintf(stderr, "stp: cannot write refcount profile %s\n", filename);
+    } else {
+        writeTable(file, sites, count);
+        if(file != stderr) {
+            fclose(file);
+        }
+    }
+    free(sites);
+}
+
+void stp_rc_register(const char* filename, const struct stp_rc_site* sites, int32_t numSites) {
+    struct stp_rc_module* module = malloc(sizeof(struct stp_rc_module));
+    module->filename = filename;
+    module->sites = sites;
+    module->numSites = numSites;
+    module->next = modules;
+
+    if(modules == NULL) {
+        atexit(writeReport);
+    }
+    modules = module;
+}
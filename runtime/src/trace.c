@@ -0,0 +1,402 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/**
+ * function entry/exit trace of programs compiled with --instrument-functions. Every thread records its events into
+ * its own ring buffer without locks on the hot path, once full the oldest events are overwritten. When a thread exits
+ * its events are moved into a buffer just large enough to hold them and the ring is freed. The buffers are written at
+ * exit, or whenever the program calls stp_trace_flush, to stp-trace.json in Chrome's trace event format
+ * (chrome://tracing, Perfetto). STP_TRACE_FILE changes the file, STP_TRACE_FORMAT=binary writes the
+ * compact format below instead and STP_TRACE_EVENTS sets the events per thread (default 1M, rounded up to a power of 2).
+ *
+ * binary format, little endian:
+ *   "STPTRACE" u32 version, u32 number of names, per name: u32 length, bytes
+ *   then per thread: u32 tid, u32 number of events, per event: u64 nanoseconds, u32 name index, u32 phase (0 enter, 1 exit)
+ */
+
+enum { ENTER, EXIT };
+
+//the phase is kept in the top bit of the timestamp
+#define PHASE_BIT 63
+
+struct stp_trace_event {
+    uint64_t timestamp;
+    const char* name;
+};
+
+/**
+ * the owning thread is the only writer. head counts the events ever recorded and is published with release semantics
+ * after each event, a flush copies events and then rereads head to drop the ones overwritten while it was copying.
+ */
+struct stp_trace_buffer {
+    uint64_t head;
+    uint64_t mask;
+    int32_t tid;
+    struct stp_trace_buffer* next;
+    struct stp_trace_event* events;
+};
+
+//the events a flush copied out of one buffer
+struct stp_trace_snapshot {
+    int32_t tid;
+    uint64_t count;
+    struct stp_trace_event* events;
+};
+
+static pthread_once_t initOnce = PTHREAD_ONCE_INIT;
+static uint64_t bufferSize;
+static struct stp_trace_buffer* buffers = NULL;
+
+//frees the ring of an exiting thread
+static pthread_key_t bufferKey;
+//held while copying buffers, so an exiting thread doesn't free the events a flush is reading
+static pthread_mutex_t flushLock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct stp_trace_buffer* threadBuffer = NULL;
+
+static uint64_t clockNanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+//events are stamped with the time stamp counter and converted to nanoseconds with a rate measured between the first
+//event and the flush
+static uint64_t startTicks;
+static uint64_t startNanos;
+
+static inline uint64_t timestamp(void) {
+    return __builtin_ia32_rdtsc();
+}
+
+static void startClock(void) {
+    startNanos = clockNanos();
+    startTicks = timestamp();
+}
+
+static double nanosPerTick(void) {
+    uint64_t ticks = timestamp() - startTicks;
+    uint64_t nanos = clockNanos() - startNanos;
+    return ticks > 0 ? (double)nanos / ticks : 1.0;
+}
+
+static uint64_t toNanos(uint64_t ticks, double scale) {
+    return (uint64_t)((ticks - startTicks) * scale);
+}
+
+#else
+
+static uint64_t startNanos;
+
+static inline uint64_t timestamp(void) {
+    return clockNanos();
+}
+
+static void startClock(void) {
+    startNanos = clockNanos();
+}
+
+static double nanosPerTick(void) {
+    return 1.0;
+}
+
+static uint64_t toNanos(uint64_t ticks, double scale) {
+    return ticks - startNanos;
+}
+
+#endif
+
+void stp_trace_flush(void);
+static void retireBuffer(void* data);
+
+static void init(void) {
+    const char* events = getenv("STP_TRACE_EVENTS");
+    uint64_t requested = events != NULL ? strtoull(events, NULL, 10) : 0;
+    if(requested == 0) {
+        requested = 1 << 20;
+    }
+    bufferSize = 1;
+    while(bufferSize < requested) {
+        bufferSize <<= 1;
+    }
+
+    startClock();
+    pthread_key_create(&bufferKey, retireBuffer);
+    atexit(stp_trace_flush);
+}
+
+static struct stp_trace_buffer* createBuffer(void) {
+    pthread_once(&initOnce, init);
+
+    struct stp_trace_buffer* buffer = malloc(sizeof(struct stp_trace_buffer));
+    if(buffer == NULL) {
+        return NULL;
+    }
+    buffer->events = malloc(bufferSize * sizeof(struct stp_trace_event));
+    if(buffer->events == NULL) {
+        free(buffer);
+        return NULL;
+    }
+    buffer->head = 0;
+    buffer->mask = bufferSize - 1;
+    buffer->tid = (int32_t)syscall(SYS_gettid);
+    do {
+        buffer->next = buffers;
+    } while(!__sync_bool_compare_and_swap(&buffers, buffer->next, buffer));
+    pthread_setspecific(bufferKey, buffer);
+    return buffer;
+}
+
+static inline void record(const char* name, int phase) {
+    struct stp_trace_buffer* buffer = threadBuffer;
+    if(buffer == NULL) {
+        buffer = threadBuffer = createBuffer();
+        if(buffer == NULL) {
+            return;
+        }
+    }
+
+    uint64_t head = buffer->head;
+    struct stp_trace_event* event = &buffer->events[head & buffer->mask];
+    //order the last published head before overwriting the slot, a flush that copied the old event then sees the
+    //overwrite when it rereads head. both fences are free on x86
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&event->timestamp, timestamp() | (uint64_t)phase << PHASE_BIT, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->name, name, __ATOMIC_RELAXED);
+    //publish the event after writing it, so a flush never sees a half written one
+    __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void stp_trace_enter(const char* name) {
+    record(name, ENTER);
+}
+
+void stp_trace_exit(const char* name) {
+    record(name, EXIT);
+}
+
+static uint64_t eventTicks(const struct stp_trace_event* event) {
+    return event->timestamp & ~((uint64_t)1 << PHASE_BIT);
+}
+
+static int eventPhase(const struct stp_trace_event* event) {
+    return (int)(event->timestamp >> PHASE_BIT);
+}
+
+//the oldest event still in the buffer, threads keep running during a flush so stay clear of the write position
+static uint64_t firstEvent(uint64_t head, uint64_t mask) {
+    return head > mask ? head - mask : 0;
+}
+
+/**
+ * TLS destructor of a thread's buffer: its events move into the smallest power of 2 buffer that holds them and the
+ * ring is freed. The buffer stays in the list for the next flush, and records made by later destructors of the
+ * thread wrap within the smaller buffer.
+ */
+static void retireBuffer(void* data) {
+    struct stp_trace_buffer* buffer = data;
+    uint64_t oldest = firstEvent(buffer->head, buffer->mask);
+    uint64_t count = buffer->head - oldest;
+    uint64_t size = 1, i;
+    while(size <= count) {
+        size <<= 1;
+    }
+
+    struct stp_trace_event* events = malloc(size * sizeof(struct stp_trace_event));
+    if(events == NULL) {
+        return;
+    }
+    for(i = oldest; i < buffer->head; i++) {
+        events[i - oldest] = buffer->events[i & buffer->mask];
+    }
+
+    pthread_mutex_lock(&flushLock);
+    struct stp_trace_event* ring = buffer->events;
+    buffer->events = events;
+    buffer->mask = size - 1;
+    __atomic_store_n(&buffer->head, count, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&flushLock);
+    free(ring);
+}
+
+//copies the events of a buffer that its thread may still be appending to, returns how many are intact
+static uint64_t copyEvents(const struct stp_trace_buffer* buffer, struct stp_trace_event* events) {
+    uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    uint64_t oldest = firstEvent(head, buffer->mask);
+    uint64_t i;
+    for(i = oldest; i < head; i++) {
+        const struct stp_trace_event* event = &buffer->events[i & buffer->mask];
+        events[i - oldest].timestamp = __atomic_load_n(&event->timestamp, __ATOMIC_RELAXED);
+        events[i - oldest].name = __atomic_load_n(&event->name, __ATOMIC_RELAXED);
+    }
+
+    //the thread may have overwritten the oldest copies meanwhile, drop every slot it could have reached
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t intact = firstEvent(__atomic_load_n(&buffer->head, __ATOMIC_RELAXED), buffer->mask);
+    if(intact <= oldest) {
+        return head - oldest;
+    }
+    if(intact >= head) {
+        return 0;
+    }
+    memmove(events, events + (intact - oldest), (head - intact) * sizeof(struct stp_trace_event));
+    return head - intact;
+}
+
+//copies every buffer, returns the number of snapshots or -1 when out of memory
+static int takeSnapshots(struct stp_trace_snapshot** result) {
+    struct stp_trace_buffer* first = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+    struct stp_trace_buffer* buffer;
+    int numBuffers = 0, b;
+
+    pthread_mutex_lock(&flushLock);
+    for(buffer = first; buffer != NULL; buffer = buffer->next) {
+        numBuffers++;
+    }
+    struct stp_trace_snapshot* snapshots = calloc(numBuffers, sizeof(struct stp_trace_snapshot));
+    for(buffer = first, b = 0; snapshots != NULL && b < numBuffers; buffer = buffer->next, b++) {
+        snapshots[b].tid = buffer->tid;
+        snapshots[b].events = malloc((buffer->mask + 1) * sizeof(struct stp_trace_event));
+        if(snapshots[b].events == NULL) {
+            numBuffers = b;
+            break;
+        }
+        snapshots[b].count = copyEvents(buffer, snapshots[b].events);
+    }
+    pthread_mutex_unlock(&flushLock);
+
+    *result = snapshots;
+    return snapshots != NULL ? numBuffers : -1;
+}
+
+static void writeJson(FILE* file, const struct stp_trace_snapshot* snapshots, int numSnapshots, double scale) {
+    int first = 1, b;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for(b = 0; b < numSnapshots; b++) {
+        uint64_t i;
+        for(i = 0; i < snapshots[b].count; i++) {
+            const struct stp_trace_event* event = &snapshots[b].events[i];
+            uint64_t nanos = toNanos(eventTicks(event), scale);
+            fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03llu}",
+                    first ? "" : ",", event->name, eventPhase(event) == ENTER ? "B" : "E", (int)getpid(),
+                    snapshots[b].tid, (unsigned long long)(nanos / 1000), (unsigned long long)(nanos % 1000));
+            first = 0;
+        }
+    }
+    fprintf(file, "\n]}\n");
+}
+
+static void writeU32(FILE* file, uint32_t value) {
+    unsigned char bytes[4] = { value, value >> 8, value >> 16, value >> 24 };
+    fwrite(bytes, 1, 4, file);
+}
+
+static void writeU64(FILE* file, uint64_t value) {
+    writeU32(file, (uint32_t)value);
+    writeU32(file, (uint32_t)(value >> 32));
+}
+
+static int comparePointers(const void* a, const void* b) {
+    uintptr_t ptrA = (uintptr_t)*(const char* const*)a;
+    uintptr_t ptrB = (uintptr_t)*(const char* const*)b;
+    return ptrA < ptrB ? -1 : ptrA > ptrB ? 1 : 0;
+}
+
+static void writeBinary(FILE* file, const struct stp_trace_snapshot* snapshots, int numSnapshots, double scale) {
+    int b;
+
+    //the name table holds every distinct name pointer, sorted so events can look up their index
+    uint64_t numEvents = 0;
+    for(b = 0; b < numSnapshots; b++) {
+        numEvents += snapshots[b].count;
+    }
+    const char** names = malloc(sizeof(const char*) * (numEvents + 1));
+    uint64_t numNames = 0, e;
+    for(b = 0; b < numSnapshots; b++) {
+        for(e = 0; e < snapshots[b].count; e++) {
+            names[numNames++] = snapshots[b].events[e].name;
+        }
+    }
+    qsort(names, numNames, sizeof(const char*), comparePointers);
+    uint32_t unique = 0, i;
+    for(e=0;e<numNames;e++) {
+        if(unique == 0 || names[unique - 1] != names[e]) {
+            names[unique++] = names[e];
+        }
+    }
+
+    fwrite("STPTRACE", 1, 8, file);
+    writeU32(file, 1);
+    writeU32(file, unique);
+    for(i=0;i<unique;i++) {
+        uint32_t length = (uint32_t)strlen(names[i]);
+        writeU32(file, length);
+        fwrite(names[i], 1, length, file);
+    }
+
+    for(b = 0; b < numSnapshots; b++) {
+        writeU32(file, (uint32_t)snapshots[b].tid);
+        writeU32(file, (uint32_t)snapshots[b].count);
+        for(e = 0; e < snapshots[b].count; e++) {
+            const struct stp_trace_event* event = &snapshots[b].events[e];
+            const char* name = event->name;
+            const char** found = bsearch(&name, names, unique, sizeof(const char*), comparePointers);
+            writeU64(file, toNanos(eventTicks(event), scale));
+            writeU32(file, (uint32_t)(found - names));
+            writeU32(file, (uint32_t)eventPhase(event));
+        }
+    }
+    free(names);
+}
+
+/**
+ * writes every thread's buffered events, replacing the previous trace file
+ */
+void stp_trace_flush(void) {
+    if(__atomic_load_n(&buffers, __ATOMIC_ACQUIRE) == NULL) {
+        return;
+    }
+
+    const char* format = getenv("STP_TRACE_FORMAT");
+    int binary = format != NULL && strcmp(format, "binary") == 0;
+    const char* filename = getenv("STP_TRACE_FILE");
+    if(filename == NULL) {
+        filename = binary ? "stp-trace.bin" : "stp-trace.json";
+    }
+
+    FILE* file = fopen(filename, binary ? "wb" : "w");
+    if(file == NULL) {
+        fprintf(stderr, "stp: cannot write trace %s\n", filename);
+        return;
+    }
+
+    struct stp_trace_snapshot* snapshots;
+    int numSnapshots = takeSnapshots(&snapshots), b;
+    if(numSnapshots < 0) {
+        fprintf(stderr, "stp: out of memory writing trace %s\n", filename);
+        fclose(file);
+        return;
+    }
+
+    double scale = nanosPerTick();
+    if(binary) {
+        writeBinary(file, snapshots, numSnapshots, scale);
+    } else {
+        writeJson(file, snapshots, numSnapshots, scale);
+    }
+    fclose(file);
+
+    for(b = 0; b < numSnapshots; b++) {
+        free(snapshots[b].events);
+    }
+    free(snapshots);
+}